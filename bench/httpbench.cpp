@@ -0,0 +1,186 @@
+// Measures the allocations and time the HTTP server spends on each request,
+// from reading it to writing its response, through a middleware chain shaped
+// like the one in main.cpp.
+//
+//   porla_httpbench [requests] [body size in bytes]
+//
+// Only allocations on the thread running the server are counted, so the
+// client in the same process does not show up in the numbers.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include "../src/httpmiddleware.hpp"
+#include "../src/httprouter.hpp"
+#include "../src/httpserver.hpp"
+
+static std::atomic<std::uint64_t> g_allocations{0};
+static std::atomic<std::uint64_t> g_bytes{0};
+static thread_local bool t_counted = false;
+
+void* operator new(std::size_t size)
+{
+    if (t_counted)
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// The routes of main.cpp, with the one requested registered last.
+static const std::vector<std::string> Routes = {
+    "/api/v1/auth/init",
+    "/api/v1/auth/login",
+    "/api/v1/system",
+    "/api/v1/events",
+    "/api/v1/ws",
+    "/api/v1/jsonrpc"
+};
+
+// Stands in for the handlers which are not the one requested.
+static void Unused(const std::shared_ptr<porla::HttpContext>& ctx)
+{
+    ctx->Write("unused");
+}
+
+static void Respond(const std::shared_ptr<porla::HttpContext>& ctx)
+{
+    ctx->Write("ok");
+}
+
+struct Result
+{
+    double allocations;
+    double bytes;
+    double micros;
+};
+
+static Result Run(bool router, int requests, std::size_t body_size)
+{
+    namespace http = boost::beast::http;
+
+    boost::asio::io_context io;
+
+    porla::HttpServer server(io, porla::HttpServerOptions{
+        .listeners = { porla::HttpListener{ .host = "127.0.0.1" } }
+    });
+
+    // The routes are either found in the router, or tried one by one by a
+    // chain of method middlewares.
+    if (router)
+    {
+        porla::HttpRouter r;
+        for (std::size_t i = 0; i + 1 < Routes.size(); i++) r.Post(Routes[i], Unused);
+        r.Post(Routes.back(), Respond);
+
+        server.Use(r);
+    }
+    else
+    {
+        for (std::size_t i = 0; i + 1 < Routes.size(); i++) server.Use(porla::HttpPost(Routes[i], Unused));
+        server.Use(porla::HttpPost(Routes.back(), Respond));
+    }
+
+    auto const port = server.Endpoint().port();
+    auto work = boost::asio::make_work_guard(io);
+
+    std::thread thread(
+        [&io]()
+        {
+            t_counted = true;
+            io.run();
+        });
+
+    boost::asio::io_context client_io;
+    boost::asio::ip::tcp::socket socket(client_io);
+    socket.connect({ boost::asio::ip::make_address("127.0.0.1"), port });
+
+    http::request<http::string_body> req{http::verb::post, Routes.back(), 11};
+    req.set(http::field::host, "localhost");
+    req.keep_alive(true);
+    req.body() = std::string(body_size, 'x');
+    req.prepare_payload();
+
+    boost::beast::flat_buffer buffer;
+
+    auto const roundtrip = [&]()
+    {
+        http::write(socket, req);
+
+        http::response<http::string_body> res;
+        http::read(socket, buffer, res);
+
+        if (res.body() != "ok")
+        {
+            std::cerr << "Unexpected response: " << res.body() << std::endl;
+            std::exit(1);
+        }
+    };
+
+    // Warm up the connection and the buffers before measuring.
+    for (int i = 0; i < 100; i++) roundtrip();
+
+    auto const allocations = g_allocations.load();
+    auto const bytes = g_bytes.load();
+    auto const start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < requests; i++) roundtrip();
+
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    Result const result{
+        .allocations = static_cast<double>(g_allocations.load() - allocations) / requests,
+        .bytes       = static_cast<double>(g_bytes.load() - bytes) / requests,
+        .micros      = std::chrono::duration<double, std::micro>(elapsed).count() / requests
+    };
+
+    socket.close();
+    work.reset();
+    io.stop();
+    thread.join();
+
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    int const requests = argc > 1 ? std::atoi(argv[1]) : 10000;
+    std::size_t const body_size = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+
+    std::cout << requests << " requests with a " << body_size << " byte body" << std::endl;
+
+    for (bool const router : { false, true })
+    {
+        auto const r = Run(router, requests, body_size);
+
+        std::cout << (router ? "router" : "chain ")
+                  << "  allocations/request: " << r.allocations
+                  << "  bytes/request: " << r.bytes
+                  << "  us/request: " << r.micros
+                  << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+// Measures the allocations and CPU time of a torrents.list call through the
+// JSON-RPC handler, split into decoding the body, converting the params into
+// the request struct, looking the method up, and the whole call including the
+// dispatch.
+//
+//   porla_rpcbench [calls]
+//
+// The method converts its params like Methods::Method does and answers with
+// an empty result, so only the handler's own cost is measured.
+
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+
+#include "../src/jsonrpchandler.hpp"
+#include "../src/json/utils.hpp"
+#include "../src/utils/wireencoding.hpp"
+
+using json = nlohmann::json;
+
+static std::uint64_t g_allocations = 0;
+static bool g_counted = false;
+
+void* operator new(std::size_t size)
+{
+    if (g_counted) g_allocations++;
+
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace porla::Methods
+{
+    // Has the fields of TorrentsListReq, whose header needs libtorrent.
+    struct BenchListReq
+    {
+        std::optional<std::string> cursor;
+        std::optional<json> filters;
+        std::optional<std::vector<std::string>> include_metadata;
+        std::optional<int> page;
+        std::optional<int> page_size;
+        std::optional<std::string> order_by;
+        std::optional<std::string> order_by_dir;
+        std::optional<std::uint64_t> since;
+    };
+
+    NLOHMANN_JSONIFY_ALL_THINGS(
+        BenchListReq,
+        cursor,
+        filters,
+        include_metadata,
+        order_by,
+        order_by_dir,
+        page,
+        page_size,
+        since);
+}
+
+// A torrents.list call as the web UI sends it, with a filter.
+static const std::string Body = R"({"jsonrpc":"2.0","id":1,"method":"torrents.list","params":{)"
+    R"("page":0,"page_size":50,"order_by":"name","order_by_dir":"asc","include_metadata":["tags","notes"],)"
+    R"("filters":{"and":[{"field":"category","args":"movies"},{"field":"size","op":"range","args":{"gte":1000000}},)"
+    R"({"or":[{"field":"tags","args":["x264","hevc"]},{"field":"name","op":"contains","args":"1080p"}]}]}}})";
+
+// The names registered in main.cpp.
+static const std::vector<std::string> Names = {
+    "presets.list", "session.pause", "session.resume", "session.settings.list", "session.settings.update",
+    "sys.versions", "torrents.add", "torrents.files.list", "torrents.list", "torrents.metadata.list",
+    "torrents.move", "torrents.pause", "torrents.peers.add", "torrents.peers.list", "torrents.properties.get",
+    "torrents.properties.set", "torrents.recheck", "torrents.query", "torrents.remove", "torrents.resume",
+    "torrents.trackers.list"
+};
+
+class BenchContext : public porla::HttpContext
+{
+public:
+    explicit BenchContext(boost::asio::io_context& io)
+        : m_stream(io)
+        , m_req(boost::beast::http::verb::post, "/api/v1/jsonrpc", 11)
+    {
+        m_req.body() = Body;
+    }
+
+    void Next() override {}
+    boost::beast::http::request<boost::beast::http::string_body>& Request() override { return m_req; }
+    Uri& RequestUri() override { return m_uri; }
+    porla::HttpStream& Stream() override { return m_stream; }
+    porla::HttpStream& TakeStream() override { return m_stream; }
+
+    void Write(std::string) override { Unexpected(); }
+    void Write(boost::beast::http::response<boost::beast::http::file_body>) override { Unexpected(); }
+    void Write(boost::beast::http::response<boost::beast::http::string_body>) override { Unexpected(); }
+    void WriteChunked(boost::beast::http::response<boost::beast::http::empty_body>, ChunkProducer) override { Unexpected(); }
+
+    void WriteJson(const nlohmann::json& j) override
+    {
+        if (!j.contains("result")) Unexpected();
+    }
+
+private:
+    static void Unexpected()
+    {
+        std::cerr << "Unexpected response" << std::endl;
+        std::exit(1);
+    }
+
+    porla::HttpStream m_stream;
+    boost::beast::http::request<boost::beast::http::string_body> m_req;
+    Uri m_uri;
+};
+
+template<typename F>
+static void Measure(const char* name, int calls, F&& f)
+{
+    // Warm up before measuring.
+    for (int i = 0; i < 100; i++) f();
+
+    g_allocations = 0;
+    g_counted = true;
+
+    auto const start = std::clock();
+
+    for (int i = 0; i < calls; i++) f();
+
+    auto const elapsed = std::clock() - start;
+
+    g_counted = false;
+
+    std::cout << name
+              << "  allocations/call: " << static_cast<double>(g_allocations) / calls
+              << "  us/call: " << 1e6 * static_cast<double>(elapsed) / CLOCKS_PER_SEC / calls
+              << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int const calls = argc > 1 ? std::atoi(argv[1]) : 100000;
+
+    // Porla logs at info by default, which leaves out the per-call debug line.
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::info);
+
+    boost::asio::io_context io;
+
+    std::map<std::string, porla::JsonRpcMethod> methods;
+
+    for (auto const& name : Names)
+    {
+        methods.insert({
+            name,
+            [](const json& params, const std::optional<json>& id, std::shared_ptr<porla::HttpContext> ctx)
+            {
+                auto const req = params.get<porla::Methods::BenchListReq>();
+                if (!req.filters.has_value()) std::exit(1);
+
+                ctx->WriteJson({{"jsonrpc", "2.0"}, {"id", id.value()}, {"result", json::object()}});
+            }
+        });
+    }
+
+    porla::JsonRpcHandler rpc(std::move(methods));
+    auto const ctx = std::make_shared<BenchContext>(io);
+
+    std::cout << calls << " calls with a " << Body.size() << " byte body" << std::endl;
+
+    Measure("decode ", calls, [&ctx]()
+    {
+        auto const j = porla::Utils::Decode(ctx->Request().body(), porla::Utils::WireEncoding::Json);
+        if (!j.is_object()) std::exit(1);
+    });
+
+    Measure("convert", calls, [&ctx]()
+    {
+        auto const j = porla::Utils::Decode(ctx->Request().body(), porla::Utils::WireEncoding::Json);
+        auto const req = j["params"].get<porla::Methods::BenchListReq>();
+        if (!req.filters.has_value()) std::exit(1);
+    });
+
+    // The method lookup on its own, in a map like the one of the handler.
+    std::map<std::string, int> table;
+    for (auto const& name : Names) table.insert({ name, 0 });
+
+    std::string const method = "torrents.list";
+
+    Measure("lookup ", calls, [&table, &method]()
+    {
+        if (table.find(method) == table.end()) std::exit(1);
+    });
+
+    Measure("call   ", calls, [&rpc, &ctx]() { rpc(ctx); });
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Compares the size of a torrents.list response, and the CPU time spent
+// encoding and decoding it, in JSON with hex info hashes against CBOR and
+// MessagePack with binary info hashes.
+//
+//   porla_wirebench [torrents] [rounds]
+//
+// The response has the fields of TorrentsListRes::Item, built directly as
+// json values so the benchmark does not need a session.
+
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "../src/utils/wireencoding.hpp"
+
+using json = nlohmann::json;
+using porla::Utils::WireEncoding;
+
+static std::vector<std::uint8_t> RandomBytes(std::mt19937& rng, std::size_t size)
+{
+    std::vector<std::uint8_t> bytes(size);
+    for (auto& b : bytes) b = static_cast<std::uint8_t>(rng());
+    return bytes;
+}
+
+static std::string Hex(const std::vector<std::uint8_t>& bytes)
+{
+    static constexpr char Digits[] = "0123456789abcdef";
+
+    std::string hex;
+    hex.reserve(bytes.size() * 2);
+
+    for (auto const b : bytes)
+    {
+        hex.push_back(Digits[b >> 4]);
+        hex.push_back(Digits[b & 0xf]);
+    }
+
+    return hex;
+}
+
+static json Response(int torrents, bool binary)
+{
+    std::mt19937 rng(1);
+    json items = json::array();
+
+    for (int i = 0; i < torrents; i++)
+    {
+        auto const v1 = RandomBytes(rng, 20);
+        auto const v2 = RandomBytes(rng, 32);
+
+        json const info_hash = binary
+            ? json::array({ json::binary(v1), json::binary(v2) })
+            : json::array({ Hex(v1), Hex(v2) });
+
+        items.push_back({
+            {"all_time_download", 1073741824LL + i},
+            {"all_time_upload", 536870912LL + i},
+            {"category", "linux"},
+            {"download_rate", 1048576},
+            {"error", nullptr},
+            {"eta", 3600},
+            {"flags", 1234},
+            {"info_hash", info_hash},
+            {"list_peers", 50},
+            {"list_seeds", 25},
+            {"metadata", json::object()},
+            {"moving_storage", false},
+            {"name", "ubuntu-22.04." + std::to_string(i) + "-desktop-amd64.iso"},
+            {"num_peers", 12},
+            {"num_seeds", 8},
+            {"progress", 0.5},
+            {"queue_position", i},
+            {"ratio", 0.5},
+            {"save_path", "/mnt/downloads/linux"},
+            {"size", 3654957056LL},
+            {"state", 3},
+            {"tags", json::array({ "iso", "ubuntu" })},
+            {"total", 3654957056LL},
+            {"total_done", 1827478528LL},
+            {"upload_rate", 524288}
+        });
+    }
+
+    return {
+        {"jsonrpc", "2.0"},
+        {"id", 1},
+        {"result", {
+            {"cursor", nullptr},
+            {"page", 0},
+            {"page_size", torrents},
+            {"removed", json::array()},
+            {"torrents", std::move(items)},
+            {"torrents_total", torrents},
+            {"version", 1}
+        }}
+    };
+}
+
+static double CpuMicros(std::clock_t start, int rounds)
+{
+    return 1e6 * static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC / rounds;
+}
+
+int main(int argc, char* argv[])
+{
+    int const torrents = argc > 1 ? std::atoi(argv[1]) : 1000;
+    int const rounds = argc > 2 ? std::atoi(argv[2]) : 100;
+
+    std::cout << torrents << " torrents, " << rounds << " rounds" << std::endl;
+
+    for (auto const encoding : { WireEncoding::Json, WireEncoding::Cbor, WireEncoding::MsgPack })
+    {
+        auto const response = Response(torrents, encoding != WireEncoding::Json);
+
+        std::size_t size = 0;
+        auto start = std::clock();
+
+        for (int i = 0; i < rounds; i++) size = porla::Utils::Encode(response, encoding).size();
+
+        auto const encode = CpuMicros(start, rounds);
+        auto const body = porla::Utils::Encode(response, encoding);
+
+        if (porla::Utils::Decode(body, encoding) != response)
+        {
+            std::cerr << "Round trip through " << porla::Utils::ContentType(encoding) << " changed the response" << std::endl;
+            return 1;
+        }
+
+        start = std::clock();
+
+        for (int i = 0; i < rounds; i++) porla::Utils::Decode(body, encoding);
+
+        auto const decode = CpuMicros(start, rounds);
+
+        std::cout << porla::Utils::ContentType(encoding)
+                  << "  bytes: " << size
+                  << "  encode us: " << encode
+                  << "  decode us: " << decode
+                  << std::endl;
+    }
+
+    return 0;
+}
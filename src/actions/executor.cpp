@@ -6,13 +6,11 @@
 #include "action.hpp"
 #include "actioncallback.hpp"
 
-#include "../data/models/torrentsmetadata.hpp"
 #include "../session.hpp"
 
 using porla::Actions::Action;
 using porla::Actions::ActionCallback;
 using porla::Actions::Executor;
-using porla::Data::Models::TorrentsMetadata;
 
 struct ActionState
 {
@@ -57,7 +55,7 @@ private:
 };
 
 Executor::Executor(const ExecutorOptions& options)
-    : m_db(options.db)
+    : m_metadata(options.metadata)
     , m_io(options.io)
     , m_session(options.session)
     , m_actions(options.actions)
@@ -89,9 +87,9 @@ void Executor::Run(
 {
     // Get the preset for this torrent. If it has none, use the default
     // if it exists.
-    auto const torrent_metadata = TorrentsMetadata::GetAll(m_db, ts.info_hashes);
-    auto const preset_name = torrent_metadata.contains("preset")
-        ? torrent_metadata.at("preset").get<std::string>()
+    auto const preset_value = m_metadata.Get(ts.info_hashes, "preset");
+    auto const preset_name = preset_value != nullptr
+        ? preset_value->get<std::string>()
         : "default";
 
     auto const& preset = m_presets.find(preset_name);
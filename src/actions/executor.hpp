@@ -7,9 +7,9 @@
 #include <boost/asio.hpp>
 #include <boost/signals2.hpp>
 #include <libtorrent/torrent_status.hpp>
-#include <sqlite3.h>
 
 #include "../config.hpp"
+#include "../data/metadatacache.hpp"
 
 namespace porla
 {
@@ -22,7 +22,7 @@ namespace porla::Actions
 
     struct ExecutorOptions
     {
-        sqlite3* db;
+        Data::MetadataCache& metadata;
         boost::asio::io_context& io;
         std::map<std::string, porla::Config::Preset> presets;
         porla::ISession& session;
@@ -44,7 +44,7 @@ namespace porla::Actions
             const libtorrent::torrent_status& ts,
             const std::function<std::vector<Config::PresetAction>(const Config::Preset&)>& selector);
 
-        sqlite3* m_db;
+        Data::MetadataCache& m_metadata;
         boost::asio::io_context& m_io;
         ISession& m_session;
 
@@ -15,15 +15,14 @@ ForceReannounce::ForceReannounce(porla::ISession& session)
 
 void ForceReannounce::Invoke(const libtorrent::info_hash_t& hash, const toml::array& args, const std::shared_ptr<ActionCallback>& callback)
 {
-    auto const& torrents = m_session.Torrents();
-    auto const& torrent = torrents.find(hash);
+    auto const torrent = m_session.Torrents().Find(hash);
 
-    if (torrent == torrents.end())
+    if (torrent == nullptr)
     {
         return;
     }
 
-    BOOST_LOG_TRIVIAL(debug) << "Forcing reannounce for " << torrent->second.status().name;
+    BOOST_LOG_TRIVIAL(debug) << "Forcing reannounce for " << torrent->status.name;
 
-    torrent->second.force_reannounce();
+    torrent->handle.force_reannounce();
 }
@@ -25,10 +25,9 @@ Move::~Move()
 
 void Move::Invoke(const libtorrent::info_hash_t& hash, const toml::array& args, const std::shared_ptr<ActionCallback>& callback)
 {
-    auto const& torrents = m_session.Torrents();
-    auto const& handle = torrents.find(hash);
+    auto const torrent = m_session.Torrents().Find(hash);
 
-    if (handle == torrents.end())
+    if (torrent == nullptr)
     {
         BOOST_LOG_TRIVIAL(warning) << "(move) Could not find torrent";
         return;
@@ -41,9 +40,9 @@ void Move::Invoke(const libtorrent::info_hash_t& hash, const toml::array& args,
 
     const std::string target_path = *args[0].value<std::string>();
 
-    BOOST_LOG_TRIVIAL(debug) << "Moving torrent " << handle->second.status().name << " to " << target_path;
+    BOOST_LOG_TRIVIAL(debug) << "Moving torrent " << torrent->status.name << " to " << target_path;
 
-    handle->second.move_storage(target_path);
+    torrent->handle.move_storage(target_path);
 
     auto ctx = std::make_unique<MoveContext>();
     ctx->callback = callback;
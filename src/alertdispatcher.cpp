@@ -0,0 +1,98 @@
+#include "alertdispatcher.hpp"
+
+#include <chrono>
+
+#include <boost/log/trivial.hpp>
+
+namespace lt = libtorrent;
+
+using porla::AlertDispatcher;
+
+void AlertDispatcher::Dispatch(const lt::alert* alert)
+{
+    int const type = alert->type();
+
+    if (type < 0 || type >= lt::num_alert_types)
+    {
+        return;
+    }
+
+    m_count[type]++;
+
+    if (type == lt::alerts_dropped_alert::alert_type)
+    {
+        auto const ada = lt::alert_cast<lt::alerts_dropped_alert>(alert);
+
+        for (int i = 0; i < lt::num_alert_types; i++)
+        {
+            if (ada->dropped_alerts.test(i)) m_dropped[i]++;
+        }
+    }
+
+    if (m_signals[type].empty())
+    {
+        return;
+    }
+
+    BOOST_LOG_TRIVIAL(trace) << "Session alert: " << alert->message();
+
+    auto const started = std::chrono::steady_clock::now();
+
+    m_signals[type](alert);
+
+    m_handler_time_us[type] += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+}
+
+lt::alert_category_t AlertDispatcher::Mask() const
+{
+    lt::alert_category_t mask{};
+
+    for (int i = 0; i < lt::num_alert_types; i++)
+    {
+        if (!m_signals[i].empty()) mask |= m_categories[i];
+    }
+
+    return mask;
+}
+
+std::vector<AlertDispatcher::TypeStats> AlertDispatcher::GetStats() const
+{
+    std::vector<TypeStats> stats;
+
+    for (int i = 0; i < lt::num_alert_types; i++)
+    {
+        if (m_signals[i].empty() && m_count[i] == 0 && m_dropped[i] == 0)
+        {
+            continue;
+        }
+
+        stats.push_back(TypeStats{
+            .type            = i,
+            .name            = lt::alert_name(i),
+            .count           = m_count[i],
+            .dropped         = m_dropped[i],
+            .handler_time_us = m_handler_time_us[i]
+        });
+    }
+
+    return stats;
+}
+
+boost::signals2::connection AlertDispatcher::Connect(
+    int type,
+    lt::alert_category_t category,
+    const AlertSignal::slot_type& slot)
+{
+    lt::alert_category_t const before = Mask();
+
+    auto connection = m_signals[type].connect(slot);
+    m_categories[type] = category;
+
+    if (lt::alert_category_t const after = Mask(); after != before && m_mask_changed)
+    {
+        m_mask_changed(after);
+    }
+
+    return connection;
+}
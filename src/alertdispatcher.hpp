@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <boost/signals2.hpp>
+#include <libtorrent/alert.hpp>
+#include <libtorrent/alert_types.hpp>
+
+namespace porla
+{
+    /*
+     * Routes libtorrent alerts to the handlers subscribed to their type. The
+     * alert mask the session needs is the union of the categories of every
+     * subscribed alert type. The number of alerts dispatched, the number
+     * dropped by libtorrent and the time spent in handlers are kept per type.
+     */
+    class AlertDispatcher
+    {
+    public:
+        typedef boost::signals2::signal<void(const libtorrent::alert*)> AlertSignal;
+        typedef std::function<void(libtorrent::alert_category_t)> MaskChangedCallback;
+
+        struct TypeStats
+        {
+            int type;
+            std::string name;
+            std::uint64_t count;
+            std::uint64_t dropped;
+            std::uint64_t handler_time_us;
+        };
+
+        AlertDispatcher() = default;
+        AlertDispatcher(const AlertDispatcher&) = delete;
+        AlertDispatcher& operator=(const AlertDispatcher&) = delete;
+
+        template<typename T>
+        boost::signals2::connection Subscribe(std::function<void(const T*)> handler)
+        {
+            return Connect(
+                T::alert_type,
+                T::static_category,
+                [handler = std::move(handler)](const libtorrent::alert* alert)
+                {
+                    handler(static_cast<const T*>(alert));
+                });
+        }
+
+        void Dispatch(const libtorrent::alert* alert);
+
+        [[nodiscard]] libtorrent::alert_category_t Mask() const;
+        void OnMaskChanged(MaskChangedCallback cb) { m_mask_changed = std::move(cb); }
+
+        // Returns the stats for every alert type which has been subscribed to,
+        // dispatched or dropped.
+        [[nodiscard]] std::vector<TypeStats> GetStats() const;
+
+    private:
+        boost::signals2::connection Connect(
+            int type,
+            libtorrent::alert_category_t category,
+            const AlertSignal::slot_type& slot);
+
+        std::array<AlertSignal, libtorrent::num_alert_types> m_signals;
+        std::array<libtorrent::alert_category_t, libtorrent::num_alert_types> m_categories{};
+        MaskChangedCallback m_mask_changed;
+
+        std::array<std::atomic_uint64_t, libtorrent::num_alert_types> m_count{};
+        std::array<std::atomic_uint64_t, libtorrent::num_alert_types> m_dropped{};
+        std::array<std::atomic_uint64_t, libtorrent::num_alert_types> m_handler_time_us{};
+    };
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <functional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/log/trivial.hpp>
+#include <libtorrent/hex.hpp>
+#include <sqlite3.h>
+
+#include "torrentregistry.hpp"
+
+namespace porla
+{
+    /*
+     * A virtual table of rows belonging to a torrent, such as its peers or its
+     * files. The first two columns are the info_hash_v1 and info_hash_v2 of the
+     * torrent a row belongs to.
+     *
+     * Rows are loaded one torrent at a time as the cursor moves. An equality
+     * constraint on either info hash loads the rows of that torrent only, so a
+     * join with the torrents table loads rows for the joined torrents only.
+     */
+    template<typename Row>
+    class ChildVTable
+    {
+    public:
+        typedef std::function<void(const Row&, sqlite3_context*)> Column;
+        typedef std::function<void(const TorrentRegistry::Entry&, std::vector<Row>&)> Loader;
+
+        static int Install(
+            sqlite3* db,
+            const std::string& name,
+            const TorrentRegistry& torrents,
+            std::vector<std::pair<std::string, Column>> columns,
+            Loader loader)
+        {
+            auto module = new Module{
+                .name     = name,
+                .torrents = torrents,
+                .columns  = std::move(columns),
+                .loader   = std::move(loader),
+                .module   = {}
+            };
+
+            module->module.iVersion    = 0;
+            module->module.xCreate     = &Connect;
+            module->module.xConnect    = &Connect;
+            module->module.xBestIndex  = &BestIndex;
+            module->module.xDisconnect = &Disconnect;
+            module->module.xDestroy    = &Disconnect;
+            module->module.xOpen       = &Open;
+            module->module.xClose      = &Close;
+            module->module.xFilter     = &Filter;
+            module->module.xNext       = &Next;
+            module->module.xEof        = &Eof;
+            module->module.xColumn     = &ColumnValue;
+            module->module.xRowid      = &Rowid;
+
+            std::string const module_name = "porla_" + name;
+
+            int res = sqlite3_create_module_v2(
+                db,
+                module_name.c_str(),
+                &module->module,
+                module,
+                [](void* aux) { delete static_cast<Module*>(aux); });
+
+            if (res != SQLITE_OK)
+            {
+                BOOST_LOG_TRIVIAL(error) << "Failed to create '" << module_name << "' SQLite module: " << sqlite3_errmsg(db);
+                return res;
+            }
+
+            std::string const create = "create virtual table " + name + " using " + module_name;
+
+            res = sqlite3_exec(db, create.c_str(), nullptr, nullptr, nullptr);
+
+            if (res != SQLITE_OK)
+            {
+                BOOST_LOG_TRIVIAL(error) << "Failed to create virtual '" << name << "' table: " << sqlite3_errmsg(db);
+                return res;
+            }
+
+            return SQLITE_OK;
+        }
+
+    private:
+        // Rows per torrent we assume when estimating costs.
+        static constexpr double RowsPerTorrent = 50;
+
+        static constexpr int IdxScan = 0;
+        static constexpr int IdxInfoHashV1 = 1;
+        static constexpr int IdxInfoHashV2 = 2;
+
+        struct Module
+        {
+            std::string name;
+            const TorrentRegistry& torrents;
+            std::vector<std::pair<std::string, Column>> columns;
+            Loader loader;
+            sqlite3_module module;
+        };
+
+        struct VTable
+        {
+            sqlite3_vtab base;
+            Module* module;
+        };
+
+        struct Cursor
+        {
+            sqlite3_vtab_cursor base{};
+
+            // The torrent ids to visit. Every id is visited when scanning.
+            bool scan;
+            std::vector<TorrentRegistry::Id> ids;
+            std::size_t next_torrent;
+
+            std::string info_hash_v1;
+            std::string info_hash_v2;
+            std::vector<Row> rows;
+            std::size_t row;
+            sqlite3_int64 rowid;
+            bool eof;
+        };
+
+        template<typename T>
+        static std::string ToString(const T &hash)
+        {
+            std::stringstream ss;
+            ss << hash;
+            return ss.str();
+        }
+
+        static int Connect(sqlite3* db, void* aux, int argc, const char* const* argv, sqlite3_vtab** pp_vt, char** pzErr)
+        {
+            auto module = static_cast<Module*>(aux);
+
+            std::stringstream spec;
+            spec << "CREATE TABLE " << module->name << " (\n";
+            spec << "info_hash_v1,\n";
+            spec << "info_hash_v2";
+
+            for (auto const& [col, _] : module->columns)
+            {
+                spec << ",\n" << col;
+            }
+
+            spec << ");";
+
+            if (sqlite3_declare_vtab(db, spec.str().c_str()) != SQLITE_OK)
+            {
+                return SQLITE_ERROR;
+            }
+
+            auto vtab = new VTable();
+            vtab->module = module;
+
+            *pp_vt = &vtab->base;
+
+            return SQLITE_OK;
+        }
+
+        static int Disconnect(sqlite3_vtab* pVtab)
+        {
+            delete reinterpret_cast<VTable*>(pVtab);
+            return SQLITE_OK;
+        }
+
+        // The info hashes are looked up byte for byte, which only finds the
+        // rows SQLite would match when the constraint uses BINARY collation.
+        static bool BinaryCollation(sqlite3_index_info* pIdxInfo, int constraint)
+        {
+#if SQLITE_VERSION_NUMBER >= 3022000
+            auto const collation = sqlite3_vtab_collation(pIdxInfo, constraint);
+            return collation == nullptr || sqlite3_stricmp(collation, "BINARY") == 0;
+#else
+            return false;
+#endif
+        }
+
+        static int BestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo)
+        {
+            auto vtab = reinterpret_cast<VTable*>(tab);
+
+            for (int i = 0; i < pIdxInfo->nConstraint; i++)
+            {
+                auto const& constraint = pIdxInfo->aConstraint[i];
+
+                if (!constraint.usable
+                    || constraint.op != SQLITE_INDEX_CONSTRAINT_EQ
+                    || (constraint.iColumn != 0 && constraint.iColumn != 1)
+                    || !BinaryCollation(pIdxInfo, i))
+                {
+                    continue;
+                }
+
+                pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+                pIdxInfo->idxNum = constraint.iColumn == 0 ? IdxInfoHashV1 : IdxInfoHashV2;
+                pIdxInfo->estimatedCost = RowsPerTorrent;
+                pIdxInfo->estimatedRows = static_cast<sqlite3_int64>(RowsPerTorrent);
+
+                return SQLITE_OK;
+            }
+
+            double const torrents = std::max<double>(static_cast<double>(vtab->module->torrents.Size()), 1);
+
+            pIdxInfo->idxNum = IdxScan;
+            pIdxInfo->estimatedCost = torrents * RowsPerTorrent;
+            pIdxInfo->estimatedRows = static_cast<sqlite3_int64>(torrents * RowsPerTorrent);
+
+            return SQLITE_OK;
+        }
+
+        static int Open(sqlite3_vtab* pVTab, sqlite3_vtab_cursor** pp_cursor)
+        {
+            auto cursor = new Cursor();
+            cursor->scan = false;
+            cursor->next_torrent = 0;
+            cursor->row = 0;
+            cursor->rowid = 0;
+            cursor->eof = true;
+
+            *pp_cursor = reinterpret_cast<sqlite3_vtab_cursor*>(cursor);
+
+            return SQLITE_OK;
+        }
+
+        static int Close(sqlite3_vtab_cursor* cur)
+        {
+            delete reinterpret_cast<Cursor*>(cur);
+            return SQLITE_OK;
+        }
+
+        // Moves to the next row, loading the rows of the next torrent when the
+        // current one has no more.
+        static void Advance(Cursor* cursor, const Module* module)
+        {
+            while (cursor->row >= cursor->rows.size())
+            {
+                const TorrentRegistry::Entry* entry = nullptr;
+
+                if (cursor->scan)
+                {
+                    if (cursor->next_torrent >= module->torrents.IdLimit()) break;
+                    entry = module->torrents.At(static_cast<TorrentRegistry::Id>(cursor->next_torrent));
+                }
+                else
+                {
+                    if (cursor->next_torrent >= cursor->ids.size()) break;
+                    entry = module->torrents.At(cursor->ids[cursor->next_torrent]);
+                }
+
+                cursor->next_torrent++;
+                cursor->rows.clear();
+                cursor->row = 0;
+
+                if (entry == nullptr || !entry->handle.is_valid())
+                {
+                    continue;
+                }
+
+                auto const& hashes = entry->status.info_hashes;
+
+                cursor->info_hash_v1 = hashes.has_v1() ? ToString(hashes.v1) : std::string();
+                cursor->info_hash_v2 = hashes.has_v2() ? ToString(hashes.v2) : std::string();
+
+                module->loader(*entry, cursor->rows);
+            }
+
+            cursor->eof = cursor->row >= cursor->rows.size();
+        }
+
+        static int Filter(sqlite3_vtab_cursor* p_vtc, int idxNum, const char* idxStr, int argc, sqlite3_value** argv)
+        {
+            auto cursor = reinterpret_cast<Cursor*>(p_vtc);
+            auto vtab = reinterpret_cast<VTable*>(p_vtc->pVtab);
+            auto const& torrents = vtab->module->torrents;
+
+            cursor->scan = idxNum == IdxScan;
+            cursor->ids.clear();
+            cursor->next_torrent = 0;
+            cursor->rows.clear();
+            cursor->row = 0;
+            cursor->rowid = 0;
+
+            if (!cursor->scan && argc > 0 && sqlite3_value_type(argv[0]) == SQLITE_TEXT)
+            {
+                std::string const value = reinterpret_cast<const char*>(sqlite3_value_text(argv[0]));
+                const TorrentRegistry::Entry* entry = nullptr;
+
+                if (idxNum == IdxInfoHashV1 && value.size() == 40)
+                {
+                    lt::sha1_hash hash;
+                    if (lt::aux::from_hex({ value.c_str(), 40 }, hash.data())) entry = torrents.FindV1(hash);
+                }
+                else if (idxNum == IdxInfoHashV2 && value.size() == 64)
+                {
+                    lt::sha256_hash hash;
+                    if (lt::aux::from_hex({ value.c_str(), 64 }, hash.data())) entry = torrents.FindV2(hash);
+                }
+
+                if (entry != nullptr)
+                {
+                    cursor->ids.push_back(entry->id);
+                }
+            }
+
+            Advance(cursor, vtab->module);
+
+            return SQLITE_OK;
+        }
+
+        static int Next(sqlite3_vtab_cursor* cur)
+        {
+            auto cursor = reinterpret_cast<Cursor*>(cur);
+            auto vtab = reinterpret_cast<VTable*>(cur->pVtab);
+
+            if (!cursor->eof)
+            {
+                cursor->row++;
+                cursor->rowid++;
+                Advance(cursor, vtab->module);
+            }
+
+            return SQLITE_OK;
+        }
+
+        static int Eof(sqlite3_vtab_cursor* cur)
+        {
+            return reinterpret_cast<Cursor*>(cur)->eof ? 1 : 0;
+        }
+
+        static int ColumnValue(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i)
+        {
+            auto cursor = reinterpret_cast<Cursor*>(cur);
+            auto vtab = reinterpret_cast<VTable*>(cur->pVtab);
+
+            if (cursor->eof)
+            {
+                sqlite3_result_null(ctx);
+                return SQLITE_OK;
+            }
+
+            if (i == 0 || i == 1)
+            {
+                auto const& hash = i == 0 ? cursor->info_hash_v1 : cursor->info_hash_v2;
+
+                hash.empty()
+                    ? sqlite3_result_null(ctx)
+                    : sqlite3_result_text(ctx, hash.c_str(), -1, SQLITE_TRANSIENT);
+
+                return SQLITE_OK;
+            }
+
+            auto const column = static_cast<std::size_t>(i - 2);
+
+            if (column >= vtab->module->columns.size())
+            {
+                sqlite3_result_null(ctx);
+                return SQLITE_OK;
+            }
+
+            vtab->module->columns[column].second(cursor->rows[cursor->row], ctx);
+
+            return SQLITE_OK;
+        }
+
+        static int Rowid(sqlite3_vtab_cursor* cur, sqlite_int64* p_rowid)
+        {
+            *p_rowid = reinterpret_cast<Cursor*>(cur)->rowid;
+            return SQLITE_OK;
+        }
+    };
+}
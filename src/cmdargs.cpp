@@ -10,20 +10,37 @@ static po::options_description Options()
     po::options_description desc("Allowed options");
     desc.add_options()
         ("config-file",           po::value<std::string>(), "Path to a porla.toml config file.")
+        ("cpu-pinning",           po::value<bool>(),        "Set to true to pin the session and HTTP threads to separate CPUs.")
         ("db",                    po::value<std::string>(), "Path to where the database will be stored.")
         ("help",                                            "Show usage")
+        ("http-acceptors",        po::value<int>(),         "The number of SO_REUSEPORT acceptors to listen for HTTP traffic with.")
         ("http-base-path",        po::value<std::string>(), "The base path for HTTP routes")
         ("http-host",             po::value<std::string>(), "The host to listen on for HTTP traffic.")
+        ("http-idle-timeout",     po::value<int>(),         "The time (in milliseconds) an HTTP connection may be idle before it is closed.")
+        ("http-listener",         po::value<std::vector<std::string>>(), "An address (host:port or unix:/path) to listen for HTTP traffic on. May be given more than once, and replaces the host, port and Unix socket options.")
+        ("http-max-connections",  po::value<int>(),         "The maximum number of open HTTP connections.")
         ("http-metrics-enabled",  po::value<bool>(),        "Set to true if the metrics endpoint should be enabled")
+        ("http-pipeline-depth",   po::value<int>(),         "The maximum number of pipelined HTTP requests in progress per connection.")
         ("http-port",             po::value<uint16_t>(),    "The port to listen on for HTTP traffic.")
+        ("http-request-timeout",  po::value<int>(),         "The time (in milliseconds) to read an HTTP request or write its response.")
+        ("http-threads",          po::value<int>(),         "The number of threads to run the HTTP server on.")
+        ("http-unix-socket",      po::value<std::string>(), "The path of a Unix domain socket to also listen for HTTP traffic on.")
+        ("http-unix-socket-mode", po::value<std::string>(), "The permissions (in octal) of the Unix domain socket.")
         ("http-webui-enabled",    po::value<bool>(),        "Set to true if the web UI should be enabled")
+        ("http-websocket-deflate", po::value<bool>(),       "Set to true to compress WebSocket messages for clients which support it")
         ("log-level",             po::value<std::string>(), "The minimum log level to print.")
+        ("query-max-steps",       po::value<int>(),         "The maximum number of SQLite VM steps a torrents query may run.")
+        ("query-timeout",         po::value<int>(),         "The maximum time in milliseconds a torrents query may run.")
+        ("rpc-queue-limit",       po::value<int>(),         "The maximum number of heavy RPC calls queued or running on the workers.")
+        ("rpc-workers",           po::value<int>(),         "The number of threads to run heavy RPC calls on.")
         ("secret-key",            po::value<std::string>(), "The secret key to use when protecting various pieces of data.")
         ("session-settings-base", po::value<std::string>(), "The libtorrent base settings to use")
+        ("shutdown-timeout",      po::value<int>(),         "The maximum time in milliseconds to spend saving resume data on shutdown.")
         ("state-dir",             po::value<std::string>(), "The path to a directory where Porla state will be saved.")
         ("supervised-interval",   po::value<int>(),         "The interval to use when checking the supervisor pid.")
         ("supervised-pid",        po::value<pid_t>(),       "A pid to a parent process. If this pid dies, we shut down.")
         ("timer-dht-stats",       po::value<int>(),         "The interval to use for the DHT stats updates.")
+        ("timer-resume-data-flush", po::value<int>(),       "The interval to use when flushing queued resume data to the database.")
         ("timer-session-stats",   po::value<int>(),         "The interval to use for the session stats updates.")
         ("timer-torrent-updates", po::value<int>(),         "The interval to use for the torrent updates.")
         ;
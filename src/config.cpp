@@ -2,6 +2,8 @@
 
 #include <filesystem>
 #include <iostream>
+#include <sstream>
+#include <vector>
 
 #include <boost/log/trivial.hpp>
 #include <boost/program_options.hpp>
@@ -73,20 +75,54 @@ std::unique_ptr<Config> Config::Load(const boost::program_options::variables_map
     }
 
     if (auto val = std::getenv("PORLA_CONFIG_FILE"))           cfg->config_file     = val;
+    if (auto val = std::getenv("PORLA_CPU_PINNING"))
+    {
+        if (strcmp("true", val) == 0)  cfg->cpu_pinning = true;
+        if (strcmp("false", val) == 0) cfg->cpu_pinning = false;
+    }
     if (auto val = std::getenv("PORLA_DB"))                    cfg->db_file         = val;
+    if (auto val = std::getenv("PORLA_HTTP_ACCEPTORS"))        cfg->http_acceptors  = std::stoi(val);
     if (auto val = std::getenv("PORLA_HTTP_BASE_PATH"))        cfg->http_base_path  = val;
     if (auto val = std::getenv("PORLA_HTTP_HOST"))             cfg->http_host       = val;
+    if (auto val = std::getenv("PORLA_HTTP_IDLE_TIMEOUT"))     cfg->http_idle_timeout    = std::stoi(val);
+    if (auto val = std::getenv("PORLA_HTTP_LISTENERS"))
+    {
+        std::vector<std::string> listeners;
+        std::stringstream ss(val);
+
+        for (std::string spec; std::getline(ss, spec, ',');)
+        {
+            if (!spec.empty()) listeners.push_back(spec);
+        }
+
+        cfg->http_listeners = listeners;
+    }
+    if (auto val = std::getenv("PORLA_HTTP_MAX_CONNECTIONS"))  cfg->http_max_connections = std::stoi(val);
     if (auto val = std::getenv("PORLA_HTTP_METRICS_ENABLED"))
     {
         if (strcmp("true", val) == 0)  cfg->http_metrics_enabled = true;
         if (strcmp("false", val) == 0) cfg->http_metrics_enabled = false;
     }
+    if (auto val = std::getenv("PORLA_HTTP_PIPELINE_DEPTH"))   cfg->http_pipeline_depth  = std::stoi(val);
     if (auto val = std::getenv("PORLA_HTTP_PORT"))             cfg->http_port       = std::stoi(val);
+    if (auto val = std::getenv("PORLA_HTTP_REQUEST_TIMEOUT"))  cfg->http_request_timeout = std::stoi(val);
+    if (auto val = std::getenv("PORLA_HTTP_THREADS"))          cfg->http_threads    = std::stoi(val);
+    if (auto val = std::getenv("PORLA_HTTP_UNIX_SOCKET"))      cfg->http_unix_socket = val;
+    if (auto val = std::getenv("PORLA_HTTP_UNIX_SOCKET_MODE")) cfg->http_unix_socket_mode = std::stoi(val, nullptr, 8);
     if (auto val = std::getenv("PORLA_HTTP_WEBUI_ENABLED"))
     {
         if (strcmp("true", val) == 0)  cfg->http_webui_enabled = true;
         if (strcmp("false", val) == 0) cfg->http_webui_enabled = false;
     }
+    if (auto val = std::getenv("PORLA_HTTP_WEBSOCKET_DEFLATE"))
+    {
+        if (strcmp("true", val) == 0)  cfg->http_websocket_deflate = true;
+        if (strcmp("false", val) == 0) cfg->http_websocket_deflate = false;
+    }
+    if (auto val = std::getenv("PORLA_QUERY_MAX_STEPS"))       cfg->query_max_steps = std::stoi(val);
+    if (auto val = std::getenv("PORLA_QUERY_TIMEOUT"))         cfg->query_timeout   = std::stoi(val);
+    if (auto val = std::getenv("PORLA_RPC_QUEUE_LIMIT"))       cfg->rpc_queue_limit = std::stoi(val);
+    if (auto val = std::getenv("PORLA_RPC_WORKERS"))           cfg->rpc_workers     = std::stoi(val);
     if (auto val = std::getenv("PORLA_SECRET_KEY"))            cfg->secret_key      = val;
     if (auto val = std::getenv("PORLA_SESSION_SETTINGS_BASE"))
     {
@@ -94,8 +130,10 @@ std::unique_ptr<Config> Config::Load(const boost::program_options::variables_map
         if (strcmp("high_performance_seed", val) == 0) cfg->session_settings = lt::high_performance_seed();
         if (strcmp("min_memory_usage", val) == 0)      cfg->session_settings = lt::min_memory_usage();
     }
+    if (auto val = std::getenv("PORLA_SHUTDOWN_TIMEOUT"))      cfg->shutdown_timeout      = std::stoi(val);
     if (auto val = std::getenv("PORLA_STATE_DIR"))             cfg->state_dir             = val;
     if (auto val = std::getenv("PORLA_TIMER_DHT_STATS"))       cfg->timer_dht_stats       = std::stoi(val);
+    if (auto val = std::getenv("PORLA_TIMER_RESUME_DATA_FLUSH")) cfg->timer_resume_data_flush = std::stoi(val);
     if (auto val = std::getenv("PORLA_TIMER_SESSION_STATS"))   cfg->timer_session_stats   = std::stoi(val);
     if (auto val = std::getenv("PORLA_TIMER_TORRENT_UPDATES")) cfg->timer_torrent_updates = std::stoi(val);
 
@@ -122,24 +160,67 @@ std::unique_ptr<Config> Config::Load(const boost::program_options::variables_map
         {
             const toml::table config_file_tbl = toml::parse(config_file_data);
 
+            if (auto val = config_file_tbl["cpu_pinning"].value<bool>())
+                cfg->cpu_pinning = *val;
+
             if (auto val = config_file_tbl["db"].value<std::string>())
                 cfg->db_file = *val;
 
+            if (auto val = config_file_tbl["http"]["acceptors"].value<int>())
+                cfg->http_acceptors = *val;
+
             if (auto val = config_file_tbl["http"]["base_path"].value<std::string>())
                 cfg->http_base_path = *val;
 
             if (auto val = config_file_tbl["http"]["host"].value<std::string>())
                 cfg->http_host = *val;
 
+            if (auto val = config_file_tbl["http"]["idle_timeout"].value<int>())
+                cfg->http_idle_timeout = *val;
+
+            if (auto val = config_file_tbl["http"]["listeners"].as_array())
+            {
+                std::vector<std::string> listeners;
+
+                for (auto const& spec : *val)
+                {
+                    if (auto str = spec.value<std::string>()) listeners.push_back(*str);
+                }
+
+                cfg->http_listeners = listeners;
+            }
+
+            if (auto val = config_file_tbl["http"]["max_connections"].value<int>())
+                cfg->http_max_connections = *val;
+
             if (auto val = config_file_tbl["http"]["metrics_enabled"].value<bool>())
                 cfg->http_metrics_enabled = *val;
 
+            if (auto val = config_file_tbl["http"]["pipeline_depth"].value<int>())
+                cfg->http_pipeline_depth = *val;
+
             if (auto val = config_file_tbl["http"]["port"].value<uint16_t>())
                 cfg->http_port = *val;
 
+            if (auto val = config_file_tbl["http"]["request_timeout"].value<int>())
+                cfg->http_request_timeout = *val;
+
+            if (auto val = config_file_tbl["http"]["threads"].value<int>())
+                cfg->http_threads = *val;
+
+            if (auto val = config_file_tbl["http"]["unix_socket"].value<std::string>())
+                cfg->http_unix_socket = *val;
+
+            // An integer, so written in octal like 0o660.
+            if (auto val = config_file_tbl["http"]["unix_socket_mode"].value<int>())
+                cfg->http_unix_socket_mode = *val;
+
             if (auto val = config_file_tbl["http"]["webui_enabled"].value<bool>())
                 cfg->http_webui_enabled = *val;
 
+            if (auto val = config_file_tbl["http"]["websocket_deflate"].value<bool>())
+                cfg->http_websocket_deflate = *val;
+
             // Load presets
             if (auto const* presets_tbl = config_file_tbl["presets"].as_table())
             {
@@ -187,6 +268,18 @@ std::unique_ptr<Config> Config::Load(const boost::program_options::variables_map
                 }
             }
 
+            if (auto val = config_file_tbl["query"]["max_steps"].value<int>())
+                cfg->query_max_steps = *val;
+
+            if (auto val = config_file_tbl["query"]["timeout"].value<int>())
+                cfg->query_timeout = *val;
+
+            if (auto val = config_file_tbl["rpc"]["queue_limit"].value<int>())
+                cfg->rpc_queue_limit = *val;
+
+            if (auto val = config_file_tbl["rpc"]["workers"].value<int>())
+                cfg->rpc_workers = *val;
+
             if (auto val = config_file_tbl["secret_key"].value<std::string>())
                 cfg->secret_key = *val;
 
@@ -227,12 +320,18 @@ std::unique_ptr<Config> Config::Load(const boost::program_options::variables_map
             if (auto session_settings_tbl = config_file_tbl["session_settings"].as_table())
                 ApplySettings(*session_settings_tbl, cfg->session_settings);
 
+            if (auto val = config_file_tbl["shutdown_timeout"].value<int>())
+                cfg->shutdown_timeout = *val;
+
             if (auto val = config_file_tbl["state_dir"].value<std::string>())
                 cfg->state_dir = *val;
 
             if (auto val = config_file_tbl["timer"]["dht_stats"].value<int>())
                 cfg->timer_dht_stats = *val;
 
+            if (auto val = config_file_tbl["timer"]["resume_data_flush"].value<int>())
+                cfg->timer_resume_data_flush = *val;
+
             if (auto val = config_file_tbl["timer"]["session_stats"].value<int>())
                 cfg->timer_session_stats = *val;
 
@@ -299,18 +398,42 @@ std::unique_ptr<Config> Config::Load(const boost::program_options::variables_map
         }
     }
 
+    if (cmd.count("cpu-pinning"))
+    {
+        cfg->cpu_pinning = cmd["cpu-pinning"].as<bool>();
+    }
     if (cmd.count("db"))                    cfg->db_file               = cmd["db"].as<std::string>();
+    if (cmd.count("http-acceptors"))        cfg->http_acceptors        = cmd["http-acceptors"].as<int>();
     if (cmd.count("http-base-path"))        cfg->http_base_path        = cmd["http-base-path"].as<std::string>();
     if (cmd.count("http-host"))             cfg->http_host             = cmd["http-host"].as<std::string>();
+    if (cmd.count("http-idle-timeout"))     cfg->http_idle_timeout     = cmd["http-idle-timeout"].as<int>();
+    if (cmd.count("http-listener"))         cfg->http_listeners        = cmd["http-listener"].as<std::vector<std::string>>();
+    if (cmd.count("http-max-connections"))  cfg->http_max_connections  = cmd["http-max-connections"].as<int>();
     if (cmd.count("http-metrics-enabled"))
     {
         cfg->http_metrics_enabled = cmd["http-metrics-enabled"].as<bool>();
     }
+    if (cmd.count("http-pipeline-depth"))   cfg->http_pipeline_depth   = cmd["http-pipeline-depth"].as<int>();
     if (cmd.count("http-port"))             cfg->http_port             = cmd["http-port"].as<uint16_t>();
+    if (cmd.count("http-request-timeout"))  cfg->http_request_timeout  = cmd["http-request-timeout"].as<int>();
+    if (cmd.count("http-threads"))          cfg->http_threads          = cmd["http-threads"].as<int>();
+    if (cmd.count("http-unix-socket"))      cfg->http_unix_socket      = cmd["http-unix-socket"].as<std::string>();
+    if (cmd.count("http-unix-socket-mode"))
+    {
+        cfg->http_unix_socket_mode = std::stoi(cmd["http-unix-socket-mode"].as<std::string>(), nullptr, 8);
+    }
     if (cmd.count("http-webui-enabled"))
     {
         cfg->http_webui_enabled = cmd["http-webui-enabled"].as<bool>();
     }
+    if (cmd.count("http-websocket-deflate"))
+    {
+        cfg->http_websocket_deflate = cmd["http-websocket-deflate"].as<bool>();
+    }
+    if (cmd.count("query-max-steps"))       cfg->query_max_steps       = cmd["query-max-steps"].as<int>();
+    if (cmd.count("query-timeout"))         cfg->query_timeout         = cmd["query-timeout"].as<int>();
+    if (cmd.count("rpc-queue-limit"))       cfg->rpc_queue_limit       = cmd["rpc-queue-limit"].as<int>();
+    if (cmd.count("rpc-workers"))           cfg->rpc_workers           = cmd["rpc-workers"].as<int>();
     if (cmd.count("secret-key"))            cfg->secret_key            = cmd["secret-key"].as<std::string>();
     if (cmd.count("session-settings-base"))
     {
@@ -320,8 +443,10 @@ std::unique_ptr<Config> Config::Load(const boost::program_options::variables_map
         if (val == "high_performance_seed") cfg->session_settings = lt::high_performance_seed();
         if (val == "min_memory_usage")      cfg->session_settings = lt::min_memory_usage();
     }
+    if (cmd.count("shutdown-timeout"))      cfg->shutdown_timeout      = cmd["shutdown-timeout"].as<int>();
     if (cmd.count("state-dir"))             cfg->state_dir             = cmd["state-dir"].as<std::string>();
     if (cmd.count("timer-dht-stats"))       cfg->timer_dht_stats       = cmd["timer-dht-stats"].as<int>();
+    if (cmd.count("timer-resume-data-flush")) cfg->timer_resume_data_flush = cmd["timer-resume-data-flush"].as<int>();
     if (cmd.count("timer-session-stats"))   cfg->timer_session_stats   = cmd["timer-session-stats"].as<pid_t>();
     if (cmd.count("timer-torrent-updates")) cfg->timer_torrent_updates = cmd["timer-torrent-updates"].as<pid_t>();
 
@@ -352,12 +477,8 @@ std::unique_ptr<Config> Config::Load(const boost::program_options::variables_map
     porla::Data::Models::SessionSettings::Apply(cfg->db, cfg->session_settings);
 
     // Apply static libtorrent settings here. These are always set after all other settings from
-    // the config are applied, and cannot be overwritten by it.
-    cfg->session_settings.set_int(
-        lt::settings_pack::alert_mask,
-        lt::alert::status_notification
-        | lt::alert::storage_notification);
-
+    // the config are applied, and cannot be overwritten by it. The alert mask is set by the
+    // session from the alerts it is subscribed to.
     cfg->session_settings.set_str(lt::settings_pack::peer_fingerprint, lt::generate_fingerprint("PO", 0, 1));
     cfg->session_settings.set_str(lt::settings_pack::user_agent, "porla/1.0");
 
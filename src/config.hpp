@@ -5,6 +5,7 @@
 #include <optional>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include <boost/program_options.hpp>
 #include <libtorrent/extensions.hpp>
@@ -50,19 +51,36 @@ namespace porla
         };
 
         std::optional<std::string>            config_file;
+        std::optional<bool>                   cpu_pinning;
         sqlite3*                              db;
         std::optional<std::string>            db_file;
+        std::optional<int>                    http_acceptors;
         std::optional<std::string>            http_base_path;
         std::optional<std::string>            http_host;
+        std::optional<int>                    http_idle_timeout;
+        std::optional<std::vector<std::string>> http_listeners;
+        std::optional<int>                    http_max_connections;
         std::optional<bool>                   http_metrics_enabled;
+        std::optional<int>                    http_pipeline_depth;
         std::optional<uint16_t>               http_port;
+        std::optional<int>                    http_request_timeout;
+        std::optional<int>                    http_threads;
+        std::optional<std::string>            http_unix_socket;
+        std::optional<int>                    http_unix_socket_mode;
         std::optional<bool>                   http_webui_enabled;
+        std::optional<bool>                   http_websocket_deflate;
         std::map<std::string, Preset>         presets;
+        std::optional<int>                    query_max_steps;
+        std::optional<int>                    query_timeout;
+        std::optional<int>                    rpc_queue_limit;
+        std::optional<int>                    rpc_workers;
         std::string                           secret_key;
+        std::optional<int>                    shutdown_timeout;
         std::optional<std::vector<lt_plugin>> session_extensions;
         libtorrent::settings_pack             session_settings;
         std::optional<fs::path>               state_dir;
         std::optional<int>                    timer_dht_stats;
+        std::optional<int>                    timer_resume_data_flush;
         std::optional<int>                    timer_session_stats;
         std::optional<int>                    timer_torrent_updates;
         std::vector<Webhook>                  webhooks;
@@ -0,0 +1,65 @@
+#include "metadatacache.hpp"
+
+#include <boost/log/trivial.hpp>
+
+#include "models/torrentsmetadata.hpp"
+
+namespace lt = libtorrent;
+using json = nlohmann::json;
+
+using porla::Data::MetadataCache;
+using porla::Data::Models::TorrentsMetadata;
+
+MetadataCache::MetadataCache(sqlite3* db)
+    : m_db(db)
+{
+    std::size_t rows = 0;
+
+    TorrentsMetadata::ForEach(
+        m_db,
+        [&](const lt::info_hash_t& hash, const std::string& key, json value)
+        {
+            m_metadata[hash].insert_or_assign(key, std::move(value));
+            rows++;
+        });
+
+    BOOST_LOG_TRIVIAL(debug) << "Loaded " << rows << " metadata value(s) for " << m_metadata.size() << " torrent(s)";
+}
+
+const MetadataCache::Metadata* MetadataCache::Get(const lt::info_hash_t& hash) const
+{
+    auto const metadata = m_metadata.find(hash);
+    return metadata == m_metadata.end() ? nullptr : &metadata->second;
+}
+
+const json* MetadataCache::Get(const lt::info_hash_t& hash, const std::string& key) const
+{
+    auto const metadata = Get(hash);
+    if (metadata == nullptr) return nullptr;
+
+    auto const value = metadata->find(key);
+    return value == metadata->end() ? nullptr : &value->second;
+}
+
+void MetadataCache::ForEachKey(const std::string& key, const std::function<void(const lt::info_hash_t&, const json&)>& cb) const
+{
+    for (auto const& [hash, metadata] : m_metadata)
+    {
+        if (auto value = metadata.find(key); value != metadata.end())
+        {
+            cb(hash, value->second);
+        }
+    }
+}
+
+void MetadataCache::RemoveAll(const lt::info_hash_t& hash)
+{
+    TorrentsMetadata::RemoveAll(m_db, hash);
+    m_metadata.erase(hash);
+}
+
+void MetadataCache::Set(const lt::info_hash_t& hash, const std::string& key, const json& value)
+{
+    TorrentsMetadata::Set(m_db, hash, key, value);
+    m_metadata[hash].insert_or_assign(key, value);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include <libtorrent/info_hash.hpp>
+#include <nlohmann/json.hpp>
+#include <sqlite3.h>
+
+namespace porla::Data
+{
+    /*
+     * A write-through cache of the torrentsmetadata table. Every row is read
+     * once on construction and kept with its value already parsed. Writes go
+     * to the database first and are applied to the cache only if they succeed,
+     * so the two never disagree.
+     */
+    class MetadataCache
+    {
+    public:
+        typedef std::map<std::string, nlohmann::json> Metadata;
+
+        explicit MetadataCache(sqlite3* db);
+        MetadataCache(const MetadataCache&) = delete;
+        MetadataCache& operator=(const MetadataCache&) = delete;
+
+        const Metadata* Get(const libtorrent::info_hash_t& hash) const;
+        const nlohmann::json* Get(const libtorrent::info_hash_t& hash, const std::string& key) const;
+        void ForEachKey(const std::string& key, const std::function<void(const libtorrent::info_hash_t&, const nlohmann::json&)>& cb) const;
+
+        void RemoveAll(const libtorrent::info_hash_t& hash);
+        void Set(const libtorrent::info_hash_t& hash, const std::string& key, const nlohmann::json& value);
+
+        [[nodiscard]] std::size_t Size() const { return m_metadata.size(); }
+
+    private:
+        sqlite3* m_db;
+        std::unordered_map<libtorrent::info_hash_t, Metadata> m_metadata;
+    };
+}
@@ -37,29 +37,54 @@ int AddTorrentParams::Count(sqlite3 *db)
     return count;
 }
 
+bool AddTorrentParams::Decode(const Blob& blob, lt::add_torrent_params& params)
+{
+    libtorrent::error_code ec;
+    params = lt::read_resume_data(blob.resume_data_buf, ec);
+
+    if (ec)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Failed to read resume data from buffer: " << ec;
+        return false;
+    }
+
+    params.name = blob.name;
+    params.save_path = blob.save_path;
+
+    return true;
+}
+
 void AddTorrentParams::ForEach(sqlite3 *db, const std::function<void(lt::add_torrent_params&)>& cb)
 {
-    auto stmt = Statement::Prepare(db, "SELECT name,resume_data_buf,save_path FROM addtorrentparams\n"
-                                       "ORDER BY queue_position ASC");
-    stmt.Step(
-        [&cb](const Statement::IRow& row)
+    ForEachBlob(
+        db,
+        [&cb](Blob&& blob)
         {
+            lt::add_torrent_params atp;
 
-            libtorrent::error_code ec;
-            auto atp = lt::read_resume_data(row.GetBuffer(1), ec);
-
-            if (ec)
+            if (Decode(blob, atp))
             {
-                BOOST_LOG_TRIVIAL(error) << "Failed to read resume data from buffer: " << ec;
-                return SQLITE_OK;
+                cb(atp);
             }
 
-            atp.name = row.GetStdString(0);
-            atp.save_path = row.GetStdString(2);
+            return true;
+        });
+}
 
-            cb(atp);
+void AddTorrentParams::ForEachBlob(sqlite3* db, const std::function<bool(Blob&&)>& cb)
+{
+    auto stmt = Statement::Prepare(db, "SELECT name,resume_data_buf,save_path FROM addtorrentparams\n"
+                                       "ORDER BY queue_position ASC");
+    stmt.Step(
+        [&cb](const Statement::IRow& row)
+        {
+            bool more = cb(Blob{
+                .name = row.GetStdString(0),
+                .resume_data_buf = row.GetBuffer(1),
+                .save_path = row.GetStdString(2)
+            });
 
-            return SQLITE_OK;
+            return more ? SQLITE_OK : SQLITE_ABORT;
         });
 }
 
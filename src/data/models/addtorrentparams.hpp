@@ -12,8 +12,17 @@ namespace porla::Data::Models
         int queue_position;
         std::string save_path;
 
+        struct Blob
+        {
+            std::string name;
+            std::vector<char> resume_data_buf;
+            std::string save_path;
+        };
+
         static int Count(sqlite3* db);
+        static bool Decode(const Blob& blob, libtorrent::add_torrent_params& params);
         static void ForEach(sqlite3* db, const std::function<void(libtorrent::add_torrent_params&)>& cb);
+        static void ForEachBlob(sqlite3* db, const std::function<bool(Blob&&)>& cb);
         static void Insert(sqlite3* db, const libtorrent::info_hash_t& hash, const AddTorrentParams& params);
         static void Remove(sqlite3* db, const libtorrent::info_hash_t& hash);
         static void Update(sqlite3* db, const libtorrent::info_hash_t& hash, const AddTorrentParams& params);
@@ -2,6 +2,8 @@
 
 #include <sstream>
 
+#include <libtorrent/hex.hpp>
+
 #include "../statement.hpp"
 
 using porla::Data::Models::TorrentsMetadata;
@@ -18,32 +20,34 @@ static std::string ToString(const T &hash)
     return ss.str();
 }
 
-std::map<std::string, json> TorrentsMetadata::GetAll(sqlite3* db, const lt::info_hash_t& hash)
+void TorrentsMetadata::ForEach(sqlite3* db, const std::function<void(const lt::info_hash_t&, const std::string&, json)>& cb)
 {
     auto stmt = Statement::Prepare(
         db,
-        "SELECT key, value FROM torrentsmetadata\n"
-        "WHERE (info_hash_v1 = $1 AND info_hash_v2 IS NULL)\n"
-        "   OR (info_hash_v1 IS NULL AND info_hash_v2 = $2)\n"
-        "   OR (info_hash_v1 = $1 AND info_hash_v2 = $2);");
+        "SELECT IFNULL(info_hash_v1, ''), IFNULL(info_hash_v2, ''), key, value FROM torrentsmetadata;");
 
-    std::map<std::string, json> metadata;
+    stmt.Step(
+        [&cb](const Statement::IRow& row)
+        {
+            std::string const v1 = row.GetStdString(0);
+            std::string const v2 = row.GetStdString(1);
 
-    stmt
-        .Bind(1, hash.has_v1() ? std::optional(ToString(hash.v1)) : std::nullopt)
-        .Bind(2, hash.has_v2() ? std::optional(ToString(hash.v2)) : std::nullopt)
-        .Step(
-            [&metadata](const Statement::IRow& row)
+            lt::info_hash_t hash;
+
+            if (v1.size() == 40)
+            {
+                lt::aux::from_hex({ v1.c_str(), 40 }, hash.v1.data());
+            }
+
+            if (v2.size() == 64)
             {
-                metadata.insert({
-                    row.GetStdString(0),
-                    json::parse(row.GetStdString(1))
-                });
+                lt::aux::from_hex({ v2.c_str(), 64 }, hash.v2.data());
+            }
 
-                return SQLITE_OK;
-            });
+            cb(hash, row.GetStdString(2), json::parse(row.GetStdString(3)));
 
-    return metadata;
+            return SQLITE_OK;
+        });
 }
 
 void TorrentsMetadata::RemoveAll(sqlite3* db, const libtorrent::info_hash_t& hash)
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <map>
+#include <functional>
 #include <string>
 
 #include <libtorrent/info_hash.hpp>
@@ -12,7 +12,7 @@ namespace porla::Data::Models
     class TorrentsMetadata
     {
     public:
-        static std::map<std::string, nlohmann::json> GetAll(sqlite3* db, const libtorrent::info_hash_t& hash);
+        static void ForEach(sqlite3* db, const std::function<void(const libtorrent::info_hash_t&, const std::string&, nlohmann::json)>& cb);
         static void RemoveAll(sqlite3* db, const libtorrent::info_hash_t& hash);
         static void Set(sqlite3* db, const libtorrent::info_hash_t& hash, const std::string& key, const nlohmann::json& value);
     };
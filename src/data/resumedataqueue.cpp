@@ -0,0 +1,213 @@
+#include "resumedataqueue.hpp"
+
+#include <sstream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/log/trivial.hpp>
+#include <libtorrent/write_resume_data.hpp>
+
+#include "statement.hpp"
+
+namespace lt = libtorrent;
+
+using porla::Data::Models::AddTorrentParams;
+using porla::Data::ResumeDataQueue;
+using porla::Data::Statement;
+
+template<typename T>
+static std::string ToString(const T &hash)
+{
+    std::stringstream ss;
+    ss << hash;
+    return ss.str();
+}
+
+static std::size_t Digest(const std::vector<char>& buf, const AddTorrentParams& params)
+{
+    std::size_t seed = std::hash<std::string_view>{}(std::string_view(buf.data(), buf.size()));
+
+    auto const combine = [&seed](std::size_t value)
+    {
+        seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    };
+
+    combine(std::hash<std::string>{}(params.name));
+    combine(std::hash<std::string>{}(params.save_path));
+    combine(std::hash<int>{}(params.queue_position));
+
+    return seed;
+}
+
+ResumeDataQueue::ResumeDataQueue(boost::asio::io_context& io, const ResumeDataQueueOptions& options)
+    : m_db(options.db)
+    , m_timer(io)
+    , m_flush_interval(options.flush_interval)
+    , m_flush_size(options.flush_size)
+{
+    ScheduleFlush();
+}
+
+ResumeDataQueue::~ResumeDataQueue()
+{
+    boost::system::error_code ec;
+    m_timer.cancel(ec);
+
+    Flush();
+}
+
+void ResumeDataQueue::Discard(const lt::info_hash_t& hash)
+{
+    m_pending.erase(hash);
+    m_written.erase(hash);
+    m_depth = m_pending.size();
+}
+
+void ResumeDataQueue::Enqueue(const lt::info_hash_t& hash, AddTorrentParams params)
+{
+    m_pending.insert_or_assign(hash, std::move(params));
+    m_depth = m_pending.size();
+
+    if (!m_held && m_pending.size() >= m_flush_size)
+    {
+        Flush();
+    }
+}
+
+void ResumeDataQueue::Flush()
+{
+    if (m_pending.empty())
+    {
+        return;
+    }
+
+    auto const started = std::chrono::steady_clock::now();
+
+    std::vector<std::pair<lt::info_hash_t, std::size_t>> digests;
+    digests.reserve(m_pending.size());
+
+    std::uint64_t skipped = 0;
+
+    if (sqlite3_exec(m_db, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr) != SQLITE_OK)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Failed to begin resume data transaction: " << sqlite3_errmsg(m_db);
+        return;
+    }
+
+    try
+    {
+        auto stmt = Statement::Prepare(m_db, "UPDATE addtorrentparams SET name = $1, resume_data_buf = $2, queue_position = $3, save_path = $4\n"
+                                             "WHERE (info_hash_v1 = $5 AND info_hash_v2 IS NULL)\n"
+                                             "   OR (info_hash_v1 IS NULL AND info_hash_v2 = $6)\n"
+                                             "   OR (info_hash_v1 = $5 AND info_hash_v2 = $6);");
+
+        for (auto const& [hash, params] : m_pending)
+        {
+            std::vector<char> buf = lt::write_resume_data_buf(params.params);
+            std::size_t const digest = Digest(buf, params);
+
+            if (auto written = m_written.find(hash);
+                written != m_written.end() && written->second == digest)
+            {
+                skipped++;
+                continue;
+            }
+
+            stmt
+                .Bind(1, std::string_view(params.name))
+                .Bind(2, buf)
+                .Bind(3, params.queue_position)
+                .Bind(4, std::string_view(params.save_path))
+                .Bind(5, hash.has_v1() ? std::optional(ToString(hash.v1)) : std::nullopt)
+                .Bind(6, hash.has_v2() ? std::optional(ToString(hash.v2)) : std::nullopt)
+                .Execute();
+
+            stmt.Reset();
+
+            digests.emplace_back(hash, digest);
+        }
+    }
+    catch (const std::exception& ex)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Failed to write resume data, keeping " << m_pending.size() << " item(s) queued: " << ex.what();
+        sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return;
+    }
+
+    if (sqlite3_exec(m_db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Failed to commit resume data transaction: " << sqlite3_errmsg(m_db);
+        sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return;
+    }
+
+    for (auto const& [hash, digest] : digests)
+    {
+        m_written.insert_or_assign(hash, digest);
+    }
+
+    m_pending.clear();
+
+    auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+
+    m_depth = 0;
+    m_flushes++;
+    m_flush_duration_last_us = elapsed;
+    m_flush_duration_total_us += elapsed;
+    m_rows_skipped += skipped;
+    m_rows_written += digests.size();
+
+    BOOST_LOG_TRIVIAL(debug) << "Wrote resume data for " << digests.size() << " torrent(s) in " << elapsed << "us ("
+                             << skipped << " unchanged)";
+}
+
+void ResumeDataQueue::Hold()
+{
+    m_held = true;
+
+    boost::system::error_code ec;
+    m_timer.cancel(ec);
+}
+
+ResumeDataQueue::Stats ResumeDataQueue::GetStats() const
+{
+    return Stats{
+        .depth                   = m_depth,
+        .flushes                 = m_flushes,
+        .flush_duration_last_us  = m_flush_duration_last_us,
+        .flush_duration_total_us = m_flush_duration_total_us,
+        .rows_skipped            = m_rows_skipped,
+        .rows_written            = m_rows_written
+    };
+}
+
+void ResumeDataQueue::ScheduleFlush()
+{
+    if (m_flush_interval <= 0)
+    {
+        return;
+    }
+
+    boost::system::error_code ec;
+    m_timer.expires_from_now(boost::posix_time::milliseconds(m_flush_interval), ec);
+
+    if (ec)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Failed to set resume data flush timer expiry: " << ec.message();
+        return;
+    }
+
+    m_timer.async_wait(
+        [this](boost::system::error_code ec)
+        {
+            if (ec == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+
+            Flush();
+            ScheduleFlush();
+        });
+}
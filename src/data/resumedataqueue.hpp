@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+#include <boost/asio.hpp>
+#include <libtorrent/info_hash.hpp>
+#include <sqlite3.h>
+
+#include "models/addtorrentparams.hpp"
+
+namespace porla::Data
+{
+    struct ResumeDataQueueOptions
+    {
+        sqlite3* db = nullptr;
+        int flush_interval = 5000;
+        std::size_t flush_size = 1000;
+    };
+
+    /*
+     * A write-behind queue for resume data. Updates are coalesced per info hash
+     * and written in a single transaction when the queue reaches its flush size,
+     * or when the flush interval expires. Writes where the encoded resume data is
+     * identical to what we last wrote for the torrent are skipped.
+     */
+    class ResumeDataQueue
+    {
+    public:
+        struct Stats
+        {
+            std::uint64_t depth;
+            std::uint64_t flushes;
+            std::uint64_t flush_duration_last_us;
+            std::uint64_t flush_duration_total_us;
+            std::uint64_t rows_skipped;
+            std::uint64_t rows_written;
+        };
+
+        explicit ResumeDataQueue(boost::asio::io_context& io, const ResumeDataQueueOptions& options);
+        ResumeDataQueue(const ResumeDataQueue&) = delete;
+        ResumeDataQueue& operator=(const ResumeDataQueue&) = delete;
+
+        ~ResumeDataQueue();
+
+        void Discard(const libtorrent::info_hash_t& hash);
+        void Enqueue(const libtorrent::info_hash_t& hash, Models::AddTorrentParams params);
+        void Flush();
+
+        // Stop flushing on the timer and when the queue is full. Only explicit
+        // calls to Flush will write anything after this.
+        void Hold();
+
+        [[nodiscard]] Stats GetStats() const;
+
+    private:
+        void ScheduleFlush();
+
+        sqlite3* m_db;
+        boost::asio::deadline_timer m_timer;
+        int m_flush_interval;
+        std::size_t m_flush_size;
+        bool m_held = false;
+
+        std::unordered_map<libtorrent::info_hash_t, Models::AddTorrentParams> m_pending;
+        std::unordered_map<libtorrent::info_hash_t, std::size_t> m_written;
+
+        std::atomic_uint64_t m_depth{0};
+        std::atomic_uint64_t m_flushes{0};
+        std::atomic_uint64_t m_flush_duration_last_us{0};
+        std::atomic_uint64_t m_flush_duration_total_us{0};
+        std::atomic_uint64_t m_rows_skipped{0};
+        std::atomic_uint64_t m_rows_written{0};
+    };
+}
@@ -126,6 +126,12 @@ void Statement::Execute()
     throw std::runtime_error("Unexpected SQLite return code for Execute: " + std::to_string(res));
 }
 
+void Statement::Reset()
+{
+    sqlite3_reset(m_stmt);
+    sqlite3_clear_bindings(m_stmt);
+}
+
 void Statement::Step(const std::function<int(const Statement::IRow&)>& cb)
 {
     do
@@ -137,7 +143,14 @@ void Statement::Step(const std::function<int(const Statement::IRow&)>& cb)
         case SQLITE_ROW:
         {
             InternalRow r(m_stmt);
-            cb(r);
+
+            // Let the callback stop the iteration early by returning anything
+            // other than SQLITE_OK.
+            if (cb(r) != SQLITE_OK)
+            {
+                return;
+            }
+
             break;
         }
         default:
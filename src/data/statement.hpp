@@ -31,6 +31,7 @@ namespace porla::Data
         Statement& Bind(int pos, const std::vector<char>& buffer);
 
         void Execute();
+        void Reset();
         void Step(const std::function<int(const IRow&)>& cb);
 
     private:
@@ -0,0 +1,85 @@
+#include "filesvt.hpp"
+
+#include <libtorrent/torrent_info.hpp>
+
+#include "childvt.hpp"
+
+namespace lt = libtorrent;
+
+using porla::FilesVTable;
+
+struct FileRow
+{
+    int index;
+    std::string path;
+    std::int64_t offset;
+    std::int64_t size;
+    std::int64_t progress;
+    int priority;
+};
+
+typedef porla::ChildVTable<FileRow> Table;
+
+int FilesVTable::Install(sqlite3* db, const porla::TorrentRegistry& torrents)
+{
+    return Table::Install(
+        db,
+        "files",
+        torrents,
+        {
+            {"file_index", [](const FileRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, row.index);
+            }},
+            {"path", [](const FileRow& row, sqlite3_context* ctx) {
+                sqlite3_result_text(ctx, row.path.c_str(), -1, SQLITE_TRANSIENT);
+            }},
+            {"offset", [](const FileRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int64(ctx, row.offset);
+            }},
+            {"size", [](const FileRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int64(ctx, row.size);
+            }},
+            {"progress", [](const FileRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int64(ctx, row.progress);
+            }},
+            {"priority", [](const FileRow& row, sqlite3_context* ctx) {
+                row.priority >= 0
+                    ? sqlite3_result_int(ctx, row.priority)
+                    : sqlite3_result_null(ctx);
+            }},
+        },
+        [](const porla::TorrentRegistry::Entry& entry, std::vector<FileRow>& rows)
+        {
+            auto const tf = entry.status.torrent_file.lock();
+
+            if (!tf)
+            {
+                return;
+            }
+
+            auto const& storage = tf->files();
+
+            // Progress is counted in whole pieces, which is a lot cheaper for
+            // libtorrent to compute than the exact number of bytes.
+            std::vector<std::int64_t> progress;
+            entry.handle.file_progress(progress, lt::torrent_handle::piece_granularity);
+
+            std::vector<lt::download_priority_t> const priorities = entry.handle.get_file_priorities();
+
+            rows.reserve(storage.num_files());
+
+            for (int i = 0; i < storage.num_files(); i++)
+            {
+                lt::file_index_t const idx{i};
+
+                rows.push_back(FileRow{
+                    .index    = i,
+                    .path     = storage.file_path(idx),
+                    .offset   = storage.file_offset(idx),
+                    .size     = storage.file_size(idx),
+                    .progress = i < static_cast<int>(progress.size()) ? progress[i] : 0,
+                    .priority = i < static_cast<int>(priorities.size()) ? static_cast<std::uint8_t>(priorities[i]) : -1
+                });
+            }
+        });
+}
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <functional>
+
+#include <boost/asio/generic/stream_protocol.hpp>
 #include <boost/beast.hpp>
 #include <nlohmann/json.hpp>
 
 namespace porla
 {
+    // The stream of an HTTP connection, which is either TCP or a Unix domain socket.
+    typedef boost::beast::basic_stream<boost::asio::generic::stream_protocol> HttpStream;
+
     class HttpContext
     {
     public:
@@ -13,15 +19,29 @@ namespace porla
             std::string path;
         };
 
+        // Takes the next chunk of a chunked response, and may be called from any
+        // thread. The last chunk is passed with `more` set to false.
+        typedef std::function<void(std::string chunk, bool more)> ChunkCb;
+
+        // Called for each chunk once the one before it is written, so at most
+        // one chunk is held in memory at a time.
+        typedef std::function<void(const ChunkCb& cb)> ChunkProducer;
+
         virtual void Next() = 0;
 
         virtual boost::beast::http::request<boost::beast::http::string_body>& Request() = 0;
         virtual Uri& RequestUri() = 0;
-        virtual boost::beast::tcp_stream& Stream() = 0;
+        virtual porla::HttpStream& Stream() = 0;
+
+        // For responses which write to the stream themselves for as long as the
+        // connection is open. Nothing more is read from the connection, and it
+        // is no longer closed when idle.
+        virtual porla::HttpStream& TakeStream() = 0;
 
         virtual void Write(std::string body) = 0;
         virtual void Write(boost::beast::http::response<boost::beast::http::file_body> res) = 0;
         virtual void Write(boost::beast::http::response<boost::beast::http::string_body> res) = 0;
+        virtual void WriteChunked(boost::beast::http::response<boost::beast::http::empty_body> res, ChunkProducer producer) = 0;
         virtual void WriteJson(const nlohmann::json& j) = 0;
     };
 }
@@ -1,5 +1,6 @@
 #include "httpeventstream.hpp"
 
+#include <atomic>
 #include <queue>
 
 #include <boost/log/trivial.hpp>
@@ -23,11 +24,19 @@ public:
 
     bool IsDead() const { return m_ctx == nullptr || m_dead; }
 
+    // Called from the session thread. The write state is only touched on the
+    // strand of the stream.
     void QueueWrite(std::string data)
     {
         if (m_dead) { return; }
-        m_sendData.push(std::move(data));
-        MaybeWrite();
+
+        boost::asio::dispatch(
+            m_ctx->Stream().get_executor(),
+            [_this = shared_from_this(), data = std::move(data)]() mutable
+            {
+                _this->m_sendData.push(std::move(data));
+                _this->MaybeWrite();
+            });
     }
 
 private:
@@ -77,7 +86,7 @@ private:
         MaybeWrite();
     }
 
-    bool m_dead {false};
+    std::atomic_bool m_dead {false};
     bool m_isWriting {false};
     int64_t m_sent{0};
     std::queue<std::string> m_sendData;
@@ -114,6 +123,10 @@ void HttpEventStream::operator()(std::shared_ptr<HttpContext> context)
     evt << "event: hello\n";
     evt << "data: {}\n\n";
 
+    // The events are written to the stream for as long as the client is
+    // connected, so the session must not read or time out the connection.
+    context->TakeStream();
+
     auto state = std::make_shared<ContextState>(std::move(context));
     state->QueueWrite(headers);
     state->QueueWrite(evt.str());
@@ -121,8 +134,15 @@ void HttpEventStream::operator()(std::shared_ptr<HttpContext> context)
     m_ctxs.push_back(state);
 }
 
+boost::signals2::connection HttpEventStream::OnEvent(const EventSignal::slot_type& subscriber)
+{
+    return m_event.connect(subscriber);
+}
+
 void HttpEventStream::Broadcast(const std::string& name, const std::string& data)
 {
+    m_event(name, data);
+
     if (m_ctxs.empty())
     {
         return;
@@ -15,6 +15,8 @@ namespace porla
     class HttpEventStream
     {
     public:
+        typedef boost::signals2::signal<void(const std::string& name, const std::string& data)> EventSignal;
+
         explicit HttpEventStream(ISession& session);
         HttpEventStream(const HttpEventStream&) = delete;
 
@@ -22,6 +24,10 @@ namespace porla
 
         void operator()(std::shared_ptr<HttpContext>);
 
+        // Subscribes to the events sent to the event stream clients, for other
+        // transports. The subscriber is called on the session thread.
+        boost::signals2::connection OnEvent(const EventSignal::slot_type& subscriber);
+
     private:
         class ContextState;
 
@@ -34,6 +40,7 @@ namespace porla
 
         ISession& m_session;
         std::vector<std::shared_ptr<ContextState>> m_ctxs;
+        EventSignal m_event;
 
         boost::signals2::connection m_sessionStatsConnection;
         boost::signals2::connection m_stateUpdateConnection;
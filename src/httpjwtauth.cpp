@@ -35,27 +35,49 @@ void HttpJwtAuth::operator()(const std::shared_ptr<porla::HttpContext> &ctx)
         return ctx->Write(not_authorized());
     }
 
-    // Authorization header is too short to start with "Bearer " and also contain a token.
-    if (auth_header->value().size() <= 7)
+    auto const bearer_token = BearerToken(auth_header->value());
+
+    if (!bearer_token.has_value())
     {
         return ctx->Write(not_authorized());
     }
 
-    const std::string bearer_token = auth_header->value()
-        .substr(7)
-        .to_string();
+    if (Verify(m_secret_key, bearer_token.value()))
+    {
+        return m_http_middleware(ctx);
+    }
+
+    return ctx->Write(not_authorized());
+}
+
+std::optional<std::string> HttpJwtAuth::BearerToken(boost::beast::string_view header)
+{
+    static constexpr boost::beast::string_view Scheme = "Bearer ";
 
+    // The header is too short to start with "Bearer " and also contain a token,
+    // or has another scheme. Schemes are case-insensitive.
+    if (header.size() <= Scheme.size()
+        || !boost::beast::iequals(header.substr(0, Scheme.size()), Scheme))
+    {
+        return std::nullopt;
+    }
+
+    return header.substr(Scheme.size()).to_string();
+}
+
+bool HttpJwtAuth::Verify(const std::string& secret_key, const std::string& token)
+{
     try
     {
-        auto decoded_token = jwt::decode(bearer_token);
+        auto decoded_token = jwt::decode(token);
 
         auto verifier = jwt::verify()
-            .allow_algorithm(jwt::algorithm::hs256(m_secret_key))
+            .allow_algorithm(jwt::algorithm::hs256(secret_key))
             .with_issuer("porla");
 
         verifier.verify(decoded_token);
 
-        return m_http_middleware(ctx);
+        return true;
     }
     catch (const jwt::signature_verification_exception& ex)
     {
@@ -70,5 +92,5 @@ void HttpJwtAuth::operator()(const std::shared_ptr<porla::HttpContext> &ctx)
         BOOST_LOG_TRIVIAL(warning) << "Failed to decode token: " << ex.what();
     }
 
-    return ctx->Write(not_authorized());
+    return false;
 }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <optional>
+#include <string>
+
 #include "httpcontext.hpp"
 #include "httpmiddleware.hpp"
 
@@ -12,6 +15,12 @@ namespace porla
 
         void operator()(const std::shared_ptr<porla::HttpContext>& ctx);
 
+        // Returns the token of an Authorization header with the Bearer scheme.
+        static std::optional<std::string> BearerToken(boost::beast::string_view header);
+
+        // Verifies a token issued by the login handler.
+        static bool Verify(const std::string& secret_key, const std::string& token);
+
     private:
         std::string m_secret_key;
         HttpMiddleware m_http_middleware;
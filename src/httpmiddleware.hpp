@@ -3,6 +3,7 @@
 #include <functional>
 #include <memory>
 
+#include <boost/asio.hpp>
 #include <boost/log/trivial.hpp>
 
 #include "httpcontext.hpp"
@@ -64,6 +65,36 @@ namespace porla
         }
     };
 
+    /*
+     * Runs the wrapped middleware on the given executor instead of on the
+     * thread serving the HTTP connection. Handlers which touch the session
+     * are wrapped with this to run them on the session thread.
+     */
+    class HttpDispatch
+    {
+    public:
+        explicit HttpDispatch(boost::asio::any_io_executor executor, HttpMiddleware middleware)
+            : m_executor(std::move(executor))
+            , m_middleware(std::make_shared<const HttpMiddleware>(std::move(middleware)))
+        {
+        }
+
+        void operator()(const std::shared_ptr<porla::HttpContext> &ctx)
+        {
+            // The middleware is shared instead of copied for each request.
+            boost::asio::dispatch(
+                m_executor,
+                [mw = m_middleware, ctx]()
+                {
+                    (*mw)(ctx);
+                });
+        }
+
+    private:
+        boost::asio::any_io_executor m_executor;
+        std::shared_ptr<const HttpMiddleware> m_middleware;
+    };
+
     class HttpNotFound
     {
     public:
@@ -0,0 +1,117 @@
+#include "httprouter.hpp"
+
+#include <algorithm>
+
+using porla::HttpRouter;
+
+HttpRouter::HttpRouter()
+    : m_root(std::make_shared<Node>())
+{
+}
+
+HttpRouter& HttpRouter::Add(boost::beast::http::verb verb, std::string_view route, HttpMiddleware middleware)
+{
+    Node* node = m_root.get();
+
+    while (!route.empty())
+    {
+        auto child = std::find_if(
+            node->children.begin(),
+            node->children.end(),
+            [&route](auto const& c) { return c->prefix.front() == route.front(); });
+
+        if (child == node->children.end())
+        {
+            auto leaf = std::make_unique<Node>();
+            leaf->prefix = route;
+
+            node->children.push_back(std::move(leaf));
+            node = node->children.back().get();
+
+            break;
+        }
+
+        auto const& prefix = (*child)->prefix;
+        auto const common = static_cast<std::size_t>(
+            std::mismatch(prefix.begin(), prefix.end(), route.begin(), route.end()).first - prefix.begin());
+
+        // Split the edge where the route leaves it.
+        if (common < prefix.size())
+        {
+            auto split = std::make_unique<Node>();
+            split->prefix = prefix.substr(0, common);
+
+            (*child)->prefix.erase(0, common);
+            split->children.push_back(std::move(*child));
+
+            *child = std::move(split);
+        }
+
+        node = child->get();
+        route.remove_prefix(common);
+    }
+
+    auto existing = std::find_if(
+        node->handlers.begin(),
+        node->handlers.end(),
+        [verb](auto const& handler) { return handler.first == verb; });
+
+    if (existing != node->handlers.end())
+    {
+        existing->second = std::move(middleware);
+    }
+    else
+    {
+        node->handlers.emplace_back(verb, std::move(middleware));
+    }
+
+    return *this;
+}
+
+HttpRouter& HttpRouter::Get(std::string_view route, HttpMiddleware middleware)
+{
+    return Add(boost::beast::http::verb::get, route, std::move(middleware));
+}
+
+HttpRouter& HttpRouter::Post(std::string_view route, HttpMiddleware middleware)
+{
+    return Add(boost::beast::http::verb::post, route, std::move(middleware));
+}
+
+void HttpRouter::operator()(const std::shared_ptr<porla::HttpContext>& ctx) const
+{
+    if (auto const middleware = Find(ctx->Request().method(), ctx->RequestUri().path))
+    {
+        return (*middleware)(ctx);
+    }
+
+    ctx->Next();
+}
+
+const porla::HttpMiddleware* HttpRouter::Find(boost::beast::http::verb verb, std::string_view path) const
+{
+    const Node* node = m_root.get();
+
+    while (!path.empty())
+    {
+        auto const child = std::find_if(
+            node->children.begin(),
+            node->children.end(),
+            [&path](auto const& c) { return c->prefix.front() == path.front(); });
+
+        if (child == node->children.end() || !path.starts_with((*child)->prefix))
+        {
+            return nullptr;
+        }
+
+        node = child->get();
+        path.remove_prefix(node->prefix.size());
+    }
+
+    for (auto const& [v, middleware] : node->handlers)
+    {
+        if (v == verb) return &middleware;
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/beast.hpp>
+
+#include "httpcontext.hpp"
+#include "httpmiddleware.hpp"
+
+namespace porla
+{
+    /*
+     * Routes requests on method and exact path to their middleware, from a
+     * radix trie over the paths which is built as the routes are added at
+     * startup. A lookup compares each character of the path at most once.
+     * Requests without a route are passed on to the next middleware.
+     */
+    class HttpRouter
+    {
+    public:
+        HttpRouter();
+
+        HttpRouter& Add(boost::beast::http::verb verb, std::string_view route, HttpMiddleware middleware);
+        HttpRouter& Get(std::string_view route, HttpMiddleware middleware);
+        HttpRouter& Post(std::string_view route, HttpMiddleware middleware);
+
+        void operator()(const std::shared_ptr<porla::HttpContext>& ctx) const;
+
+    private:
+        struct Node
+        {
+            std::string prefix;
+            std::vector<std::unique_ptr<Node>> children;
+            std::vector<std::pair<boost::beast::http::verb, HttpMiddleware>> handlers;
+        };
+
+        [[nodiscard]] const HttpMiddleware* Find(boost::beast::http::verb verb, std::string_view path) const;
+
+        // Shared so the router can be copied into the middleware chain.
+        std::shared_ptr<Node> m_root;
+    };
+}
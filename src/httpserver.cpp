@@ -1,5 +1,10 @@
 #include "httpserver.hpp"
 
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+
 #include <boost/beast.hpp>
 #include <boost/log/trivial.hpp>
 
@@ -7,18 +12,191 @@
 #include "httpmiddleware.hpp"
 #include "httpsession.hpp"
 
+namespace fs = std::filesystem;
+
 using porla::HttpServer;
 using porla::HttpSession;
 
+typedef boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol> Acceptor;
+
+#ifdef SO_REUSEPORT
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> ReusePort;
+#endif
+
+static boost::asio::ip::tcp::endpoint ToTcp(const boost::asio::generic::stream_protocol::endpoint& endpoint)
+{
+    boost::asio::ip::tcp::endpoint tcp;
+    std::memcpy(tcp.data(), endpoint.data(), std::min(endpoint.size(), tcp.capacity()));
+    tcp.resize(std::min(endpoint.size(), tcp.capacity()));
+    return tcp;
+}
+
+std::optional<porla::HttpListener> porla::HttpListener::Parse(const std::string& spec)
+{
+    if (spec.starts_with("unix:"))
+    {
+        if (spec.size() == 5) return std::nullopt;
+        return HttpListener{ .path = spec.substr(5) };
+    }
+
+    auto const colon = spec.rfind(':');
+
+    if (colon == std::string::npos || colon == 0 || colon == spec.size() - 1)
+    {
+        return std::nullopt;
+    }
+
+    std::string host = spec.substr(0, colon);
+
+    if (host.starts_with("[") && host.ends_with("]"))
+    {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    int port;
+
+    try
+    {
+        std::size_t pos;
+        port = std::stoi(spec.substr(colon + 1), &pos);
+
+        if (pos != spec.size() - colon - 1) return std::nullopt;
+    }
+    catch (const std::exception&)
+    {
+        return std::nullopt;
+    }
+
+    if (port < 0 || port > 65535)
+    {
+        return std::nullopt;
+    }
+
+    return HttpListener{ .host = std::move(host), .port = static_cast<uint16_t>(port) };
+}
+
 class HttpServer::State : public std::enable_shared_from_this<HttpServer::State>
 {
 public:
-    State(boost::asio::io_context& io, std::string const& host, uint16_t port)
+    State(boost::asio::io_context& io, porla::HttpServerOptions const& options)
         : m_io(io),
-        m_acceptor(boost::asio::make_strand(m_io))
+        m_options(options)
+    {
+        for (auto const& listener : m_options.listeners)
+        {
+            if (!listener.path.empty())
+            {
+                OpenUnix(listener);
+                continue;
+            }
+
+            for (std::size_t i = 0; i < std::max<std::size_t>(listener.acceptors, 1); i++)
+            {
+                OpenTcp(listener, listener.acceptors > 1);
+            }
+        }
+
+        if (m_listeners.empty())
+        {
+            BOOST_LOG_TRIVIAL(warning) << "No HTTP listeners configured";
+        }
+    }
+
+    boost::asio::ip::tcp::endpoint Endpoint()
+    {
+        for (auto const& listener : m_listeners)
+        {
+            if (listener->path.empty()) return ToTcp(listener->acceptor.local_endpoint());
+        }
+
+        return {};
+    }
+
+    void Start()
+    {
+        for (auto& listener : m_listeners)
+        {
+            boost::asio::dispatch(
+                listener->acceptor.get_executor(),
+                boost::beast::bind_front_handler(
+                    &State::BeginAccept,
+                    shared_from_this(),
+                    listener.get()));
+        }
+    }
+
+    void Stop()
+    {
+        std::map<uint64_t, std::weak_ptr<HttpSession>> sessions;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_middlewares.reset();
+            m_stopped = true;
+            sessions.swap(m_sessions);
+        }
+
+        for (auto& listener : m_listeners)
+        {
+            boost::asio::dispatch(
+                listener->acceptor.get_executor(),
+                [self = shared_from_this(), listener = listener.get()]()
+                {
+                    boost::system::error_code ec;
+                    listener->acceptor.close(ec);
+                });
+
+            if (!listener->path.empty())
+            {
+                std::error_code ec;
+                fs::remove(listener->path, ec);
+            }
+        }
+
+        // Stopping a session may destroy it, which takes the lock to remove it.
+        for (auto const& [id, session] : sessions)
+        {
+            if (auto s = session.lock())
+            {
+                s->Stop();
+            }
+        }
+    }
+
+    void Use(const porla::HttpMiddleware& middleware)
+    {
+        // The chain is shared by the sessions and never changed once they have
+        // it, so a new one is made with the middleware added.
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        auto middlewares = m_middlewares != nullptr
+            ? std::make_shared<std::vector<porla::HttpMiddleware>>(*m_middlewares)
+            : std::make_shared<std::vector<porla::HttpMiddleware>>();
+
+        middlewares->emplace_back(middleware);
+
+        m_middlewares = std::move(middlewares);
+    }
+
+private:
+    // Each acceptor has a strand of its own, so connections on the listeners
+    // are accepted concurrently by the threads running the I/O context.
+    struct Listener
+    {
+        explicit Listener(boost::asio::io_context& io)
+            : acceptor(boost::asio::make_strand(io))
+        {
+        }
+
+        Acceptor acceptor;
+        std::string path;
+        bool paused = false;
+    };
+
+    void OpenTcp(const porla::HttpListener& options, bool reuse_port)
     {
         boost::system::error_code ec;
-        auto addr = boost::asio::ip::make_address(host, ec);
+        auto addr = boost::asio::ip::make_address(options.host, ec);
 
         if (ec)
         {
@@ -26,98 +204,245 @@ public:
             addr = boost::asio::ip::make_address("127.0.0.1");
         }
 
-        auto endpoint = boost::asio::ip::tcp::endpoint{ addr, port };
+        auto endpoint = boost::asio::ip::tcp::endpoint{ addr, options.port };
+
+        // The acceptors sharing a port bind to the one the first was given.
+        if (reuse_port && endpoint.port() == 0)
+        {
+            for (auto const& listener : m_listeners)
+            {
+                auto const local = ToTcp(listener->acceptor.local_endpoint(ec));
+
+                if (listener->path.empty() && local.address() == addr)
+                {
+                    endpoint.port(local.port());
+                    break;
+                }
+            }
+        }
+
+        auto listener = std::make_unique<Listener>(m_io);
 
-        m_acceptor.open(endpoint.protocol(), ec);
+        listener->acceptor.open(boost::asio::generic::stream_protocol(endpoint.protocol().family(), endpoint.protocol().protocol()), ec);
         if (ec) { BOOST_LOG_TRIVIAL(error) << "Failed to open TCP endpoint: " << ec; }
 
-        m_acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
+        listener->acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
         if (ec) { BOOST_LOG_TRIVIAL(error) << "Failed to set reuse_address(true): " << ec; }
 
-        m_acceptor.bind(endpoint, ec);
+        if (reuse_port)
+        {
+#ifdef SO_REUSEPORT
+            listener->acceptor.set_option(ReusePort(true), ec);
+            if (ec) { BOOST_LOG_TRIVIAL(error) << "Failed to set SO_REUSEPORT: " << ec; }
+#else
+            BOOST_LOG_TRIVIAL(warning) << "SO_REUSEPORT is not supported on this platform";
+#endif
+        }
+
+        listener->acceptor.bind(endpoint, ec);
         if (ec) { BOOST_LOG_TRIVIAL(error) << "Failed to bind TCP endpoint: " << ec; }
 
-        m_acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+        listener->acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
         if (ec) { BOOST_LOG_TRIVIAL(error) << "Failed to listen: " << ec; }
 
-        BOOST_LOG_TRIVIAL(info) << "Running HTTP server on " << m_acceptor.local_endpoint();
-    }
+        BOOST_LOG_TRIVIAL(info) << "Running HTTP server on " << ToTcp(listener->acceptor.local_endpoint(ec));
 
-    auto Endpoint() { return m_acceptor.local_endpoint(); }
-
-    void Start()
-    {
-        boost::asio::dispatch(
-            m_acceptor.get_executor(),
-            boost::beast::bind_front_handler(
-                &State::BeginAccept,
-                shared_from_this()));
+        m_listeners.push_back(std::move(listener));
     }
 
-    void Stop()
+    void OpenUnix(const porla::HttpListener& options)
     {
-        m_acceptor.cancel();
-        m_middlewares.clear();
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        boost::system::error_code ec;
 
-        for (auto&& s : m_sessions)
+        // A socket file left by an earlier run which was not stopped cleanly
+        // would fail the bind.
+        std::error_code fs_ec;
+        if (fs::is_socket(options.path, fs_ec))
         {
-            if (auto sl = s.lock())
-            {
-                sl->Stop();
-            }
+            fs::remove(options.path, fs_ec);
         }
 
-        m_sessions.clear();
-    }
+        auto listener = std::make_unique<Listener>(m_io);
+        listener->path = options.path;
 
-    void Use(const porla::HttpMiddleware& middleware)
-    {
-        m_middlewares.emplace_back(middleware);
+        auto const endpoint = boost::asio::local::stream_protocol::endpoint(options.path);
+
+        listener->acceptor.open(boost::asio::generic::stream_protocol(AF_UNIX, 0), ec);
+        if (ec) { BOOST_LOG_TRIVIAL(error) << "Failed to open Unix socket: " << ec; }
+
+        listener->acceptor.bind(endpoint, ec);
+        if (ec) { BOOST_LOG_TRIVIAL(error) << "Failed to bind Unix socket " << options.path << ": " << ec; }
+
+        // Set the permissions before listening, so nobody connects before
+        // they are in place.
+        fs::permissions(options.path, static_cast<fs::perms>(options.mode) & fs::perms::mask, fs_ec);
+        if (fs_ec) { BOOST_LOG_TRIVIAL(error) << "Failed to set permissions of Unix socket: " << fs_ec.message(); }
+
+        listener->acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+        if (ec) { BOOST_LOG_TRIVIAL(error) << "Failed to listen: " << ec; }
+
+        BOOST_LOG_TRIVIAL(info) << "Running HTTP server on unix:" << options.path;
+
+        m_listeners.push_back(std::move(listener));
+#else
+        BOOST_LOG_TRIVIAL(error) << "Unix sockets are not supported on this platform - not listening on " << options.path;
+#endif
     }
 
-private:
-    void BeginAccept()
+    void BeginAccept(Listener* listener)
     {
-        m_acceptor.async_accept(
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            if (m_stopped)
+            {
+                return;
+            }
+
+            // Stop accepting while at the limit. The connections wait in the
+            // listen backlog, and accepting resumes when a session closes.
+            if (m_connections >= m_options.max_connections)
+            {
+                if (!m_paused)
+                {
+                    BOOST_LOG_TRIVIAL(warning) << "Reached the limit of " << m_options.max_connections << " HTTP connections";
+                }
+
+                m_paused = true;
+                listener->paused = true;
+                return;
+            }
+
+            // Reserve the connection before accepting it, since the listeners
+            // accept concurrently and would go over the limit together if each
+            // only counted the sessions already open.
+            m_connections++;
+        }
+
+        listener->acceptor.async_accept(
             boost::asio::make_strand(m_io),
             boost::beast::bind_front_handler(
                 &State::EndAccept,
-                shared_from_this()));
+                shared_from_this(),
+                listener));
     }
 
-    void EndAccept(boost::system::error_code ec, boost::asio::ip::tcp::socket socket)
+    void EndAccept(Listener* listener, boost::system::error_code ec, boost::asio::generic::stream_protocol::socket socket)
     {
+        if (ec == boost::asio::error::operation_aborted)
+        {
+            return Release();
+        }
+
         if (ec)
         {
             BOOST_LOG_TRIVIAL(error) << "Error when accepting HTTP client: " << ec.message();
+            Release();
         }
         else
         {
-            BOOST_LOG_TRIVIAL(debug) << "Incoming HTTP connection from " << socket.remote_endpoint();
+            if (listener->path.empty())
+            {
+                BOOST_LOG_TRIVIAL(debug) << "Incoming HTTP connection from " << ToTcp(socket.remote_endpoint(ec));
+            }
+            else
+            {
+                BOOST_LOG_TRIVIAL(debug) << "Incoming HTTP connection on unix:" << listener->path;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            if (m_stopped)
+            {
+                m_connections--;
+                return;
+            }
+
+            auto const id = m_next_id++;
 
             auto session = std::make_shared<HttpSession>(
                 std::move(socket),
-                m_middlewares);
+                porla::HttpSessionOptions{
+                    .middlewares     = m_middlewares,
+                    .metrics         = m_options.metrics,
+                    .on_close        = [state = weak_from_this(), id]()
+                    {
+                        if (auto s = state.lock()) s->OnClose(id);
+                    },
+                    .pipeline_depth  = m_options.pipeline_depth,
+                    .idle_timeout    = m_options.idle_timeout,
+                    .request_timeout = m_options.request_timeout
+                });
 
-            m_sessions.push_back(session);
+            m_sessions.insert({ id, session });
+
+            lock.unlock();
 
             session->Run();
         }
 
-        BeginAccept();
+        BeginAccept(listener);
+    }
+
+    // Called when a session is destroyed, from any thread.
+    void OnClose(uint64_t id)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_sessions.erase(id);
+        }
+
+        Release();
+    }
+
+    // Gives back a reserved connection, and resumes accepting if paused.
+    void Release()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        m_connections--;
+
+        if (!m_paused || m_stopped)
+        {
+            return;
+        }
+
+        m_paused = false;
+
+        for (auto& listener : m_listeners)
+        {
+            if (!listener->paused) continue;
+
+            listener->paused = false;
+
+            boost::asio::post(
+                listener->acceptor.get_executor(),
+                boost::beast::bind_front_handler(
+                    &State::BeginAccept,
+                    shared_from_this(),
+                    listener.get()));
+        }
     }
 
     boost::asio::io_context& m_io;
-    boost::asio::ip::tcp::acceptor m_acceptor;
+    porla::HttpServerOptions m_options;
+    std::vector<std::unique_ptr<Listener>> m_listeners;
 
-    std::vector<std::weak_ptr<HttpSession>> m_sessions;
-    std::vector<porla::HttpMiddleware> m_middlewares;
+    std::mutex m_mutex;
+    std::shared_ptr<const std::vector<porla::HttpMiddleware>> m_middlewares;
+    std::map<uint64_t, std::weak_ptr<HttpSession>> m_sessions;
+    // The open sessions and the connections being accepted.
+    std::size_t m_connections = 0;
+    uint64_t m_next_id = 0;
+    bool m_paused = false;
+    bool m_stopped = false;
 };
 
 HttpServer::HttpServer(boost::asio::io_context& io, porla::HttpServerOptions const& options)
     : m_io(io)
 {
-    m_state = std::make_shared<State>(io, options.host, options.port);
+    m_state = std::make_shared<State>(io, options);
     m_state->Start();
 }
 
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
@@ -11,10 +15,41 @@
 
 namespace porla
 {
-    struct HttpServerOptions
+    class RequestMetrics;
+
+    struct HttpListener
     {
+        // Parses "host:port", "[v6]:port" or "unix:/path", and returns nullopt
+        // if the spec is none of them.
+        static std::optional<HttpListener> Parse(const std::string& spec);
+
         std::string host;
-        uint16_t port;
+        uint16_t port = 0;
+        // The number of acceptors bound to the TCP endpoint with SO_REUSEPORT,
+        // which the kernel spreads the connections over.
+        std::size_t acceptors = 1;
+        // Listens on a Unix domain socket at this path instead of TCP when set.
+        std::string path;
+        // The permissions of the socket file, which control who may connect.
+        int mode = 0600;
+    };
+
+    struct HttpServerOptions
+    {
+        std::vector<HttpListener> listeners;
+        // Requests are measured per route path when set.
+        RequestMetrics* metrics = nullptr;
+        // New connections are not accepted while this many are open, counted
+        // over all listeners.
+        std::size_t max_connections = 1024;
+        // The number of requests read from a connection before the responses
+        // to the first of them have been written.
+        std::size_t pipeline_depth = 8;
+        // How long a connection may wait between requests before it is closed.
+        std::chrono::milliseconds idle_timeout = std::chrono::seconds(30);
+        // How long a client has to send a request it has started, and a
+        // response has to be written.
+        std::chrono::milliseconds request_timeout = std::chrono::seconds(30);
     };
 
     class HttpServer
@@ -23,6 +58,7 @@ namespace porla
         HttpServer(boost::asio::io_context& io, HttpServerOptions const& options);
         ~HttpServer();
 
+        // The endpoint of the first TCP listener.
         boost::asio::ip::tcp::endpoint Endpoint();
         void Use(const HttpMiddleware& middleware);
 
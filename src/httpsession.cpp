@@ -1,15 +1,20 @@
 #include "httpsession.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <memory>
 #include <utility>
 
+#include <boost/beast/websocket/rfc6455.hpp>
 #include <boost/log/trivial.hpp>
 #include <nlohmann/json.hpp>
 #include <uriparser/Uri.h>
 
 #include "httpcontext.hpp"
 #include "httpmiddleware.hpp"
+#include "utils/wireencoding.hpp"
 
 namespace fs = std::filesystem;
 
@@ -18,25 +23,231 @@ using BasicHttpRequest = boost::beast::http::request<boost::beast::http::string_
 
 using porla::HttpSession;
 
-class HttpSession::MiddlewareContext : public porla::HttpContext
+// The largest read of a request body, which is also the most Beast reads at once.
+static constexpr std::uint64_t MaxReadSize = 64 * 1024;
+
+// Whether the request asks for an event stream, which takes the connection
+// over like an upgrade does.
+static bool AcceptsEventStream(const BasicHttpRequest& req)
+{
+    auto rest = req[boost::beast::http::field::accept];
+
+    while (!rest.empty())
+    {
+        auto const comma = rest.find(',');
+        auto range = rest.substr(0, comma);
+        rest = comma == boost::beast::string_view::npos ? boost::beast::string_view() : rest.substr(comma + 1);
+
+        range = range.substr(0, range.find(';'));
+
+        auto const begin = range.find_first_not_of(" \t");
+        if (begin == boost::beast::string_view::npos) continue;
+
+        range = range.substr(begin, range.find_last_not_of(" \t") - begin + 1);
+
+        if (boost::beast::iequals(range, "text/event-stream")) return true;
+    }
+
+    return false;
+}
+
+// Writes the header of a chunked response, then each chunk from the producer
+// as it is written, asking for the next one only when the previous is sent.
+class HttpSession::Queue::ChunkedWork : public HttpSession::Queue::Work
+{
+public:
+    ChunkedWork(
+        HttpSession& self,
+        boost::beast::http::response<boost::beast::http::empty_body>&& res,
+        porla::HttpContext::ChunkProducer producer)
+        : m_self(self)
+        , m_res(std::move(res))
+        , m_sr(m_res)
+        , m_producer(std::move(producer))
+        , m_more(true)
+    {
+        m_res.chunked(true);
+    }
+
+    void operator()() override
+    {
+        m_self.m_stream.expires_after(m_self.m_options.request_timeout);
+
+        boost::beast::http::async_write_header(
+            m_self.m_stream,
+            m_sr,
+            [this, session = m_self.shared_from_this()](boost::beast::error_code ec, std::size_t)
+            {
+                if (ec) return session->EndWrite(true, ec, 0);
+                Produce();
+            });
+    }
+
+private:
+    void Produce()
+    {
+        // The work item lives until EndWrite is called for it, which is not
+        // before the producer passes its last chunk.
+        m_producer(
+            [this, session = m_self.shared_from_this()](std::string chunk, bool more)
+            {
+                boost::asio::dispatch(
+                    session->m_stream.get_executor(),
+                    [this, session, chunk = std::move(chunk), more]() mutable
+                    {
+                        m_chunk = std::move(chunk);
+                        m_more = more;
+                        WriteChunk();
+                    });
+            });
+    }
+
+    void WriteChunk()
+    {
+        if (m_chunk.empty())
+        {
+            return m_more ? Produce() : WriteLast();
+        }
+
+        m_self.m_stream.expires_after(m_self.m_options.request_timeout);
+
+        boost::asio::async_write(
+            m_self.m_stream,
+            boost::beast::http::make_chunk(boost::asio::buffer(m_chunk)),
+            [this, session = m_self.shared_from_this()](boost::beast::error_code ec, std::size_t)
+            {
+                if (ec) return session->EndWrite(true, ec, 0);
+
+                m_chunk.clear();
+                m_chunk.shrink_to_fit();
+
+                m_more ? Produce() : WriteLast();
+            });
+    }
+
+    void WriteLast()
+    {
+        boost::asio::async_write(
+            m_self.m_stream,
+            boost::beast::http::make_chunk_last(),
+            [this, session = m_self.shared_from_this()](boost::beast::error_code ec, std::size_t bytes_transferred)
+            {
+                session->EndWrite(m_res.need_eof(), ec, bytes_transferred);
+            });
+    }
+
+    HttpSession& m_self;
+    boost::beast::http::response<boost::beast::http::empty_body> m_res;
+    boost::beast::http::response_serializer<boost::beast::http::empty_body> m_sr;
+    porla::HttpContext::ChunkProducer m_producer;
+    std::string m_chunk;
+    bool m_more;
+};
+
+void HttpSession::Queue::operator()(
+    std::uint64_t slot,
+    boost::beast::http::response<boost::beast::http::empty_body>&& res,
+    porla::HttpContext::ChunkProducer producer)
+{
+    Fill(slot, std::make_unique<ChunkedWork>(m_self, std::move(res), std::move(producer)));
+}
+
+void HttpSession::Queue::Fill(std::uint64_t slot, std::unique_ptr<Work> work)
+{
+    if (slot < m_head || slot - m_head >= m_items.size() || m_items[slot - m_head] != nullptr)
+    {
+        BOOST_LOG_TRIVIAL(warning) << "Dropping more than one response to an HTTP request";
+        return;
+    }
+
+    m_items[slot - m_head] = std::move(work);
+
+    MaybeWrite();
+}
+
+void HttpSession::Queue::MaybeWrite()
+{
+    // Responses are written in the order of their requests, so one which is
+    // ready waits for the ones before it.
+    if (m_writing || m_items.empty() || m_items.front() == nullptr)
+    {
+        return;
+    }
+
+    m_writing = true;
+    (*m_items.front())();
+}
+
+// Records the metrics of one request in the series of its route, from when it
+// was read until its response is queued. It is shared by the contexts of each
+// middleware the request passes through.
+class HttpSession::Measurement
+{
+public:
+    Measurement(std::shared_ptr<porla::RequestMetrics::Series> series, std::uint64_t request_bytes)
+        : m_series(std::move(series))
+        , m_start(std::chrono::steady_clock::now())
+        , m_request_bytes(request_bytes)
+    {
+        m_series->Begin();
+    }
+
+    ~Measurement()
+    {
+        // Requests which take over the stream, such as the event stream, never
+        // queue a response and are measured until they are closed.
+        Record(0);
+    }
+
+    void Add(std::uint64_t response_bytes)
+    {
+        m_response_bytes += response_bytes;
+    }
+
+    void Record(unsigned status)
+    {
+        if (m_recorded.exchange(true)) return;
+
+        m_series->End(
+            std::chrono::steady_clock::now() - m_start,
+            status >= 400 ? static_cast<int>(status) : 0,
+            m_request_bytes,
+            m_response_bytes);
+    }
+
+private:
+    std::shared_ptr<porla::RequestMetrics::Series> m_series;
+    std::chrono::steady_clock::time_point m_start;
+    std::uint64_t m_request_bytes;
+    std::atomic_uint64_t m_response_bytes{0};
+    std::atomic_bool m_recorded{false};
+};
+
+// The context of a request, shared by each middleware it is passed through.
+// The request is moved in once and the middlewares are read from the chain
+// shared by every session, so passing it on does not copy anything.
+class HttpSession::MiddlewareContext
+    : public porla::HttpContext
+    , public std::enable_shared_from_this<MiddlewareContext>
 {
 public:
     explicit MiddlewareContext(
         std::shared_ptr<HttpSession> session,
         BasicHttpRequest req,
-        std::vector<porla::HttpMiddleware> mws,
-        std::vector<porla::HttpMiddleware>::const_iterator current)
+        std::shared_ptr<const std::vector<porla::HttpMiddleware>> mws,
+        std::uint64_t slot)
         : m_session(std::move(session))
         , m_req(std::move(req))
         , m_mws(std::move(mws))
-        , m_curr(current)
+        , m_curr(0)
+        , m_slot(slot)
     {
         UriUriA uri = {};
 
         UriParserStateA state;
         state.uri = &uri;
 
-        std::string faked_url = "http://porla" + m_req.target().to_string();
+        std::string const faked_url = "http://porla" + std::string(m_req.target());
 
         if (uriParseUriA(&state, faked_url.c_str()) != URI_SUCCESS)
         {
@@ -44,36 +255,37 @@ public:
         }
         else
         {
-            UriPathSegmentStructA *head(uri.pathHead);
-            std::stringstream accum;
-
-            const auto fromRange = [](const UriTextRangeA &range) -> std::string
+            for (auto head = uri.pathHead; head != nullptr; head = head->next)
             {
-                return {range.first, range.afterLast};
-            };
-
-            while (head)
-            {
-                accum << "/" << fromRange(head->text);
-                head = head->next;
+                m_uri.path.push_back('/');
+                m_uri.path.append(head->text.first, head->text.afterLast);
             }
-
-            m_uri = Uri{
-                .path = accum.str()
-            };
         }
+
+        uriFreeUriMembersA(&uri);
+    }
+
+    // Runs the first middleware of the chain.
+    void Run()
+    {
+        (*m_mws)[m_curr](shared_from_this());
+    }
+
+    // Measures the request in the series, which is looked up by its path.
+    void Measure(std::shared_ptr<porla::RequestMetrics::Series> series)
+    {
+        m_measurement = std::make_shared<Measurement>(std::move(series), m_req.body().size());
     }
 
     void Next() override
     {
-        auto next = m_curr + 1;
-        auto ctx = std::make_shared<MiddlewareContext>(
-            m_session,
-            m_req,
-            m_mws,
-            next);
+        if (m_curr + 1 >= m_mws->size())
+        {
+            BOOST_LOG_TRIVIAL(warning) << "No middleware after the last one for " << m_uri.path;
+            return;
+        }
 
-        (*next)(ctx);
+        (*m_mws)[++m_curr](shared_from_this());
     }
 
     boost::beast::http::request<boost::beast::http::string_body>& Request() override
@@ -81,8 +293,19 @@ public:
         return m_req;
     }
 
-    boost::beast::tcp_stream& Stream() override
+    porla::HttpStream& Stream() override
+    {
+        return m_session->m_stream;
+    }
+
+    [[nodiscard]] std::uint64_t Slot() const { return m_slot; }
+
+    porla::HttpStream& TakeStream() override
     {
+        boost::asio::dispatch(
+            m_session->m_stream.get_executor(),
+            [session = m_session, slot = m_slot]() { session->TakeOver(slot); });
+
         return m_session->m_stream;
     }
 
@@ -102,50 +325,148 @@ public:
         res.body() = body;
         res.prepare_payload();
 
-        m_session->m_queue(std::move(res));
+        Queue(std::move(res));
     }
 
     void Write(boost::beast::http::response<boost::beast::http::file_body> res) override
     {
-        m_session->m_queue(std::move(res));
+        Queue(std::move(res));
     }
 
     void Write(boost::beast::http::response<boost::beast::http::string_body> res) override
     {
-        m_session->m_queue(std::move(res));
+        Queue(std::move(res));
+    }
+
+    void WriteChunked(boost::beast::http::response<boost::beast::http::empty_body> res, ChunkProducer producer) override
+    {
+        namespace http = boost::beast::http;
+
+        // Chunked responses are measured until their last chunk is produced.
+        if (m_measurement != nullptr)
+        {
+            producer = [producer = std::move(producer), measurement = m_measurement, status = res.result_int()](const ChunkCb& cb)
+            {
+                producer(
+                    [cb, measurement, status](std::string chunk, bool more)
+                    {
+                        measurement->Add(chunk.size());
+                        if (!more) measurement->Record(status);
+                        cb(std::move(chunk), more);
+                    });
+            };
+        }
+
+        if (m_req.version() >= 11)
+        {
+            return boost::asio::dispatch(
+                m_session->m_stream.get_executor(),
+                [session = m_session, slot = m_slot, res = std::move(res), producer = std::move(producer)]() mutable
+                {
+                    session->m_queue(slot, std::move(res), std::move(producer));
+                });
+        }
+
+        // HTTP/1.0 has no chunked encoding, so collect the whole body instead.
+        Collect(
+            m_session,
+            m_slot,
+            std::make_shared<http::response<http::string_body>>(std::move(res.base())),
+            std::move(producer));
     }
 
     void WriteJson(const nlohmann::json& j) override
     {
         namespace http = boost::beast::http;
 
+        // Clients which accept CBOR or MessagePack get the value in that instead.
+        auto const encoding = porla::Utils::ResponseEncoding(m_req);
+
         http::response<http::string_body> res{http::status::ok, m_req.version()};
         res.set(http::field::server, "porla/1.0");
-        res.set(http::field::content_type, "application/json");
+        res.set(http::field::content_type, porla::Utils::ContentType(encoding));
         res.keep_alive(m_req.keep_alive());
-        res.body() = j.dump();
+        res.body() = porla::Utils::Encode(j, encoding);
         res.prepare_payload();
 
-        m_session->m_queue(std::move(res));
+        Queue(std::move(res));
     }
 
 private:
+    static void Collect(
+        std::shared_ptr<HttpSession> session,
+        std::uint64_t slot,
+        std::shared_ptr<boost::beast::http::response<boost::beast::http::string_body>> res,
+        ChunkProducer producer)
+    {
+        producer(
+            [session, slot, res, producer](std::string chunk, bool more)
+            {
+                res->body() += chunk;
+
+                if (more)
+                {
+                    // Post instead of calling the producer again to not recurse
+                    // on producers which pass their chunks right away.
+                    return boost::asio::post(
+                        session->m_stream.get_executor(),
+                        [session, slot, res, producer]() { Collect(session, slot, res, producer); });
+                }
+
+                res->prepare_payload();
+
+                boost::asio::dispatch(
+                    session->m_stream.get_executor(),
+                    [session, slot, res]() { session->m_queue(slot, std::move(*res)); });
+            });
+    }
+
+    // Responses may be written from any thread, for example by handlers running
+    // on the session thread. The queue is only touched on the stream's strand.
+    template<class Body>
+    void Queue(boost::beast::http::response<Body>&& res)
+    {
+        if (m_measurement != nullptr)
+        {
+            m_measurement->Add(res.body().size());
+            m_measurement->Record(res.result_int());
+        }
+
+        boost::asio::dispatch(
+            m_session->m_stream.get_executor(),
+            [session = m_session, slot = m_slot, res = std::move(res)]() mutable
+            {
+                session->m_queue(slot, std::move(res));
+            });
+    }
+
     std::shared_ptr<HttpSession> m_session;
     BasicHttpRequest m_req;
-    std::vector<porla::HttpMiddleware> m_mws;
-    std::vector<porla::HttpMiddleware>::const_iterator m_curr;
+    std::shared_ptr<const std::vector<porla::HttpMiddleware>> m_mws;
+    std::size_t m_curr;
+    std::uint64_t m_slot;
+    std::shared_ptr<Measurement> m_measurement;
     Uri m_uri;
 };
 
-HttpSession::HttpSession(
-    boost::asio::ip::tcp::socket&& socket,
-    std::vector<porla::HttpMiddleware> middlewares)
+HttpSession::HttpSession(boost::asio::generic::stream_protocol::socket&& socket, HttpSessionOptions options)
     : m_stream(std::move(socket))
-    , m_queue(*this)
-    , m_middlewares(std::move(middlewares))
+    , m_options(std::move(options))
+    , m_queue(*this, m_options.pipeline_depth)
+    , m_timer(m_stream.get_executor())
+    , m_timer_generation(0)
+    , m_reading(false)
+    , m_reading_body(false)
+    , m_closing(false)
+    , m_taken_over(false)
 {
 }
 
+HttpSession::~HttpSession()
+{
+    if (m_options.on_close) m_options.on_close();
+}
+
 void HttpSession::Run()
 {
     // We need to be executing within a strand to perform async operations
@@ -161,17 +482,67 @@ void HttpSession::Run()
 
 void HttpSession::Stop()
 {
-    m_stream.close();
+    boost::asio::dispatch(
+        m_stream.get_executor(),
+        [self = shared_from_this()]()
+        {
+            self->m_closing = true;
+            self->DisarmTimer();
+            self->m_stream.close();
+        });
 }
 
 void HttpSession::BeginRead()
 {
+    if (m_reading || m_closing)
+    {
+        return;
+    }
+
+    m_reading = true;
+    m_reading_body = false;
+
     m_parser.emplace();
     m_parser->body_limit(10000000);
 
-    m_stream.expires_after(std::chrono::seconds(30));
+    // Only the writes have timeouts on the stream. A connection without any
+    // requests in progress is closed when it has been idle for too long, but
+    // one waiting for its responses may send nothing until they are written.
+    m_stream.expires_never();
+
+    if (m_queue.IsEmpty())
+    {
+        ArmTimer(m_options.idle_timeout);
+    }
+
+    boost::beast::http::async_read_header(
+        m_stream,
+        m_buffer,
+        *m_parser,
+        boost::beast::bind_front_handler(
+            &HttpSession::EndReadHeader,
+            shared_from_this()));
+}
+
+void HttpSession::EndReadHeader(boost::beast::error_code ec, std::size_t bytes_transferred)
+{
+    if (ec)
+    {
+        return EndRead(ec, bytes_transferred);
+    }
+
+    // A client which has started a request has this long to send the rest.
+    m_reading_body = true;
+    ArmTimer(m_options.request_timeout);
+
+    // Each read costs the same few allocations whatever its size, so read
+    // large bodies in large chunks instead of the 512 bytes the buffer would
+    // otherwise grow by. The buffer keeps its size for the next requests.
+    if (auto const length = m_parser->content_length(); length.has_value() && length.value() > m_buffer.capacity())
+    {
+        m_buffer.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(length.value(), MaxReadSize)));
+    }
 
-    // Read a request using the parser-oriented interface
     boost::beast::http::async_read(
         m_stream,
         m_buffer,
@@ -187,50 +558,88 @@ void HttpSession::EndRead(boost::beast::error_code ec, std::size_t bytes_transfe
 
     boost::ignore_unused(bytes_transferred);
 
-    // This means they closed the connection
+    m_reading = false;
+    DisarmTimer();
+
+    // This means they closed the connection. Write the responses to the
+    // requests already read before closing our side of it.
     if(ec == http::error::end_of_stream)
     {
-        BOOST_LOG_TRIVIAL(info) << "Stream closing";
-        return BeginClose();
+        BOOST_LOG_TRIVIAL(debug) << "Stream closing";
+
+        m_closing = true;
+        if (m_queue.IsEmpty()) BeginClose();
+
+        return;
     }
 
     if(ec)
     {
-        BOOST_LOG_TRIVIAL(error) << "Error when reading HTTP request: " << ec.message();
+        if (ec != boost::asio::error::operation_aborted)
+        {
+            BOOST_LOG_TRIVIAL(debug) << "Error when reading HTTP request: " << ec.message();
+        }
+
+        return;
+    }
+
+    // A response took the connection over while this request was read.
+    if (m_closing)
+    {
         return;
     }
 
-    // Check for matching handler
     auto req = m_parser->release();
+    auto const slot = m_queue.Reserve();
 
-    if (!m_middlewares.empty())
+    // Upgrades and event streams write to the stream themselves once they
+    // take it over, so they must not run while earlier responses are pending.
+    bool const takes_over = boost::beast::websocket::is_upgrade(req) || AcceptsEventStream(req);
+
+    // Nothing is read after a request which asks to close the connection. The
+    // same goes for the requests taking the stream over, which either do so or
+    // are refused and closed, since the bytes after upgrades are not HTTP.
+    if (!req.keep_alive() || takes_over)
+    {
+        m_closing = true;
+    }
+
+    if (m_options.middlewares != nullptr && !m_options.middlewares->empty())
     {
-        auto first = m_middlewares.begin();
         auto ctx = std::make_shared<MiddlewareContext>(
             shared_from_this(),
             std::move(req),
-            m_middlewares,
-            first);
+            m_options.middlewares,
+            slot);
 
-        (*first)(ctx);
+        if (m_options.metrics != nullptr)
+        {
+            ctx->Measure(m_options.metrics->Get(ctx->RequestUri().path));
+        }
 
-        return;
+        if (takes_over && !m_queue.IsNext(slot))
+        {
+            m_deferred = std::move(ctx);
+        }
+        else
+        {
+            ctx->Run();
+        }
     }
-
-    auto const not_found = [&req](boost::beast::string_view target)
+    else
     {
         http::response<http::string_body> res{http::status::not_found, req.version()};
         res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
         res.set(http::field::content_type, "text/plain");
         res.keep_alive(req.keep_alive());
-        res.body() = "The resource '" + std::string(target) + "' was not found.";
+        res.body() = "The resource '" + std::string(req.target()) + "' was not found.";
         res.prepare_payload();
-        return res;
-    };
 
-    m_queue(not_found(req.target()));
+        m_queue(slot, std::move(res));
+    }
 
-    // If we aren't at the queue limit, try to pipeline another request
+    // Read the next request while this one is handled, unless the client
+    // has as many requests in progress as we allow.
     if(!m_queue.IsFull())
     {
         BeginRead();
@@ -251,6 +660,7 @@ void HttpSession::EndWrite(bool close, boost::beast::error_code ec, std::size_t
     {
         // This means we should close the connection, usually because
         // the response indicated the "Connection: close" semantic.
+        m_closing = true;
         return BeginClose();
     }
 
@@ -260,11 +670,97 @@ void HttpSession::EndWrite(bool close, boost::beast::error_code ec, std::size_t
         // Read another request
         BeginRead();
     }
+
+    // The responses before the request waiting to take the stream over are
+    // written, so it can run now.
+    if (m_deferred != nullptr && m_queue.IsNext(m_deferred->Slot()))
+    {
+        auto ctx = std::move(m_deferred);
+        m_deferred.reset();
+
+        return ctx->Run();
+    }
+
+    if (m_queue.IsEmpty())
+    {
+        if (m_closing)
+        {
+            return BeginClose();
+        }
+
+        // The read waiting for the next request has been without a timeout
+        // while the responses were written.
+        if (m_reading && !m_reading_body)
+        {
+            ArmTimer(m_options.idle_timeout);
+        }
+    }
 }
 
 void HttpSession::BeginClose()
 {
+    DisarmTimer();
+
+    // The stream is closed by the one which took it over.
+    if (m_taken_over)
+    {
+        return;
+    }
+
     // Send a TCP shutdown
     boost::beast::error_code ec;
-    m_stream.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
-}
\ No newline at end of file
+    m_stream.socket().shutdown(boost::asio::socket_base::shutdown_send, ec);
+}
+
+void HttpSession::TakeOver(std::uint64_t slot)
+{
+    // Requests known to take the stream over wait for the responses before
+    // them, so this is one which was not. Its writes would interleave with
+    // theirs, so refuse it by closing the connection instead.
+    if (!m_queue.IsNext(slot))
+    {
+        BOOST_LOG_TRIVIAL(warning) << "Closing HTTP connection taken over while earlier responses were pending";
+
+        m_closing = true;
+        DisarmTimer();
+        m_stream.close();
+
+        return;
+    }
+
+    // The response writes to the stream for as long as the connection is
+    // open, so it is neither read from nor timed out anymore.
+    m_closing = true;
+    m_taken_over = true;
+    DisarmTimer();
+    m_stream.expires_never();
+}
+
+void HttpSession::ArmTimer(std::chrono::milliseconds timeout)
+{
+    auto const generation = ++m_timer_generation;
+
+    m_timer.expires_after(timeout);
+    m_timer.async_wait(
+        [self = weak_from_this(), generation](boost::beast::error_code ec)
+        {
+            auto session = self.lock();
+
+            // The timer may have fired just before it was rearmed or disarmed.
+            if (ec || session == nullptr || session->m_timer_generation != generation)
+            {
+                return;
+            }
+
+            BOOST_LOG_TRIVIAL(debug) << "Closing HTTP connection which timed out";
+
+            session->m_closing = true;
+            session->m_stream.close();
+        });
+}
+
+void HttpSession::DisarmTimer()
+{
+    ++m_timer_generation;
+    m_timer.cancel();
+}
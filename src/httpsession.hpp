@@ -1,27 +1,48 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 
+#include "httpcontext.hpp"
 #include "httpmiddleware.hpp"
+#include "requestmetrics.hpp"
 
 namespace porla
 {
+    struct HttpSessionOptions
+    {
+        std::shared_ptr<const std::vector<porla::HttpMiddleware>> middlewares;
+        porla::RequestMetrics* metrics = nullptr;
+        // Called when the session is destroyed.
+        std::function<void()> on_close;
+        // The number of requests read ahead of their responses.
+        std::size_t pipeline_depth = 8;
+        // How long to wait for the next request on a kept-alive connection.
+        std::chrono::milliseconds idle_timeout = std::chrono::seconds(30);
+        // How long a started request may take to read, or a response to write.
+        std::chrono::milliseconds request_timeout = std::chrono::seconds(30);
+    };
+
     class HttpSession : public std::enable_shared_from_this<HttpSession>
     {
+        class Measurement;
         class MiddlewareContext;
-    
+
+        /*
+         * The responses of the requests on the connection, in the order the
+         * requests were read. Each request reserves a slot when it is read,
+         * and its response is written once the ones before it are.
+         */
         class Queue
         {
-            enum
-            {
-                // Maximum number of responses we will queue
-                Limit = 8
-            };
-
             // The type-erased, saved work item
             struct Work
             {
@@ -30,20 +51,44 @@ namespace porla
             };
 
             HttpSession& m_self;
-            std::vector<std::unique_ptr<Work>> m_items;
+            std::size_t m_limit;
+            std::deque<std::unique_ptr<Work>> m_items;
+            std::uint64_t m_head;
+            bool m_writing;
 
         public:
-            explicit Queue(HttpSession& self)
+            explicit Queue(HttpSession& self, std::size_t limit)
                 : m_self(self)
+                , m_limit(std::max<std::size_t>(limit, 1))
+                , m_head(0)
+                , m_writing(false)
             {
-                static_assert(Limit > 0, "queue limit must be positive");
-                m_items.reserve(Limit);
             }
 
             // Returns `true` if we have reached the queue limit
             bool IsFull() const
             {
-                return m_items.size() >= Limit;
+                return m_items.size() >= m_limit;
+            }
+
+            // Returns `true` if no request is waiting for its response
+            bool IsEmpty() const
+            {
+                return m_items.empty();
+            }
+
+            // Returns `true` if the slot is the next to be written and no
+            // response is being written
+            bool IsNext(std::uint64_t slot) const
+            {
+                return !m_writing && slot == m_head;
+            }
+
+            // Reserves the slot of the response to the request just read
+            std::uint64_t Reserve()
+            {
+                m_items.emplace_back();
+                return m_head + m_items.size() - 1;
             }
 
             // Called when a message finishes sending
@@ -52,14 +97,15 @@ namespace porla
             {
                 BOOST_ASSERT(!m_items.empty());
                 auto const wasFull = IsFull();
-                m_items.erase(m_items.begin());
-                if(! m_items.empty())
-                    (*m_items.front())();
+                m_items.pop_front();
+                m_head++;
+                m_writing = false;
+                MaybeWrite();
                 return wasFull;
             }
 
             template<bool isRequest, class Body, class Fields>
-            void operator()(boost::beast::http::message<isRequest, Body, Fields>&& msg)
+            void operator()(std::uint64_t slot, boost::beast::http::message<isRequest, Body, Fields>&& msg)
             {
                 // This holds a work item
                 struct WorkImpl : Work
@@ -77,6 +123,8 @@ namespace porla
 
                     void operator()()
                     {
+                        m_self.m_stream.expires_after(m_self.m_options.request_timeout);
+
                         boost::beast::http::async_write(
                             m_self.m_stream,
                             m_msg,
@@ -87,35 +135,59 @@ namespace porla
                     }
                 };
 
-                // Allocate and store the work
-                m_items.push_back(std::make_unique<WorkImpl>(m_self, std::move(msg)));
-
-                // If there was no previous work, start this one
-                if(m_items.size() == 1)
-                    (*m_items.front())();
+                Fill(slot, std::make_unique<WorkImpl>(m_self, std::move(msg)));
             }
+
+            void operator()(
+                std::uint64_t slot,
+                boost::beast::http::response<boost::beast::http::empty_body>&& res,
+                HttpContext::ChunkProducer producer);
+
+        private:
+            class ChunkedWork;
+
+            void Fill(std::uint64_t slot, std::unique_ptr<Work> work);
+            void MaybeWrite();
         };
 
     public:
-        HttpSession(
-            boost::asio::ip::tcp::socket&& socket,
-            std::vector<porla::HttpMiddleware> middlewares);
+        HttpSession(boost::asio::generic::stream_protocol::socket&& socket, HttpSessionOptions options);
+        ~HttpSession();
 
         void Run();
         void Stop();
 
     private:
         void BeginRead();
+        void EndReadHeader(boost::beast::error_code ec, std::size_t bytes_transferred);
         void EndRead(boost::beast::error_code ec, std::size_t bytes_transferred);
         void EndWrite(bool close, boost::beast::error_code ec, std::size_t bytes_transferred);
         void BeginClose();
+        void TakeOver(std::uint64_t slot);
+
+        // The timeouts of reads are kept here instead of on the stream, so a
+        // read can wait without one while responses are being written.
+        void ArmTimer(std::chrono::milliseconds timeout);
+        void DisarmTimer();
 
-        boost::beast::tcp_stream m_stream;
+        porla::HttpStream m_stream;
         boost::beast::flat_buffer m_buffer;
-        std::vector<porla::HttpMiddleware> m_middlewares;
+        HttpSessionOptions m_options;
 
         Queue m_queue;
 
+        // A request which takes the stream over, waiting for the responses
+        // before it to be written.
+        std::shared_ptr<MiddlewareContext> m_deferred;
+
+        boost::asio::steady_timer m_timer;
+        std::uint64_t m_timer_generation;
+
+        bool m_reading;      // A read is in progress
+        bool m_reading_body; // The header of the request being read is read
+        bool m_closing;      // No more requests are read from the connection
+        bool m_taken_over;   // A response writes to the stream itself
+
         // The parser is stored in an optional container so we can
         // construct it from scratch it at the beginning of each new message.
         boost::optional<boost::beast::http::request_parser<boost::beast::http::string_body>> m_parser;
@@ -0,0 +1,497 @@
+#include "httpwebsocket.hpp"
+
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <utility>
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/signals2.hpp>
+#include <nlohmann/json.hpp>
+
+#include "httpeventstream.hpp"
+#include "httpjwtauth.hpp"
+#include "jsonrpchandler.hpp"
+#include "utils/wireencoding.hpp"
+
+using json = nlohmann::json;
+using porla::HttpWebSocket;
+
+// The number of calls from one connection which may be in progress before
+// nothing more is read from it.
+static constexpr std::size_t MaxPendingCalls = 64;
+
+// How long a client which did not authenticate with the upgrade request has
+// to send its auth call.
+static constexpr std::chrono::seconds AuthTimeout{10};
+
+static std::string Notification(const std::string& method, const std::string& params)
+{
+    return R"({"jsonrpc":"2.0","method":")" + method + R"(","params":)" + params + "}";
+}
+
+static std::string Error(const json& id, int code, const std::string& message)
+{
+    return json({
+        {"jsonrpc", "2.0"},
+        {"id", id},
+        {"error", {
+            {"code", code},
+            {"message", message}
+        }}
+    }).dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
+class HttpWebSocket::Connection : public std::enable_shared_from_this<HttpWebSocket::Connection>
+{
+public:
+    explicit Connection(HttpWebSocketOptions& options, std::shared_ptr<porla::HttpContext> upgrade, bool authenticated)
+        : m_options(options)
+        , m_upgrade(std::move(upgrade))
+        , m_ws(m_upgrade->TakeStream())
+        , m_auth_timer(m_ws.get_executor())
+        , m_authenticated(authenticated)
+    {
+    }
+
+    [[nodiscard]] porla::HttpContext& Upgrade() const { return *m_upgrade; }
+    [[nodiscard]] porla::HttpStream& Stream() { return m_ws.next_layer(); }
+
+    void Accept()
+    {
+        namespace websocket = boost::beast::websocket;
+
+        m_ws.set_option(websocket::stream_base::timeout::suggested(boost::beast::role_type::server));
+        m_ws.set_option(websocket::stream_base::decorator(
+            [](websocket::response_type& res)
+            {
+                res.set(boost::beast::http::field::server, "porla/1.0");
+            }));
+
+        if (m_options.deflate)
+        {
+            websocket::permessage_deflate pmd;
+            pmd.server_enable = true;
+            m_ws.set_option(pmd);
+        }
+
+        m_ws.async_accept(
+            m_upgrade->Request(),
+            boost::beast::bind_front_handler(
+                &Connection::EndAccept,
+                shared_from_this()));
+    }
+
+    // Sends a message, and may be called from any thread.
+    void Send(std::string message)
+    {
+        boost::asio::dispatch(
+            m_ws.get_executor(),
+            [self = shared_from_this(), message = std::move(message)]() mutable
+            {
+                if (self->m_closed) return;
+
+                if (self->m_outbox.size() >= self->m_options.max_queued_messages)
+                {
+                    BOOST_LOG_TRIVIAL(warning) << "Closing WebSocket connection which is too far behind";
+                    return self->Close();
+                }
+
+                self->m_outbox.push_back(std::move(message));
+                self->MaybeWrite();
+            });
+    }
+
+    // Called when a call from this connection has been answered.
+    void OnCallDone()
+    {
+        boost::asio::dispatch(
+            m_ws.get_executor(),
+            [self = shared_from_this()]()
+            {
+                bool const paused = self->m_pending_calls-- >= MaxPendingCalls;
+                if (paused) self->BeginRead();
+            });
+    }
+
+private:
+    void EndAccept(boost::beast::error_code ec)
+    {
+        if (ec)
+        {
+            BOOST_LOG_TRIVIAL(debug) << "Failed to accept WebSocket connection: " << ec.message();
+            return Close();
+        }
+
+        if (m_authenticated)
+        {
+            Subscribe();
+        }
+        else
+        {
+            // The pings keep an idle connection open, so one which never
+            // authenticates would hold on to its slot forever.
+            m_auth_timer.expires_after(AuthTimeout);
+            m_auth_timer.async_wait(
+                [self = shared_from_this()](boost::beast::error_code ec)
+                {
+                    if (ec || self->m_authenticated) return;
+
+                    BOOST_LOG_TRIVIAL(debug) << "Closing WebSocket connection which did not authenticate in time";
+                    self->CloseWith(boost::beast::websocket::close_code::policy_error);
+                });
+        }
+
+        BeginRead();
+    }
+
+    void BeginRead()
+    {
+        if (m_closed) return;
+
+        m_ws.async_read(
+            m_buffer,
+            boost::beast::bind_front_handler(
+                &Connection::EndRead,
+                shared_from_this()));
+    }
+
+    void EndRead(boost::beast::error_code ec, std::size_t bytes_transferred)
+    {
+        boost::ignore_unused(bytes_transferred);
+
+        if (ec)
+        {
+            if (ec != boost::beast::websocket::error::closed && ec != boost::asio::error::operation_aborted)
+            {
+                BOOST_LOG_TRIVIAL(debug) << "Error when reading WebSocket message: " << ec.message();
+            }
+
+            return Close();
+        }
+
+        std::string message = boost::beast::buffers_to_string(m_buffer.data());
+        m_buffer.consume(m_buffer.size());
+
+        if (!m_authenticated)
+        {
+            // A client which fails to authenticate is not given another try,
+            // so it cannot hold on to the connection.
+            if (!Authenticate(message))
+            {
+                return CloseWith(boost::beast::websocket::close_code::policy_error);
+            }
+
+            return BeginRead();
+        }
+
+        Call(std::move(message));
+
+        // Stop reading while the client has too many calls in progress, and
+        // continue when one of them is answered.
+        if (m_pending_calls < MaxPendingCalls)
+        {
+            BeginRead();
+        }
+    }
+
+    bool Authenticate(const std::string& message)
+    {
+        json const call = json::parse(message, nullptr, false);
+
+        json const id = call.is_object() && call.contains("id") ? call["id"] : json();
+
+        bool const auth = call.is_object()
+            && call.value("method", "") == "auth"
+            && call.contains("params")
+            && call["params"].is_object()
+            && call["params"].contains("token")
+            && call["params"]["token"].is_string();
+
+        if (!auth || !porla::HttpJwtAuth::Verify(m_options.secret_key, call["params"]["token"].get<std::string>()))
+        {
+            Send(Error(id, -32001, "Unauthorized"));
+            return false;
+        }
+
+        m_authenticated = true;
+        m_auth_timer.cancel();
+
+        Subscribe();
+
+        Send(json({{"jsonrpc", "2.0"}, {"id", id}, {"result", json::object()}}).dump());
+
+        return true;
+    }
+
+    void Call(std::string message);
+
+    void Subscribe()
+    {
+        m_events = m_options.events.OnEvent(
+            [weak = weak_from_this()](const std::string& name, const std::string& data)
+            {
+                if (auto self = weak.lock()) self->Send(Notification(name, data));
+            });
+    }
+
+    // Closes the connection with the code once the queued messages are sent.
+    void CloseWith(boost::beast::websocket::close_code code)
+    {
+        m_close_code = code;
+        MaybeWrite();
+    }
+
+    void MaybeWrite()
+    {
+        if (m_writing || m_closed)
+        {
+            return;
+        }
+
+        if (m_outbox.empty())
+        {
+            if (m_close_code.has_value())
+            {
+                m_writing = true;
+
+                m_ws.async_close(
+                    m_close_code.value(),
+                    [self = shared_from_this()](boost::beast::error_code)
+                    {
+                        self->m_writing = false;
+                        self->Close();
+                    });
+            }
+
+            return;
+        }
+
+        m_writing = true;
+
+        m_ws.text(true);
+        m_ws.async_write(
+            boost::asio::buffer(m_outbox.front()),
+            boost::beast::bind_front_handler(
+                &Connection::EndWrite,
+                shared_from_this()));
+    }
+
+    void EndWrite(boost::beast::error_code ec, std::size_t bytes_transferred)
+    {
+        boost::ignore_unused(bytes_transferred);
+
+        m_writing = false;
+
+        if (ec)
+        {
+            if (ec != boost::asio::error::operation_aborted)
+            {
+                BOOST_LOG_TRIVIAL(debug) << "Error when writing WebSocket message: " << ec.message();
+            }
+
+            return Close();
+        }
+
+        m_outbox.pop_front();
+
+        MaybeWrite();
+    }
+
+    void Close()
+    {
+        if (m_closed) return;
+
+        m_closed = true;
+        m_auth_timer.cancel();
+        m_events.disconnect();
+        m_outbox.clear();
+
+        // Also ends the pending read or write, which releases the connection.
+        m_ws.next_layer().close();
+    }
+
+    HttpWebSocketOptions& m_options;
+    std::shared_ptr<porla::HttpContext> m_upgrade;
+    boost::beast::websocket::stream<porla::HttpStream&> m_ws;
+    boost::asio::steady_timer m_auth_timer;
+    boost::beast::flat_buffer m_buffer;
+    std::deque<std::string> m_outbox;
+    std::optional<boost::beast::websocket::close_code> m_close_code;
+    boost::signals2::scoped_connection m_events;
+    std::size_t m_pending_calls = 0;
+    bool m_authenticated;
+    bool m_closed = false;
+    bool m_writing = false;
+};
+
+// The context of one message with calls, which is passed to the JSON-RPC
+// handler as if it was the body of a POST. Responses are sent as a message
+// instead of being written as HTTP.
+class HttpWebSocket::CallContext : public porla::HttpContext
+{
+public:
+    explicit CallContext(std::shared_ptr<Connection> connection, std::string body)
+        : m_connection(std::move(connection))
+        , m_req(boost::beast::http::verb::post, m_connection->Upgrade().Request().target(), 11)
+    {
+        m_req.keep_alive(true);
+        m_req.body() = std::move(body);
+    }
+
+    ~CallContext()
+    {
+        m_connection->OnCallDone();
+    }
+
+    void Next() override
+    {
+        BOOST_LOG_TRIVIAL(warning) << "No middleware after a WebSocket call";
+    }
+
+    boost::beast::http::request<boost::beast::http::string_body>& Request() override
+    {
+        return m_req;
+    }
+
+    Uri& RequestUri() override
+    {
+        return m_connection->Upgrade().RequestUri();
+    }
+
+    porla::HttpStream& Stream() override
+    {
+        return m_connection->Stream();
+    }
+
+    porla::HttpStream& TakeStream() override
+    {
+        BOOST_LOG_TRIVIAL(warning) << "The stream of a WebSocket connection cannot be taken over";
+        return m_connection->Stream();
+    }
+
+    void Write(std::string body) override
+    {
+        m_connection->Send(std::move(body));
+    }
+
+    void Write(boost::beast::http::response<boost::beast::http::file_body>) override
+    {
+        m_connection->Send(Error(json(), -32603, "Internal error"));
+    }
+
+    void Write(boost::beast::http::response<boost::beast::http::string_body> res) override
+    {
+        // Requests with only notifications are answered with an empty 204.
+        if (res.body().empty()) return;
+        m_connection->Send(std::move(res.body()));
+    }
+
+    void WriteChunked(boost::beast::http::response<boost::beast::http::empty_body>, ChunkProducer producer) override
+    {
+        // A message is sent as a whole, so the chunks are collected first.
+        Collect(m_connection, std::make_shared<std::string>(), std::move(producer));
+    }
+
+    void WriteJson(const nlohmann::json& j) override
+    {
+        m_connection->Send(porla::Utils::Encode(j, porla::Utils::WireEncoding::Json));
+    }
+
+private:
+    static void Collect(
+        std::shared_ptr<Connection> connection,
+        std::shared_ptr<std::string> body,
+        ChunkProducer producer)
+    {
+        producer(
+            [connection, body, producer](std::string chunk, bool more)
+            {
+                *body += chunk;
+
+                if (!more)
+                {
+                    return connection->Send(std::move(*body));
+                }
+
+                // Post instead of calling the producer again to not recurse
+                // on producers which pass their chunks right away.
+                boost::asio::post(
+                    connection->Stream().get_executor(),
+                    [connection, body, producer]() { Collect(connection, body, producer); });
+            });
+    }
+
+    std::shared_ptr<Connection> m_connection;
+    boost::beast::http::request<boost::beast::http::string_body> m_req;
+};
+
+void HttpWebSocket::Connection::Call(std::string message)
+{
+    m_pending_calls++;
+
+    auto ctx = std::make_shared<CallContext>(shared_from_this(), std::move(message));
+
+    boost::asio::post(
+        m_options.session_executor,
+        [&rpc = m_options.rpc, ctx = std::move(ctx)]()
+        {
+            rpc(ctx);
+        });
+}
+
+HttpWebSocket::HttpWebSocket(HttpWebSocketOptions options)
+    : m_options(std::move(options))
+{
+}
+
+void HttpWebSocket::operator()(const std::shared_ptr<porla::HttpContext>& ctx)
+{
+    namespace http = boost::beast::http;
+
+    auto const refuse = [&ctx](http::status status, const std::string& body)
+    {
+        http::response<http::string_body> res{status, ctx->Request().version()};
+        res.set(http::field::server, "porla/1.0");
+        res.set(http::field::content_type, "text/plain");
+        res.keep_alive(false);
+        res.body() = body;
+        res.prepare_payload();
+
+        ctx->Write(std::move(res));
+    };
+
+    if (!boost::beast::websocket::is_upgrade(ctx->Request()))
+    {
+        return refuse(http::status::upgrade_required, "Expected a WebSocket upgrade");
+    }
+
+    // Messages are JSON text only, so a client asking for one of the binary
+    // encodings is told so instead of getting JSON it did not ask for.
+    if (porla::Utils::ResponseEncoding(ctx->Request()) != porla::Utils::WireEncoding::Json)
+    {
+        return refuse(http::status::not_acceptable, "WebSocket messages are only sent as JSON");
+    }
+
+    bool authenticated = false;
+
+    // Clients which can set headers authenticate with the upgrade request, and
+    // the others with an auth call once connected.
+    auto const auth_header = ctx->Request().find(http::field::authorization);
+
+    if (auth_header != ctx->Request().end())
+    {
+        auto const token = porla::HttpJwtAuth::BearerToken(auth_header->value());
+
+        if (!token.has_value() || !porla::HttpJwtAuth::Verify(m_options.secret_key, token.value()))
+        {
+            return refuse(http::status::unauthorized, "Unauthorized");
+        }
+
+        authenticated = true;
+    }
+
+    std::make_shared<Connection>(m_options, ctx, authenticated)->Accept();
+}
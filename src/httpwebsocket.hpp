@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <boost/asio.hpp>
+
+#include "httpcontext.hpp"
+
+namespace porla
+{
+    class HttpEventStream;
+    class JsonRpcHandler;
+
+    struct HttpWebSocketOptions
+    {
+        // Calls are run on this executor, like the ones posted over HTTP.
+        boost::asio::any_io_executor session_executor;
+        HttpEventStream&             events;
+        JsonRpcHandler&              rpc;
+        std::string                  secret_key;
+        // Compress messages when the client offers permessage-deflate.
+        bool                         deflate = false;
+        // Connections which fall this many messages behind are closed.
+        std::size_t                  max_queued_messages = 1024;
+    };
+
+    /*
+     * Serves JSON-RPC calls and the events of the event stream on one
+     * WebSocket connection. The client is authenticated once, either by the
+     * Authorization header of the upgrade request or by an "auth" call with
+     * the token as the first message, since browsers cannot set headers on
+     * WebSocket requests.
+     *
+     * Each text message is handled like the body of a POST to the JSON-RPC
+     * endpoint, and its response is sent back as one message. Calls may be
+     * sent without waiting for the responses, which are matched by their id.
+     * Events are sent as JSON-RPC notifications with the event name as the
+     * method.
+     *
+     * Messages are always JSON text. The CBOR and MessagePack encodings are
+     * only negotiated over HTTP, and an upgrade asking for them is refused.
+     * Clients which authenticate with an auth call must do so within a few
+     * seconds of connecting.
+     */
+    class HttpWebSocket
+    {
+    public:
+        explicit HttpWebSocket(HttpWebSocketOptions options);
+
+        HttpWebSocket(const HttpWebSocket&) = delete;
+        HttpWebSocket& operator=(const HttpWebSocket&) = delete;
+
+        void operator()(const std::shared_ptr<HttpContext>& ctx);
+
+    private:
+        class CallContext;
+        class Connection;
+
+        HttpWebSocketOptions m_options;
+    };
+}
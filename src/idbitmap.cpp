@@ -0,0 +1,266 @@
+#include "idbitmap.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <iterator>
+
+using porla::IdBitmap;
+
+IdBitmap::const_iterator::const_iterator(const IdBitmap* bitmap, std::size_t pos)
+    : m_bitmap(bitmap)
+    , m_pos(pos)
+{
+    SkipEmpty();
+}
+
+std::uint32_t IdBitmap::const_iterator::operator*() const
+{
+    return m_bitmap->m_sparse
+        ? m_bitmap->m_ids[m_pos]
+        : static_cast<std::uint32_t>(m_pos);
+}
+
+IdBitmap::const_iterator& IdBitmap::const_iterator::operator++()
+{
+    m_pos++;
+    SkipEmpty();
+    return *this;
+}
+
+void IdBitmap::const_iterator::SkipEmpty()
+{
+    // Every position in the list of a sparse set is an id.
+    if (m_bitmap->m_sparse) return;
+
+    auto const& words = m_bitmap->m_words;
+    std::size_t const end = words.size() * 64;
+
+    while (m_pos < end)
+    {
+        // Drop the bits below the current position and jump to the next set
+        // bit in the word, or to the start of the next word.
+        std::uint64_t const word = words[m_pos / 64] >> (m_pos % 64);
+
+        if (word != 0)
+        {
+            m_pos += std::countr_zero(word);
+            return;
+        }
+
+        m_pos = (m_pos / 64 + 1) * 64;
+    }
+
+    m_pos = end;
+}
+
+bool IdBitmap::Contains(std::uint32_t id) const
+{
+    if (m_sparse)
+    {
+        return std::binary_search(m_ids.begin(), m_ids.end(), id);
+    }
+
+    std::size_t const word = id / 64;
+    return word < m_words.size() && (m_words[word] >> (id % 64)) & 1;
+}
+
+void IdBitmap::Erase(std::uint32_t id)
+{
+    if (m_sparse)
+    {
+        auto const it = std::lower_bound(m_ids.begin(), m_ids.end(), id);
+        if (it == m_ids.end() || *it != id) return;
+
+        m_ids.erase(it);
+        m_count--;
+
+        return;
+    }
+
+    if (!Contains(id)) return;
+
+    m_words[id / 64] &= ~(std::uint64_t{1} << (id % 64));
+    m_count--;
+}
+
+void IdBitmap::Insert(std::uint32_t id)
+{
+    if (m_sparse)
+    {
+        // Ids are mostly inserted in increasing order, which appends.
+        auto const it = std::lower_bound(m_ids.begin(), m_ids.end(), id);
+        if (it != m_ids.end() && *it == id) return;
+
+        m_ids.insert(it, id);
+        m_count++;
+
+        return MaybeDensify();
+    }
+
+    std::size_t const word = id / 64;
+
+    if (word >= m_words.size())
+    {
+        m_words.resize(word + 1, 0);
+    }
+
+    if (!Contains(id))
+    {
+        m_words[word] |= std::uint64_t{1} << (id % 64);
+        m_count++;
+    }
+}
+
+IdBitmap& IdBitmap::operator&=(const IdBitmap& other)
+{
+    if (m_sparse)
+    {
+        std::erase_if(m_ids, [&other](std::uint32_t id) { return !other.Contains(id); });
+        m_count = m_ids.size();
+
+        return *this;
+    }
+
+    // The intersection is no larger than the sparse set, so keep it as one.
+    if (other.m_sparse)
+    {
+        std::vector<std::uint32_t> ids;
+
+        for (auto const id : other.m_ids)
+        {
+            if (Contains(id)) ids.push_back(id);
+        }
+
+        m_sparse = true;
+        m_ids = std::move(ids);
+        m_words = {};
+        m_count = m_ids.size();
+
+        return *this;
+    }
+
+    if (m_words.size() > other.m_words.size())
+    {
+        m_words.resize(other.m_words.size());
+    }
+
+    for (std::size_t i = 0; i < m_words.size(); i++)
+    {
+        m_words[i] &= other.m_words[i];
+    }
+
+    Recount();
+    return *this;
+}
+
+IdBitmap& IdBitmap::operator|=(const IdBitmap& other)
+{
+    if (other.m_sparse)
+    {
+        if (m_sparse)
+        {
+            std::vector<std::uint32_t> ids;
+            ids.reserve(m_ids.size() + other.m_ids.size());
+
+            std::set_union(
+                m_ids.begin(), m_ids.end(),
+                other.m_ids.begin(), other.m_ids.end(),
+                std::back_inserter(ids));
+
+            m_ids = std::move(ids);
+            m_count = m_ids.size();
+
+            MaybeDensify();
+            return *this;
+        }
+
+        for (auto const id : other.m_ids) Insert(id);
+
+        return *this;
+    }
+
+    if (m_sparse)
+    {
+        auto const ids = std::move(m_ids);
+
+        m_sparse = false;
+        m_ids = {};
+        m_words = other.m_words;
+        m_count = other.m_count;
+
+        for (auto const id : ids) Insert(id);
+
+        return *this;
+    }
+
+    if (m_words.size() < other.m_words.size())
+    {
+        m_words.resize(other.m_words.size(), 0);
+    }
+
+    for (std::size_t i = 0; i < other.m_words.size(); i++)
+    {
+        m_words[i] |= other.m_words[i];
+    }
+
+    Recount();
+    return *this;
+}
+
+IdBitmap& IdBitmap::operator-=(const IdBitmap& other)
+{
+    if (m_sparse)
+    {
+        std::erase_if(m_ids, [&other](std::uint32_t id) { return other.Contains(id); });
+        m_count = m_ids.size();
+
+        return *this;
+    }
+
+    if (other.m_sparse)
+    {
+        for (auto const id : other.m_ids) Erase(id);
+
+        return *this;
+    }
+
+    std::size_t const n = std::min(m_words.size(), other.m_words.size());
+
+    for (std::size_t i = 0; i < n; i++)
+    {
+        m_words[i] &= ~other.m_words[i];
+    }
+
+    Recount();
+    return *this;
+}
+
+void IdBitmap::MaybeDensify()
+{
+    // A list takes 32 bits per id, and words one bit per id up to the
+    // largest, so switch once the list is the larger of the two.
+    if (!m_sparse || m_ids.empty() || m_ids.size() < (m_ids.back() / 64 + 1) * 2)
+    {
+        return;
+    }
+
+    m_words.assign(m_ids.back() / 64 + 1, 0);
+
+    for (auto const id : m_ids)
+    {
+        m_words[id / 64] |= std::uint64_t{1} << (id % 64);
+    }
+
+    m_sparse = false;
+    m_ids = {};
+}
+
+void IdBitmap::Recount()
+{
+    m_count = 0;
+
+    for (auto const word : m_words)
+    {
+        m_count += std::popcount(word);
+    }
+}
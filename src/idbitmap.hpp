@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace porla
+{
+    /*
+     * A set of dense ids stored as one bit per id. Intersections, unions and
+     * differences run a word at a time, which makes combining the registry
+     * indexes cheap compared to hashing every id.
+     *
+     * Sets which are sparse compared to their largest id, such as the ones of
+     * a save path only a few torrents use, are kept as a sorted list of ids
+     * instead, and turned into words once that takes less memory.
+     */
+    class IdBitmap
+    {
+    public:
+        class const_iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef std::uint32_t value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const std::uint32_t* pointer;
+            typedef std::uint32_t reference;
+
+            const_iterator(const IdBitmap* bitmap, std::size_t pos);
+
+            std::uint32_t operator*() const;
+
+            const_iterator& operator++();
+
+            bool operator==(const const_iterator& other) const { return m_pos == other.m_pos; }
+            bool operator!=(const const_iterator& other) const { return m_pos != other.m_pos; }
+
+        private:
+            void SkipEmpty();
+
+            const IdBitmap* m_bitmap;
+            std::size_t m_pos;
+        };
+
+        bool Contains(std::uint32_t id) const;
+        [[nodiscard]] std::size_t Count() const { return m_count; }
+        [[nodiscard]] bool Empty() const { return m_count == 0; }
+        void Erase(std::uint32_t id);
+        void Insert(std::uint32_t id);
+
+        IdBitmap& operator&=(const IdBitmap& other);
+        IdBitmap& operator|=(const IdBitmap& other);
+        IdBitmap& operator-=(const IdBitmap& other);
+
+        [[nodiscard]] const_iterator begin() const { return { this, 0 }; }
+        [[nodiscard]] const_iterator end() const { return { this, m_sparse ? m_ids.size() : m_words.size() * 64 }; }
+
+    private:
+        void MaybeDensify();
+        void Recount();
+
+        // The ids are in m_ids while this is true, and in m_words otherwise.
+        bool m_sparse = true;
+        std::vector<std::uint32_t> m_ids;
+        std::vector<std::uint64_t> m_words;
+        std::size_t m_count = 0;
+    };
+}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include <libtorrent/hex.hpp>
 #include <libtorrent/info_hash.hpp>
@@ -16,11 +20,90 @@ static std::string ToString(const T &hash)
     return ss.str();
 }
 
+namespace porla::Json
+{
+    /*
+     * While a scope is alive on a thread, info hashes are converted to binary
+     * values instead of hex strings. The binary wire encodings send them as
+     * raw bytes this way, from the same to_json definitions as JSON.
+     */
+    class BinaryHashScope
+    {
+    public:
+        explicit BinaryHashScope(bool enabled)
+            : m_prev(Enabled())
+        {
+            Enabled() = enabled;
+        }
+
+        BinaryHashScope(const BinaryHashScope&) = delete;
+        BinaryHashScope& operator=(const BinaryHashScope&) = delete;
+
+        ~BinaryHashScope()
+        {
+            Enabled() = m_prev;
+        }
+
+        static bool& Enabled()
+        {
+            static thread_local bool enabled = false;
+            return enabled;
+        }
+
+    private:
+        bool m_prev;
+    };
+}
+
 namespace libtorrent
 {
+    template<typename T>
+    static json HashToJson(const T& hash)
+    {
+        if (porla::Json::BinaryHashScope::Enabled())
+        {
+            auto const data = reinterpret_cast<const std::uint8_t*>(hash.data());
+            return json::binary(std::vector<std::uint8_t>(data, data + hash.size()));
+        }
+
+        return ToString(hash);
+    }
+
+    // Takes a hash from raw bytes, which must be exactly the size of the hash.
+    template<typename T>
+    static T HashFromBinary(const json& j)
+    {
+        if (!j.is_binary() || j.get_binary().size() != T::size())
+        {
+            throw json::type_error::create(
+                302,
+                "info hash must be binary of " + std::to_string(T::size()) + " bytes",
+                &j);
+        }
+
+        T hash;
+        std::copy(j.get_binary().begin(), j.get_binary().end(), hash.data());
+        return hash;
+    }
+
     static void from_json(const json& j, libtorrent::info_hash_t& ih)
     {
-        if (j.is_string() && j.get<std::string>().size() == 40)
+        // The binary encodings send a bare hash, or a pair of the v1 and v2
+        // hashes where either one may be null.
+        if (j.is_binary())
+        {
+            ih = j.get_binary().size() == lt::sha256_hash::size()
+                ? lt::info_hash_t(HashFromBinary<lt::sha256_hash>(j))
+                : lt::info_hash_t(HashFromBinary<lt::sha1_hash>(j));
+        }
+        else if (j.is_array() && j.size() == 2 && (j[0].is_binary() || j[1].is_binary()))
+        {
+            lt::info_hash_t hash;
+            if (!j[0].is_null()) hash.v1 = HashFromBinary<lt::sha1_hash>(j[0]);
+            if (!j[1].is_null()) hash.v2 = HashFromBinary<lt::sha256_hash>(j[1]);
+            ih = hash;
+        }
+        else if (j.is_string() && j.get<std::string>().size() == 40)
         {
             lt::sha1_hash h;
             lt::aux::from_hex({j.get<std::string>().c_str(),40}, h.data());
@@ -40,7 +123,7 @@ namespace libtorrent
     static void to_json(json& j, const libtorrent::info_hash_t& ih)
     {
         j = json::array();
-        j.push_back(ih.has_v1() ? json(ToString(ih.v1)) : nullptr);
-        j.push_back(ih.has_v2() ? json(ToString(ih.v2)) : nullptr);
+        j.push_back(ih.has_v1() ? HashToJson(ih.v1) : nullptr);
+        j.push_back(ih.has_v2() ? HashToJson(ih.v2) : nullptr);
     }
 }
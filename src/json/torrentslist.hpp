@@ -11,17 +11,14 @@ namespace porla::Methods
 {
     NLOHMANN_JSONIFY_ALL_THINGS(
         TorrentsListReq,
+        cursor,
         filters,
         include_metadata,
         order_by,
         order_by_dir,
         page,
-        page_size);
-
-    NLOHMANN_JSONIFY_ALL_THINGS(
-        TorrentsListReqFilter,
-        field,
-        args);
+        page_size,
+        since);
 
     NLOHMANN_JSONIFY_ALL_THINGS(
         TorrentsListRes::Item,
@@ -53,8 +50,11 @@ namespace porla::Methods
 
     NLOHMANN_JSONIFY_ALL_THINGS(
         TorrentsListRes,
+        cursor,
         page,
         page_size,
+        removed,
         torrents,
-        torrents_total);
+        torrents_total,
+        version);
 }
@@ -2,21 +2,20 @@
 
 #include <nlohmann/json.hpp>
 
+#include "utils.hpp"
 #include "../methods/torrentsquery_reqres.hpp"
 
-using json = nlohmann::json;
-
 namespace porla::Methods
 {
-    static void from_json(const json& j, porla::Methods::TorrentsQueryReq& req)
-    {
-        j.at("query").get_to(req.query);
-    }
+    NLOHMANN_JSONIFY_ALL_THINGS(
+        TorrentsQueryReq,
+        query,
+        params,
+        cursor,
+        limit);
 
-    static void to_json(json& j, const porla::Methods::TorrentsQueryRes& res)
-    {
-        j = json{
-            {"results", res.results}
-        };
-    }
+    NLOHMANN_JSONIFY_ALL_THINGS(
+        TorrentsQueryRes,
+        results,
+        cursor);
 }
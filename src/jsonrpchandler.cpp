@@ -1,16 +1,394 @@
 #include "jsonrpchandler.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <utility>
 
 #include <boost/log/trivial.hpp>
 
+#include "utils/wireencoding.hpp"
+
 using json = nlohmann::json;
 using porla::JsonRpcHandler;
 
-JsonRpcHandler::JsonRpcHandler(
-    std::map<std::string, std::function<void(const nlohmann::json&, std::shared_ptr<porla::HttpContext>)>> methods)
-    : m_methods(std::move(methods))
+static void WriteError(
+    const std::shared_ptr<porla::HttpContext>& ctx,
+    const std::optional<json>& id,
+    int code,
+    const std::string& message,
+    const std::optional<std::string>& data = std::nullopt)
+{
+    // Notifications are not answered, not even with errors.
+    if (!id.has_value()) return;
+
+    json error = {
+        {"code", code},
+        {"message", message}
+    };
+
+    if (data.has_value()) error["data"] = data.value();
+
+    ctx->WriteJson({
+        {"jsonrpc", "2.0"},
+        {"id", id.value()},
+        {"error", error}
+    });
+}
+
+// Only a well-formed call without an id is a notification. A malformed one is
+// answered with an error, which needs somewhere to go.
+static bool IsNotification(const json& call)
 {
+    if (!call.is_object() || call.contains("id")) return false;
+
+    auto const method = call.find("method");
+    return method != call.end() && method->is_string();
+}
+
+static void WriteNoContent(const std::shared_ptr<porla::HttpContext>& ctx)
+{
+    namespace http = boost::beast::http;
+
+    http::response<http::string_body> res{http::status::no_content, ctx->Request().version()};
+    res.set(http::field::server, "porla/1.0");
+    res.keep_alive(ctx->Request().keep_alive());
+    res.prepare_payload();
+
+    ctx->Write(std::move(res));
+}
+
+// Collects the responses of the calls in a batch, and writes them as one array
+// when the last call has been answered. Calls may complete on any thread.
+// Responses are kept as JSON text, or as values for the binary encodings.
+class JsonRpcHandler::Batch
+{
+public:
+    explicit Batch(std::shared_ptr<porla::HttpContext> ctx, std::size_t size)
+        : m_ctx(std::move(ctx))
+        , m_encoding(porla::Utils::ResponseEncoding(m_ctx->Request()))
+        , m_done(size, false)
+        , m_pending(size)
+    {
+        if (m_encoding == porla::Utils::WireEncoding::Json) m_texts.resize(size);
+        else m_values.resize(size);
+    }
+
+    [[nodiscard]] const std::shared_ptr<porla::HttpContext>& Context() const { return m_ctx; }
+
+    // Completes the slot with a response body in the given encoding, which
+    // is converted if it is not the encoding of the batch.
+    void CompleteText(std::size_t slot, std::string text, porla::Utils::WireEncoding encoding)
+    {
+        if (encoding == m_encoding && m_encoding == porla::Utils::WireEncoding::Json)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!Claim(slot)) return;
+
+            m_texts[slot] = std::move(text);
+
+            return MaybeWrite(lock);
+        }
+
+        json value;
+
+        try
+        {
+            value = porla::Utils::Decode(text, encoding);
+        }
+        catch (const json::exception& ex)
+        {
+            BOOST_LOG_TRIVIAL(warning) << "Invalid response to JSONRPC call in batch: " << ex.what();
+            value = InternalError();
+        }
+
+        CompleteValue(slot, value);
+    }
+
+    void CompleteValue(std::size_t slot, const json& value)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!Claim(slot)) return;
+
+        if (m_encoding == porla::Utils::WireEncoding::Json) m_texts[slot] = porla::Utils::Encode(value, m_encoding);
+        else m_values[slot] = value;
+
+        MaybeWrite(lock);
+    }
+
+    static json InternalError()
+    {
+        return {
+            {"jsonrpc", "2.0"},
+            {"id", nullptr},
+            {"error", {
+                {"code", -32603},
+                {"message", "Internal error"}
+            }}
+        };
+    }
+
+private:
+    bool Claim(std::size_t slot)
+    {
+        if (m_done[slot])
+        {
+            BOOST_LOG_TRIVIAL(warning) << "JSONRPC call in batch answered more than once";
+            return false;
+        }
+
+        m_done[slot] = true;
+        return true;
+    }
+
+    void MaybeWrite(std::unique_lock<std::mutex>& lock)
+    {
+        if (--m_pending > 0) return;
+
+        lock.unlock();
+
+        namespace http = boost::beast::http;
+
+        std::string body;
+
+        if (m_encoding == porla::Utils::WireEncoding::Json)
+        {
+            body = "[";
+
+            for (std::size_t i = 0; i < m_texts.size(); i++)
+            {
+                if (i > 0) body.push_back(',');
+                body += m_texts[i];
+            }
+
+            body.push_back(']');
+        }
+        else
+        {
+            body = porla::Utils::Encode(json(std::move(m_values)), m_encoding);
+        }
+
+        http::response<http::string_body> res{http::status::ok, m_ctx->Request().version()};
+        res.set(http::field::server, "porla/1.0");
+        res.set(http::field::content_type, porla::Utils::ContentType(m_encoding));
+        res.keep_alive(m_ctx->Request().keep_alive());
+        res.body() = std::move(body);
+        res.prepare_payload();
+
+        m_ctx->Write(std::move(res));
+    }
+
+    std::shared_ptr<porla::HttpContext> m_ctx;
+    porla::Utils::WireEncoding m_encoding;
+    std::mutex m_mutex;
+    std::vector<bool> m_done;
+    std::vector<std::string> m_texts;
+    std::vector<json> m_values;
+    std::size_t m_pending;
+};
+
+// The context a call in a batch writes its response to. It puts the response
+// in the call's slot in the batch instead of writing it to the connection.
+class JsonRpcHandler::BatchContext : public porla::HttpContext
+{
+public:
+    explicit BatchContext(std::shared_ptr<Batch> batch, std::size_t slot)
+        : m_batch(std::move(batch))
+        , m_slot(slot)
+    {
+    }
+
+    void Next() override
+    {
+        m_batch->Context()->Next();
+    }
+
+    boost::beast::http::request<boost::beast::http::string_body>& Request() override
+    {
+        return m_batch->Context()->Request();
+    }
+
+    Uri& RequestUri() override
+    {
+        return m_batch->Context()->RequestUri();
+    }
+
+    porla::HttpStream& Stream() override
+    {
+        return m_batch->Context()->Stream();
+    }
+
+    porla::HttpStream& TakeStream() override
+    {
+        return m_batch->Context()->TakeStream();
+    }
+
+    void Write(std::string body) override
+    {
+        m_batch->CompleteText(m_slot, std::move(body), porla::Utils::WireEncoding::Json);
+    }
+
+    void Write(boost::beast::http::response<boost::beast::http::file_body>) override
+    {
+        m_batch->CompleteValue(m_slot, Batch::InternalError());
+    }
+
+    void Write(boost::beast::http::response<boost::beast::http::string_body> res) override
+    {
+        auto const encoding = porla::Utils::BodyEncoding(res[boost::beast::http::field::content_type]);
+        m_batch->CompleteText(m_slot, std::move(res.body()), encoding);
+    }
+
+    void WriteChunked(boost::beast::http::response<boost::beast::http::empty_body>, ChunkProducer producer) override
+    {
+        // The batch response is written as a whole, so the chunks are
+        // collected into the slot.
+        Collect(m_batch, m_slot, std::make_shared<std::string>(), std::move(producer));
+    }
+
+    void WriteJson(const nlohmann::json& j) override
+    {
+        m_batch->CompleteValue(m_slot, j);
+    }
+
+private:
+    static void Collect(
+        std::shared_ptr<Batch> batch,
+        std::size_t slot,
+        std::shared_ptr<std::string> body,
+        ChunkProducer producer)
+    {
+        producer(
+            [batch, slot, body, producer](std::string chunk, bool more)
+            {
+                *body += chunk;
+
+                if (!more)
+                {
+                    return batch->CompleteText(slot, std::move(*body), porla::Utils::WireEncoding::Json);
+                }
+
+                // Post instead of calling the producer again to not recurse
+                // on producers which pass their chunks right away.
+                boost::asio::post(
+                    batch->Context()->Stream().get_executor(),
+                    [batch, slot, body, producer]() { Collect(batch, slot, body, producer); });
+            });
+    }
+
+    std::shared_ptr<Batch> m_batch;
+    std::size_t m_slot;
+};
+
+// Wraps the context of a call to record its metrics when it is answered.
+class JsonRpcHandler::CallContext : public porla::HttpContext
+{
+public:
+    explicit CallContext(
+        std::shared_ptr<porla::HttpContext> ctx,
+        std::shared_ptr<RequestMetrics::Series> metrics,
+        std::chrono::steady_clock::time_point start)
+        : m_ctx(std::move(ctx))
+        , m_metrics(std::move(metrics))
+        , m_start(start)
+    {
+    }
+
+    ~CallContext()
+    {
+        // A call which never answered still leaves the in-flight count.
+        Record(-32603);
+    }
+
+    void Next() override
+    {
+        m_ctx->Next();
+    }
+
+    boost::beast::http::request<boost::beast::http::string_body>& Request() override
+    {
+        return m_ctx->Request();
+    }
+
+    Uri& RequestUri() override
+    {
+        return m_ctx->RequestUri();
+    }
+
+    porla::HttpStream& Stream() override
+    {
+        return m_ctx->Stream();
+    }
+
+    porla::HttpStream& TakeStream() override
+    {
+        return m_ctx->TakeStream();
+    }
+
+    void Write(std::string body) override
+    {
+        Record(0);
+        m_ctx->Write(std::move(body));
+    }
+
+    void Write(boost::beast::http::response<boost::beast::http::file_body> res) override
+    {
+        Record(0);
+        m_ctx->Write(std::move(res));
+    }
+
+    void Write(boost::beast::http::response<boost::beast::http::string_body> res) override
+    {
+        // Calls shed with 503 are counted with the HTTP status.
+        Record(res.result_int() >= 400 ? static_cast<int>(res.result_int()) : 0);
+        m_ctx->Write(std::move(res));
+    }
+
+    void WriteChunked(boost::beast::http::response<boost::beast::http::empty_body> res, ChunkProducer producer) override
+    {
+        // Measured to the first chunk, as the rest is paced by the client.
+        Record(0);
+        m_ctx->WriteChunked(std::move(res), std::move(producer));
+    }
+
+    void WriteJson(const nlohmann::json& j) override
+    {
+        auto const error = j.find("error");
+
+        Record(error != j.end() && error->is_object() && error->contains("code") && (*error)["code"].is_number_integer()
+            ? (*error)["code"].get<int>()
+            : 0);
+
+        m_ctx->WriteJson(j);
+    }
+
+private:
+    void Record(int error)
+    {
+        if (m_recorded.exchange(true)) return;
+        m_metrics->End(std::chrono::steady_clock::now() - m_start, error);
+    }
+
+    std::shared_ptr<porla::HttpContext> m_ctx;
+    std::shared_ptr<RequestMetrics::Series> m_metrics;
+    std::chrono::steady_clock::time_point m_start;
+    std::atomic_bool m_recorded{false};
+};
+
+static std::vector<std::string> Names(const std::map<std::string, porla::JsonRpcMethod>& methods)
+{
+    std::vector<std::string> names;
+    for (auto const& [name, _] : methods) names.push_back(name);
+    return names;
+}
+
+JsonRpcHandler::JsonRpcHandler(std::map<std::string, JsonRpcMethod> methods)
+    : m_metrics(Names(methods))
+{
+    for (auto& [name, method] : methods)
+    {
+        m_methods.insert({ name, Method{ .method = std::move(method), .metrics = m_metrics.Get(name) } });
+    }
 }
 
 void JsonRpcHandler::operator()(const std::shared_ptr<porla::HttpContext> &ctx)
@@ -19,50 +397,106 @@ void JsonRpcHandler::operator()(const std::shared_ptr<porla::HttpContext> &ctx)
 
     try
     {
-        req = json::parse(ctx->Request().body());
+        // Bodies in CBOR or MessagePack are decoded to the same json value.
+        req = porla::Utils::Decode(ctx->Request().body(), porla::Utils::RequestEncoding(ctx->Request()));
     }
     catch (const std::exception& ex)
     {
         BOOST_LOG_TRIVIAL(warning) << "Failed to parse JSONRPC request: " << ex.what();
+        return WriteError(ctx, json(), -32700, "Parse error", ex.what());
+    }
 
-        return ctx->WriteJson({
-            {"error", {
-                {"code", -32700},
-                {"message", "Parse error"},
-                {"data", ex.what()}
-            }}
-        });
+    if (!req.is_array())
+    {
+        Invoke(req, ctx);
+
+        if (IsNotification(req)) WriteNoContent(ctx);
+
+        return;
+    }
+
+    if (req.empty())
+    {
+        return WriteError(ctx, json(), -32600, "Invalid Request");
     }
 
-    std::string method = req.at("method").get<std::string>();
+    // Every call except the notifications gets a slot in the batch response.
+    std::vector<std::optional<std::size_t>> slots;
+    std::size_t size = 0;
 
-    if (m_methods.find(method) == m_methods.end())
+    for (auto const& call : req)
     {
-        BOOST_LOG_TRIVIAL(warning) << "Failed to find JSONRPC method '" << method << "'";
+        slots.push_back(IsNotification(call) ? std::nullopt : std::optional(size++));
+    }
 
-        return ctx->WriteJson({
-            {"error", {
-                {"code", -32601},
-                {"message", "Method not found"}
-            }}
-        });
+    auto const batch = size > 0
+        ? std::make_shared<Batch>(ctx, size)
+        : nullptr;
+
+    for (std::size_t i = 0; i < req.size(); i++)
+    {
+        if (slots[i].has_value())
+        {
+            Invoke(req[i], std::make_shared<BatchContext>(batch, slots[i].value()));
+        }
+        else
+        {
+            Invoke(req[i], ctx);
+        }
     }
 
+    if (batch == nullptr)
+    {
+        WriteNoContent(ctx);
+    }
+}
+
+void JsonRpcHandler::Invoke(json& call, const std::shared_ptr<porla::HttpContext>& ctx)
+{
+    if (!call.is_object() || !call.contains("method") || !call["method"].is_string())
+    {
+        return WriteError(ctx, call.is_object() && call.contains("id") ? call["id"] : json(), -32600, "Invalid Request");
+    }
+
+    std::optional<json> const id = call.contains("id") ? std::optional(call["id"]) : std::nullopt;
+    auto const& method = call["method"].get_ref<const std::string&>();
+    auto const handler = m_methods.find(method);
+
+    if (handler == m_methods.end())
+    {
+        BOOST_LOG_TRIVIAL(warning) << "Failed to find JSONRPC method '" << method << "'";
+        return WriteError(ctx, id, -32601, "Method not found");
+    }
+
+    auto const& metrics = handler->second.metrics;
+    auto const start = std::chrono::steady_clock::now();
+
+    metrics->Begin();
+
+    // Calls are measured until their response is written, and notifications
+    // until the method returns since they have no response.
+    auto const call_ctx = id.has_value()
+        ? std::make_shared<CallContext>(ctx, metrics, start)
+        : ctx;
+
     try
     {
         BOOST_LOG_TRIVIAL(debug) << "Executing JSONRPC method '" << method << "'";
-        m_methods.at(method)(req.at("params"), ctx);
+
+        // The params are moved out instead of copied, since the call is not
+        // used after this. Filters and the like make them the largest part of
+        // the call.
+        auto const params = call.contains("params") ? std::move(call["params"]) : json::object();
+        handler->second.method(params, id, call_ctx);
     }
     catch (const std::exception& ex)
     {
         BOOST_LOG_TRIVIAL(error) << "Error when executing JSONRPC method '" << method << "': " << ex.what();
+        WriteError(call_ctx, id, -32603, "Internal error", ex.what());
+    }
 
-        ctx->WriteJson({
-            {"error", {
-                {"code", -32603},
-                {"message", "Internal error"},
-                {"data", ex.what()}
-            }}
-        });
+    if (!id.has_value())
+    {
+        metrics->End(std::chrono::steady_clock::now() - start, 0);
     }
 }
@@ -1,19 +1,36 @@
 #pragma once
 
+#include <functional>
 #include <map>
 #include <memory>
+#include <optional>
 
 #include <nlohmann/json.hpp>
 
 #include "httpcontext.hpp"
+#include "requestmetrics.hpp"
 
 namespace porla
 {
+    typedef std::function<void(
+        const nlohmann::json& params,
+        const std::optional<nlohmann::json>& id,
+        std::shared_ptr<porla::HttpContext> ctx)> JsonRpcMethod;
+
+    /*
+     * Serves JSON-RPC 2.0 calls. The body is either a single call or a batch
+     * of them in an array, which are invoked in order and answered with one
+     * array of their responses once they have all completed. Calls without an
+     * id are notifications and are not answered, and a request with only
+     * notifications gets an empty 204 response.
+     *
+     * The latency, errors and in-flight count of each method are recorded in
+     * the metrics of the handler.
+     */
     class JsonRpcHandler
     {
     public:
-        explicit JsonRpcHandler(
-            std::map<std::string, std::function<void(const nlohmann::json&, std::shared_ptr<porla::HttpContext>)>> methods);
+        explicit JsonRpcHandler(std::map<std::string, JsonRpcMethod> methods);
 
         JsonRpcHandler(const JsonRpcHandler&) = delete;
         JsonRpcHandler& operator=(const JsonRpcHandler&) = delete;
@@ -21,7 +38,23 @@ namespace porla
 
         void operator()(const std::shared_ptr<porla::HttpContext>& ctx);
 
+        [[nodiscard]] const RequestMetrics& Metrics() const { return m_metrics; }
+
     private:
-        std::map<std::string, std::function<void(const nlohmann::json&, std::shared_ptr<porla::HttpContext>)>> m_methods;
+        class Batch;
+        class BatchContext;
+        class CallContext;
+
+        struct Method
+        {
+            JsonRpcMethod method;
+            std::shared_ptr<RequestMetrics::Series> metrics;
+        };
+
+        // Moves the params out of the call.
+        void Invoke(nlohmann::json& call, const std::shared_ptr<porla::HttpContext>& ctx);
+
+        RequestMetrics m_metrics;
+        std::map<std::string, Method> m_methods;
     };
 }
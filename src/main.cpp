@@ -1,3 +1,5 @@
+#include <thread>
+
 #include <boost/asio.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/trivial.hpp>
@@ -13,20 +15,28 @@
 #include "authloginhandler.hpp"
 #include "cmdargs.hpp"
 #include "config.hpp"
+#include "data/metadatacache.hpp"
+#include "data/resumedataqueue.hpp"
 #include "embeddedwebuihandler.hpp"
 #include "httpeventstream.hpp"
 #include "httpjwtauth.hpp"
+#include "httprouter.hpp"
 #include "httpserver.hpp"
+#include "httpwebsocket.hpp"
 #include "jsonrpchandler.hpp"
 #include "logger.hpp"
 #include "metricshandler.hpp"
+#include "queuelatencyprobe.hpp"
+#include "requestmetrics.hpp"
 #include "session.hpp"
 #include "systemhandler.hpp"
 #include "tools/authtoken.hpp"
 #include "tools/generatesecretkey.hpp"
 #include "tools/versionjson.hpp"
 #include "utils/secretkey.hpp"
+#include "utils/thread.hpp"
 #include "webhookclient.hpp"
+#include "workerpool.hpp"
 
 #include "methods/presetslist.hpp"
 #include "methods/sessionpause.hpp"
@@ -86,22 +96,40 @@ int main(int argc, char* argv[])
         return subcommands.at(argv[1])(argc, argv, std::move(cfg));
     }
 
+    // The session, and everything that touches it, runs on the main thread
+    // using the io context. HTTP connections are served by a pool of threads
+    // running the http_io context, and handlers which need the session are
+    // dispatched to the main thread.
+    boost::asio::io_context http_io;
     boost::asio::io_context io;
     boost::asio::signal_set signals(io, SIGINT, SIGTERM);
 
     signals.async_wait(
-        [&io](boost::system::error_code const& ec, int signal)
+        [&io, &http_io](boost::system::error_code const& ec, int signal)
         {
             BOOST_LOG_TRIVIAL(info) << "Interrupt received (" << signal << ") - stopping...";
+            http_io.stop();
             io.stop();
         });
 
     {
+        porla::Data::ResumeDataQueue resume_data_queue(io, porla::Data::ResumeDataQueueOptions{
+            .db             = cfg->db,
+            .flush_interval = cfg->timer_resume_data_flush.value_or(5000)
+        });
+
+        porla::Data::MetadataCache metadata(cfg->db);
+
         porla::Session session(io, porla::SessionOptions{
             .db                    = cfg->db,
+            .metadata              = metadata,
+            .resume_data_queue     = resume_data_queue,
             .extensions            = cfg->session_extensions,
             .settings              = cfg->session_settings,
             .session_params_file   = cfg->state_dir.value_or(fs::current_path()) / "session.dat",
+            .query_max_steps       = cfg->query_max_steps.value_or(10000000),
+            .query_timeout         = cfg->query_timeout.value_or(5000),
+            .shutdown_timeout      = cfg->shutdown_timeout.value_or(30000),
             .timer_dht_stats       = cfg->timer_dht_stats.value_or(5000),
             .timer_session_stats   = cfg->timer_session_stats.value_or(5000),
             .timer_torrent_updates = cfg->timer_torrent_updates.value_or(1000)
@@ -118,11 +146,11 @@ int main(int argc, char* argv[])
         }
 
         porla::Actions::Executor actions_executor{porla::Actions::ExecutorOptions{
-            .db      = cfg->db,
-            .io      = io,
-            .presets = cfg->presets,
-            .session = session,
-            .actions = {
+            .metadata = metadata,
+            .io       = io,
+            .presets  = cfg->presets,
+            .session  = session,
+            .actions  = {
                 {"log",                 std::make_shared<porla::Actions::Log>(session)},
                 {"sleep",               std::make_shared<porla::Actions::Sleep>(io)},
                 {"torrents.reannounce", std::make_shared<porla::Actions::ForceReannounce>(session)},
@@ -135,6 +163,12 @@ int main(int argc, char* argv[])
             .webhooks = cfg->webhooks
         });
 
+        // Heavy RPC calls are run here instead of on the session thread.
+        porla::WorkerPool workers(porla::WorkerPoolOptions{
+            .threads     = static_cast<std::size_t>(std::max(cfg->rpc_workers.value_or(2), 1)),
+            .queue_limit = static_cast<std::size_t>(std::max(cfg->rpc_queue_limit.value_or(64), 1))
+        });
+
         porla::JsonRpcHandler rpc({
             {"presets.list", porla::Methods::PresetsList(cfg->presets)},
             {"session.pause", porla::Methods::SessionPause(session)},
@@ -143,9 +177,9 @@ int main(int argc, char* argv[])
             {"session.settings.update", porla::Methods::SessionSettingsUpdate(session, cfg->db)},
             {"sys.versions", porla::Methods::SysVersions()},
             {"torrents.add", porla::Methods::TorrentsAdd(cfg->db, session, cfg->presets)},
-            {"torrents.files.list", porla::Methods::TorrentsFilesList(session)},
-            {"torrents.list", porla::Methods::TorrentsList(cfg->db, session)},
-            {"torrents.metadata.list", porla::Methods::TorrentsMetadataList(cfg->db, session)},
+            {"torrents.files.list", porla::Methods::TorrentsFilesList(io, workers, session)},
+            {"torrents.list", porla::Methods::TorrentsList(io, workers, metadata, session)},
+            {"torrents.metadata.list", porla::Methods::TorrentsMetadataList(metadata, session)},
             {"torrents.move", porla::Methods::TorrentsMove(session)},
             {"torrents.pause", porla::Methods::TorrentsPause(session)},
             {"torrents.peers.add", porla::Methods::TorrentsPeersAdd(session)},
@@ -159,13 +193,94 @@ int main(int argc, char* argv[])
             {"torrents.trackers.list", porla::Methods::TorrentsTrackersList(session)}
         });
 
-        porla::HttpServer http(io, porla::HttpServerOptions{
-            .host = cfg->http_host.value_or("127.0.0.1"),
-            .port = cfg->http_port.value_or(1337)
+        std::string http_base_path = cfg->http_base_path.value_or("/");
+        if (http_base_path.empty())        http_base_path = "/";
+        if (http_base_path[0] != '/')      http_base_path = "/" + http_base_path;
+        if (http_base_path.ends_with("/")) http_base_path = http_base_path.substr(0, http_base_path.size() - 1);
+
+        // Requests to the web UI and unknown paths are counted as "other".
+        porla::RequestMetrics http_requests({
+            http_base_path + "/api/v1/auth/init",
+            http_base_path + "/api/v1/auth/login",
+            http_base_path + "/api/v1/events",
+            http_base_path + "/api/v1/jsonrpc",
+            http_base_path + "/api/v1/system",
+            http_base_path + "/api/v1/ws",
+            http_base_path + "/metrics"
+        });
+
+        std::size_t const http_acceptors = static_cast<std::size_t>(std::max(cfg->http_acceptors.value_or(1), 1));
+        int const http_unix_socket_mode = cfg->http_unix_socket_mode.value_or(0600);
+
+        std::vector<porla::HttpListener> http_listeners;
+
+        // A list of listeners replaces the host, port and Unix socket, so the
+        // server can listen on only Unix sockets, or on several addresses.
+        if (cfg->http_listeners.has_value())
+        {
+            for (auto const& spec : cfg->http_listeners.value())
+            {
+                auto listener = porla::HttpListener::Parse(spec);
+
+                if (!listener.has_value())
+                {
+                    BOOST_LOG_TRIVIAL(error) << "Invalid HTTP listener '" << spec << "' - expected host:port or unix:/path";
+                    continue;
+                }
+
+                listener->acceptors = http_acceptors;
+                listener->mode      = http_unix_socket_mode;
+
+                http_listeners.push_back(std::move(listener.value()));
+            }
+        }
+        else
+        {
+            http_listeners.push_back(porla::HttpListener{
+                .host      = cfg->http_host.value_or("127.0.0.1"),
+                .port      = cfg->http_port.value_or(1337),
+                .acceptors = http_acceptors
+            });
+
+            if (cfg->http_unix_socket.has_value())
+            {
+                http_listeners.push_back(porla::HttpListener{
+                    .path = cfg->http_unix_socket.value(),
+                    .mode = http_unix_socket_mode
+                });
+            }
+        }
+
+        porla::HttpServer http(http_io, porla::HttpServerOptions{
+            .listeners       = std::move(http_listeners),
+            .metrics         = &http_requests,
+            .max_connections = static_cast<std::size_t>(std::max(cfg->http_max_connections.value_or(1024), 1)),
+            .pipeline_depth  = static_cast<std::size_t>(std::max(cfg->http_pipeline_depth.value_or(8), 1)),
+            .idle_timeout    = std::chrono::milliseconds(std::max(cfg->http_idle_timeout.value_or(30000), 1)),
+            .request_timeout = std::chrono::milliseconds(std::max(cfg->http_request_timeout.value_or(30000), 1))
         });
 
+        porla::QueueLatencyProbe http_latency(http_io);
+        porla::QueueLatencyProbe session_latency(io);
+
         porla::HttpEventStream eventStream(session);
-        porla::MetricsHandler metrics(session);
+        porla::MetricsHandler metrics(porla::MetricsHandlerOptions{
+            .http_latency      = http_latency,
+            .http_requests     = http_requests,
+            .resume_data_queue = resume_data_queue,
+            .rpc_requests      = rpc.Metrics(),
+            .session           = session,
+            .session_latency   = session_latency,
+            .workers           = workers
+        });
+
+        porla::HttpWebSocket webSocket(porla::HttpWebSocketOptions{
+            .session_executor = io.get_executor(),
+            .events           = eventStream,
+            .rpc              = rpc,
+            .secret_key       = cfg->secret_key,
+            .deflate          = cfg->http_websocket_deflate.value_or(false)
+        });
 
         porla::AuthInitHandler authInitHandler(io, cfg->db);
         porla::AuthLoginHandler authLoginHandler(io, porla::AuthLoginHandlerOptions{
@@ -173,35 +288,38 @@ int main(int argc, char* argv[])
             .secret_key = cfg->secret_key
         });
 
-        std::string http_base_path = cfg->http_base_path.value_or("/");
-        if (http_base_path.empty())        http_base_path = "/";
-        if (http_base_path[0] != '/')      http_base_path = "/" + http_base_path;
-        if (http_base_path.ends_with("/")) http_base_path = http_base_path.substr(0, http_base_path.size() - 1);
+        auto const session_executor = io.get_executor();
 
-        http.Use(porla::HttpPost(http_base_path + "/api/v1/auth/init",  [&authInitHandler](auto const& ctx) { authInitHandler(ctx); }));
-        http.Use(porla::HttpPost(http_base_path + "/api/v1/auth/login", [&authLoginHandler](auto const& ctx) { authLoginHandler(ctx); }));
-        http.Use(porla::HttpGet(http_base_path +  "/api/v1/system",     porla::SystemHandler(cfg->db)));
+        porla::HttpRouter router;
 
-        http.Use(
-            porla::HttpPost(
-                http_base_path + "/api/v1/jsonrpc",
-                porla::HttpJwtAuth(
-                    cfg->secret_key,
-                    [&rpc](auto const& ctx) { rpc(ctx); })));
+        router.Post(http_base_path + "/api/v1/auth/init",  porla::HttpDispatch(session_executor, [&authInitHandler](auto const& ctx) { authInitHandler(ctx); }));
+        router.Post(http_base_path + "/api/v1/auth/login", porla::HttpDispatch(session_executor, [&authLoginHandler](auto const& ctx) { authLoginHandler(ctx); }));
+        router.Get(http_base_path +  "/api/v1/system",     porla::HttpDispatch(session_executor, porla::SystemHandler(cfg->db, session)));
 
-        http.Use(
-            porla::HttpGet(
-                http_base_path + "/api/v1/events",
-                porla::HttpJwtAuth(
-                    cfg->secret_key,
-                    [&eventStream](auto const& ctx) { eventStream(ctx); })));
+        router.Post(
+            http_base_path + "/api/v1/jsonrpc",
+            porla::HttpJwtAuth(
+                cfg->secret_key,
+                porla::HttpDispatch(session_executor, [&rpc](auto const& ctx) { rpc(ctx); })));
+
+        router.Get(
+            http_base_path + "/api/v1/events",
+            porla::HttpJwtAuth(
+                cfg->secret_key,
+                porla::HttpDispatch(session_executor, [&eventStream](auto const& ctx) { eventStream(ctx); })));
+
+        // Runs on the connection's thread, which it takes over. The calls on it
+        // are posted to the session thread by the handler.
+        router.Get(http_base_path + "/api/v1/ws", [&webSocket](auto const& ctx) { webSocket(ctx); });
 
         if (cfg->http_metrics_enabled.value_or(true))
         {
             BOOST_LOG_TRIVIAL(info) << "Enabling HTTP metrics endpoint";
-            http.Use(porla::HttpGet(http_base_path + "/metrics", [&metrics](auto const &ctx) { metrics(ctx); }));
+            router.Get(http_base_path + "/metrics", porla::HttpDispatch(session_executor, [&metrics](auto const &ctx) { metrics(ctx); }));
         }
 
+        http.Use(router);
+
         if (cfg->http_webui_enabled.value_or(true))
         {
             BOOST_LOG_TRIVIAL(info) << "Enabling HTTP web UI";
@@ -210,7 +328,44 @@ int main(int argc, char* argv[])
 
         http.Use(porla::HttpNotFound());
 
+        int const http_thread_count = std::max(cfg->http_threads.value_or(1), 1);
+        bool const cpu_pinning = cfg->cpu_pinning.value_or(false);
+        unsigned int const cpus = std::max(std::thread::hardware_concurrency(), 1u);
+
+        std::vector<std::thread> http_threads;
+        http_threads.reserve(http_thread_count);
+
+        for (int i = 0; i < http_thread_count; i++)
+        {
+            http_threads.emplace_back(
+                [&http_io, cpu_pinning, cpus, i]()
+                {
+                    // Keep CPU 0 for the session thread when there are CPUs to spare.
+                    if (cpu_pinning) porla::Utils::PinThread(cpus > 1 ? 1 + (i % (cpus - 1)) : 0);
+                    http_io.run();
+                });
+        }
+
+        BOOST_LOG_TRIVIAL(info) << "Serving HTTP on " << http_thread_count << " thread(s)";
+
+        if (cpu_pinning) porla::Utils::PinThread(0);
+
         io.run();
+
+        // Stop serving HTTP before anything the handlers refer to is destroyed.
+        http_io.stop();
+
+        for (auto& thread : http_threads)
+        {
+            thread.join();
+        }
+
+        // Let the running RPC calls finish before the methods are destroyed.
+        // Their completions are posted to the stopped session and never run.
+        // They, and the other handlers still queued on both contexts, are
+        // destroyed with the contexts after this block, so what they hold on
+        // to past it, such as the request metrics series, is shared with them.
+        workers.Join();
     }
 
     return 0;
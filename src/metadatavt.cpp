@@ -0,0 +1,44 @@
+#include "metadatavt.hpp"
+
+#include "childvt.hpp"
+
+namespace lt = libtorrent;
+
+using porla::MetadataVTable;
+
+struct MetadataRow
+{
+    std::string key;
+    std::string value;
+};
+
+typedef porla::ChildVTable<MetadataRow> Table;
+
+int MetadataVTable::Install(sqlite3* db, const porla::TorrentRegistry& torrents, const porla::Data::MetadataCache& metadata)
+{
+    return Table::Install(
+        db,
+        "metadata",
+        torrents,
+        {
+            {"key", [](const MetadataRow& row, sqlite3_context* ctx) {
+                sqlite3_result_text(ctx, row.key.c_str(), -1, SQLITE_TRANSIENT);
+            }},
+            {"value", [](const MetadataRow& row, sqlite3_context* ctx) {
+                sqlite3_result_text(ctx, row.value.c_str(), -1, SQLITE_TRANSIENT);
+            }},
+        },
+        [&metadata](const porla::TorrentRegistry::Entry& entry, std::vector<MetadataRow>& rows)
+        {
+            auto const values = metadata.Get(entry.status.info_hashes);
+            if (values == nullptr) return;
+
+            for (auto const& [key, value] : *values)
+            {
+                rows.push_back(MetadataRow{
+                    .key   = key,
+                    .value = value.dump()
+                });
+            }
+        });
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <sqlite3.h>
+
+#include "data/metadatacache.hpp"
+#include "torrentregistry.hpp"
+
+namespace porla
+{
+    class MetadataVTable
+    {
+    public:
+        static int Install(sqlite3* db, const TorrentRegistry& torrents, const Data::MetadataCache& metadata);
+    };
+}
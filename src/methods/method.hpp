@@ -1,30 +1,41 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
 #include <utility>
 
+#include <boost/asio.hpp>
 #include <nlohmann/json.hpp>
 
 #include "../json/all.hpp"
 #include "../httpcontext.hpp"
+#include "../utils/wireencoding.hpp"
+#include "../workerpool.hpp"
 
 using json = nlohmann::json;
 
 namespace porla::Methods
 {
+    /*
+     * Writes the response to a JSON-RPC call, with the id of the call. Calls
+     * without an id are notifications, and nothing is written for them.
+     */
     template<typename TRes>
     class WriteCb
     {
     public:
-        explicit WriteCb(std::shared_ptr<porla::HttpContext> ctx)
+        explicit WriteCb(std::shared_ptr<porla::HttpContext> ctx, std::optional<json> id)
             : m_ctx(std::move(ctx))
+            , m_id(std::move(id))
         {
         }
 
         void operator()(const TRes& res)
         {
-            json d = res;
-            Ok(d);
+            Ok(res);
         }
 
         void operator()(const json& j)
@@ -34,8 +45,11 @@ namespace porla::Methods
 
         void Error(int code, const std::string_view& message)
         {
+            if (!m_id.has_value()) return;
+
             m_ctx->WriteJson({
                 {"jsonrpc", "2.0"},
+                {"id", m_id.value()},
                 {"error", {
                     {"code", code},
                     {"message", message}
@@ -43,28 +57,238 @@ namespace porla::Methods
             });
         }
 
+        // Answers with 503 when the call is shed because the server is busy. The
+        // body is in the response encoding, so a call in a batch gets the error
+        // in its slot.
+        void Unavailable()
+        {
+            namespace http = boost::beast::http;
+
+            if (!m_id.has_value()) return;
+
+            json const body = {
+                {"jsonrpc", "2.0"},
+                {"id", m_id.value()},
+                {"error", {
+                    {"code", -32000},
+                    {"message", "Server busy"}
+                }}
+            };
+
+            http::response<http::string_body> res{http::status::service_unavailable, m_ctx->Request().version()};
+            res.set(http::field::server, "porla/1.0");
+            res.set(http::field::content_type, porla::Utils::ContentType(Encoding()));
+            res.set(http::field::retry_after, "1");
+            res.keep_alive(m_ctx->Request().keep_alive());
+            res.body() = porla::Utils::Encode(body, Encoding());
+            res.prepare_payload();
+
+            m_ctx->Write(std::move(res));
+        }
+
         void Ok(const json& result)
         {
+            if (!m_id.has_value()) return;
+
             m_ctx->WriteJson({
                 {"jsonrpc", "2.0"},
+                {"id", m_id.value()},
                 {"result", result}
             });
         }
 
+        // Converts the result here, so its info hashes are raw bytes when the
+        // client asked for a binary encoding.
+        template<typename T>
+        void Ok(const T& result)
+        {
+            if (!m_id.has_value()) return;
+
+            porla::Json::BinaryHashScope binary(Encoding() != porla::Utils::WireEncoding::Json);
+            Ok(json(result));
+        }
+
+        // The encoding the response is written with. Results which are written
+        // as JSON text with OkSerialized or OkChunked must use Ok instead when
+        // this is not JSON.
+        [[nodiscard]] porla::Utils::WireEncoding Encoding() const
+        {
+            return porla::Utils::ResponseEncoding(m_ctx->Request());
+        }
+
+        // Writes a result which is already serialized to JSON text, for results
+        // too large to build a json value of first.
+        void OkSerialized(std::string result)
+        {
+            namespace http = boost::beast::http;
+
+            if (!m_id.has_value()) return;
+
+            result.insert(0, ResultPrefix());
+            result.push_back('}');
+
+            http::response<http::string_body> res{http::status::ok, m_ctx->Request().version()};
+            res.set(http::field::server, "porla/1.0");
+            res.set(http::field::content_type, "application/json");
+            res.keep_alive(m_ctx->Request().keep_alive());
+            res.body() = std::move(result);
+            res.prepare_payload();
+
+            m_ctx->Write(std::move(res));
+        }
+
+        // Writes the result as a chunked response, for results too large to keep
+        // in memory at once. The producer passes the result JSON text in parts.
+        void OkChunked(porla::HttpContext::ChunkProducer producer)
+        {
+            namespace http = boost::beast::http;
+
+            if (!m_id.has_value()) return;
+
+            http::response<http::empty_body> res{http::status::ok, m_ctx->Request().version()};
+            res.set(http::field::server, "porla/1.0");
+            res.set(http::field::content_type, "application/json");
+            res.keep_alive(m_ctx->Request().keep_alive());
+
+            auto first = std::make_shared<bool>(true);
+
+            m_ctx->WriteChunked(
+                std::move(res),
+                [producer = std::move(producer), first, prefix = ResultPrefix()](const porla::HttpContext::ChunkCb& cb)
+                {
+                    producer(
+                        [cb, first, prefix](std::string chunk, bool more)
+                        {
+                            if (*first) chunk.insert(0, prefix);
+                            if (!more) chunk.push_back('}');
+
+                            *first = false;
+
+                            cb(std::move(chunk), more);
+                        });
+                });
+        }
+
     private:
+        std::string ResultPrefix() const
+        {
+            return R"({"jsonrpc":"2.0","id":)" + m_id->dump() + R"(,"result":)";
+        }
+
         std::shared_ptr<porla::HttpContext> m_ctx;
+        std::optional<json> m_id;
     };
 
     template<typename TReq, typename TRes>
     class Method
     {
     public:
-        void operator()(const nlohmann::json& body, std::shared_ptr<porla::HttpContext> ctx)
+        void operator()(const nlohmann::json& params, const std::optional<nlohmann::json>& id, std::shared_ptr<porla::HttpContext> ctx)
         {
-            Invoke(body.get<TReq>(), WriteCb<TRes>(std::move(ctx)));
+            WriteCb<TRes> cb(std::move(ctx), id);
+            std::optional<TReq> req;
+
+            try
+            {
+                req = params.get<TReq>();
+            }
+            catch (const nlohmann::json::exception& ex)
+            {
+                return cb.Error(-32602, "Invalid params: " + std::string(ex.what()));
+            }
+
+            Invoke(req.value(), std::move(cb));
         }
 
     protected:
         virtual void Invoke(const TReq& req, WriteCb<TRes>) = 0;
     };
+
+    /*
+     * A method which does its heavy part on the worker pool instead of the
+     * session thread. Snapshot is called on the session thread and copies
+     * what the method needs from the session, or answers the call right away
+     * if it is cheap. Execute is called with the snapshot on a worker, and
+     * the completion it returns is posted back to the session thread to write
+     * the response. The write callback is only used on the session thread.
+     * Calls are answered with 503 when the pool is saturated.
+     */
+    template<typename TReq, typename TRes, typename TSnapshot>
+    class PooledMethod : public Method<TReq, TRes>
+    {
+    public:
+        typedef std::function<void(WriteCb<TRes>& cb)> Completion;
+
+    protected:
+        explicit PooledMethod(boost::asio::io_context& io, porla::WorkerPool& pool)
+            : m_io(io)
+            , m_pool(pool)
+        {
+        }
+
+        // Returns nullopt if the call was already answered.
+        virtual std::optional<TSnapshot> Snapshot(const TReq& req, WriteCb<TRes>& cb) = 0;
+
+        virtual Completion Execute(const TReq& req, TSnapshot& snapshot) = 0;
+
+        void Invoke(const TReq& req, WriteCb<TRes> cb) final
+        {
+            auto snapshot = Snapshot(req, cb);
+            if (!snapshot.has_value()) return;
+
+            struct Job
+            {
+                TReq req;
+                TSnapshot snapshot;
+                WriteCb<TRes> cb;
+            };
+
+            auto job = std::make_shared<Job>(Job{req, std::move(snapshot.value()), std::move(cb)});
+
+            bool const posted = m_pool.TryPost(
+                [this, job]()
+                {
+                    Completion completion;
+
+                    try
+                    {
+                        completion = Execute(job->req, job->snapshot);
+                    }
+                    catch (const std::exception& ex)
+                    {
+                        // The call must still be answered, and the callback
+                        // may only be used on the session thread.
+                        completion = [message = std::string(ex.what())](WriteCb<TRes>& cb)
+                        {
+                            cb.Error(-32603, message);
+                        };
+                    }
+
+                    boost::asio::post(
+                        m_io,
+                        [job, completion = std::move(completion)]()
+                        {
+                            // Nothing catches what is thrown out of the
+                            // session thread's handlers.
+                            try
+                            {
+                                completion(job->cb);
+                            }
+                            catch (const std::exception& ex)
+                            {
+                                job->cb.Error(-32603, ex.what());
+                            }
+                        });
+                });
+
+            if (!posted)
+            {
+                job->cb.Unavailable();
+            }
+        }
+
+    private:
+        boost::asio::io_context& m_io;
+        porla::WorkerPool& m_pool;
+    };
 }
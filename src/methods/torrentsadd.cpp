@@ -4,13 +4,11 @@
 #include <libtorrent/add_torrent_params.hpp>
 #include <libtorrent/magnet_uri.hpp>
 
-#include "../data/models/torrentsmetadata.hpp"
 #include "../session.hpp"
 #include "../utils/base64.hpp"
 
 namespace lt = libtorrent;
 
-using porla::Data::Models::TorrentsMetadata;
 using porla::Methods::TorrentsAdd;
 using porla::Methods::TorrentsAddReq;
 
@@ -136,13 +134,13 @@ void TorrentsAdd::Invoke(const TorrentsAddReq& req, WriteCb<TorrentsAddRes> cb)
     {
         for (auto const& [key, value] : metadata.value())
         {
-            TorrentsMetadata::Set(m_db, hash, key, value);
+            m_session.SetMetadata(hash, key, value);
         }
     }
 
     // Set static metadata, preset etc
     if (auto val = req.preset)
-        TorrentsMetadata::Set(m_db, hash, "preset", json(req.preset.value()));
+        m_session.SetMetadata(hash, "preset", json(req.preset.value()));
 
     cb.Ok(TorrentsAddRes{
         .info_hash = hash
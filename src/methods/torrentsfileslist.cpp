@@ -1,36 +1,93 @@
 #include "torrentsfileslist.hpp"
 
+#include <libtorrent/torrent_info.hpp>
+
 #include "../session.hpp"
 
 using porla::Methods::TorrentsFilesList;
 using porla::Methods::TorrentsFilesListReq;
 using porla::Methods::TorrentsFilesListRes;
 
-TorrentsFilesList::TorrentsFilesList(porla::ISession &session)
-    : m_session(session)
+// The files of torrents with more than this are streamed as JSON in chunks
+// of about ChunkSize bytes, or built on the worker pool for the binary
+// encodings, instead of being built on the session thread.
+static constexpr int StreamThreshold = 1000;
+static constexpr std::size_t ChunkSize = 64 * 1024;
+
+TorrentsFilesList::TorrentsFilesList(boost::asio::io_context& io, porla::WorkerPool& pool, porla::ISession& session)
+    : PooledMethod(io, pool)
+    , m_session(session)
 {
 }
 
-void TorrentsFilesList::Invoke(const TorrentsFilesListReq& req, WriteCb<TorrentsFilesListRes> cb)
+std::optional<std::shared_ptr<const lt::torrent_info>> TorrentsFilesList::Snapshot(
+    const TorrentsFilesListReq& req,
+    WriteCb<TorrentsFilesListRes>& cb)
 {
-    auto const& torrents = m_session.Torrents();
-    auto const handle = torrents.find(req.info_hash);
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
 
-    if (handle == torrents.end())
+    if (torrent == nullptr)
     {
-        return cb.Error(-1, "Torrent not found");
+        cb.Error(-1, "Torrent not found");
+        return std::nullopt;
     }
 
-    auto const status = handle->second.status();
+    auto tf = torrent->status.torrent_file.lock();
 
-    TorrentsFilesListRes res;
+    if (tf == nullptr)
+    {
+        cb.Error(-2, "Failed to lock torrent file");
+        return std::nullopt;
+    }
 
-    if (auto tf = status.torrent_file.lock())
+    if (tf->num_files() <= StreamThreshold)
     {
-        return cb.Ok(TorrentsFilesListRes{
+        cb.Ok(TorrentsFilesListRes{
             .file_storage = tf->files()
         });
+
+        return std::nullopt;
+    }
+
+    if (cb.Encoding() == porla::Utils::WireEncoding::Json)
+    {
+        // The torrent info is immutable, so the files can be serialized on
+        // whichever thread is writing the response.
+        auto next = std::make_shared<int>(0);
+
+        cb.OkChunked(
+            [tf, next](const porla::HttpContext::ChunkCb& write)
+            {
+                auto const& storage = tf->files();
+
+                std::string chunk = *next == 0 ? R"({"files":[)" : "";
+
+                for (; *next < storage.num_files() && chunk.size() < ChunkSize; ++*next)
+                {
+                    if (*next > 0) chunk.push_back(',');
+                    chunk += porla::Methods::FileToJson(storage, lt::file_index_t{*next})
+                        .dump(-1, ' ', false, json::error_handler_t::replace);
+                }
+
+                bool const more = *next < storage.num_files();
+                if (!more) chunk += "]}";
+
+                write(std::move(chunk), more);
+            });
+
+        return std::nullopt;
     }
 
-    return cb.Error(-2, "Failed to lock torrent file");
+    return tf;
+}
+
+TorrentsFilesList::Completion TorrentsFilesList::Execute(
+    const TorrentsFilesListReq& req,
+    std::shared_ptr<const lt::torrent_info>& snapshot)
+{
+    json result = TorrentsFilesListRes{
+        .file_storage = snapshot->files()
+    };
+
+    return [result = std::move(result)](WriteCb<TorrentsFilesListRes>& cb) { cb.Ok(result); };
 }
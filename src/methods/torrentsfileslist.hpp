@@ -1,8 +1,17 @@
 #pragma once
 
+#include <memory>
+
+#include <boost/asio.hpp>
+
 #include "method.hpp"
 #include "torrentsfileslist_reqres.hpp"
 
+namespace libtorrent
+{
+    class torrent_info;
+}
+
 namespace porla
 {
     class ISession;
@@ -10,13 +19,19 @@ namespace porla
 
 namespace porla::Methods
 {
-    class TorrentsFilesList : public Method<TorrentsFilesListReq, TorrentsFilesListRes>
+    class TorrentsFilesList : public PooledMethod<TorrentsFilesListReq, TorrentsFilesListRes, std::shared_ptr<const libtorrent::torrent_info>>
     {
     public:
-        explicit TorrentsFilesList(ISession& session);
+        explicit TorrentsFilesList(boost::asio::io_context& io, WorkerPool& pool, ISession& session);
 
     protected:
-        void Invoke(const TorrentsFilesListReq& req, WriteCb<TorrentsFilesListRes> cb);
+        std::optional<std::shared_ptr<const libtorrent::torrent_info>> Snapshot(
+            const TorrentsFilesListReq& req,
+            WriteCb<TorrentsFilesListRes>& cb) override;
+
+        Completion Execute(
+            const TorrentsFilesListReq& req,
+            std::shared_ptr<const libtorrent::torrent_info>& snapshot) override;
 
     private:
         ISession& m_session;
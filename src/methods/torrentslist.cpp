@@ -1,216 +1,526 @@
 #include "torrentslist.hpp"
 
-#include "../data/models/torrentsmetadata.hpp"
+#include <iomanip>
+#include <sstream>
+#include <string_view>
+
+#include <libtorrent/hex.hpp>
+
 #include "../session.hpp"
+#include "../torrentfilter.hpp"
 #include "../utils/eta.hpp"
 #include "../utils/ratio.hpp"
 
-using porla::Data::Models::TorrentsMetadata;
 using porla::Methods::TorrentsList;
+using porla::Methods::TorrentsListReq;
+using porla::Methods::TorrentsListRes;
+using porla::Methods::TorrentsListSnapshot;
+using porla::TorrentRegistry;
 
-TorrentsList::TorrentsList(sqlite3* db, porla::ISession& session)
-    : m_db(db)
-    , m_session(session)
+typedef TorrentRegistry::SortColumn SortColumn;
+
+// JSON lists with more torrents than this are streamed in chunks of about
+// ChunkSize bytes instead of being built into one response.
+static constexpr std::size_t StreamThreshold = 1000;
+static constexpr std::size_t ChunkSize = 64 * 1024;
+
+// Lists which order more torrents than this outside of the registry sort
+// index are ordered on the worker pool.
+static constexpr std::size_t PoolThreshold = 5000;
+
+struct Stream
+{
+    std::string head;
+    std::vector<std::pair<TorrentRegistry::Id, lt::info_hash_t>> rows;
+    std::size_t next = 0;
+    std::size_t written = 0;
+};
+
+static const std::map<std::string, SortColumn> SortColumns =
+{
+    {"download_rate",  SortColumn::DownloadRate},
+    {"list_peers",     SortColumn::ListPeers},
+    {"list_seeds",     SortColumn::ListSeeds},
+    {"name",           SortColumn::Name},
+    {"num_peers",      SortColumn::NumPeers},
+    {"num_seeds",      SortColumn::NumSeeds},
+    {"progress",       SortColumn::Progress},
+    {"queue_position", SortColumn::QueuePosition},
+    {"save_path",      SortColumn::SavePath},
+    {"size",           SortColumn::Size},
+    {"total",          SortColumn::Total},
+    {"total_done",     SortColumn::TotalDone},
+    {"upload_rate",    SortColumn::UploadRate},
+};
+
+// Cursors are "<id>:" followed by the sort value of the torrent - 'n' and a
+// number, 'x' and a string in hex, or nothing if the torrent has no value.
+// Names and save paths are not always valid UTF-8, so their bytes are not put
+// in the cursor as they are. Cursors with 's' and the raw string are still
+// read.
+static std::string EncodeCursor(const TorrentRegistry::SortCursor& cursor)
 {
+    std::stringstream ss;
+    ss << cursor.id << ':';
+
+    if (cursor.value.has_value())
+    {
+        if (auto number = std::get_if<double>(&cursor.value.value()))
+        {
+            ss << 'n' << std::setprecision(17) << *number;
+        }
+        else
+        {
+            auto const& text = std::get<std::string>(cursor.value.value());
+            ss << 'x' << lt::aux::to_hex({ text.data(), static_cast<std::ptrdiff_t>(text.size()) });
+        }
+    }
+
+    return ss.str();
 }
 
-void TorrentsList::Invoke(const TorrentsListReq& req, WriteCb<TorrentsListRes> cb)
+static std::optional<TorrentRegistry::SortCursor> DecodeCursor(const std::string& cursor)
 {
-    static std::map<std::pair<std::string, bool>, std::function<bool(const TorrentsListRes::Item&, const TorrentsListRes::Item&)>> sorters =
-    {
-        {{"download_rate", false},  [](auto const& lhs, auto const& rhs) { return lhs.download_rate >= rhs.download_rate; }},
-        {{"download_rate", true},   [](auto const& lhs, auto const& rhs) { return lhs.download_rate < rhs.download_rate; }},
-        {{"list_peers", false},     [](auto const& lhs, auto const& rhs) { return lhs.list_peers >= rhs.list_peers; }},
-        {{"list_peers", true},      [](auto const& lhs, auto const& rhs) { return lhs.list_peers < rhs.list_peers; }},
-        {{"list_seeds", false},     [](auto const& lhs, auto const& rhs) { return lhs.list_seeds >= rhs.list_seeds; }},
-        {{"list_seeds", true},      [](auto const& lhs, auto const& rhs) { return lhs.list_seeds < rhs.list_seeds; }},
-        {{"name", false},           [](auto const& lhs, auto const& rhs) { return strcmp(lhs.name.c_str(), rhs.name.c_str()) > 0; }},
-        {{"name", true},            [](auto const& lhs, auto const& rhs) { return strcmp(lhs.name.c_str(), rhs.name.c_str()) < 0; }},
-        {{"num_peers", false},      [](auto const& lhs, auto const& rhs) { return lhs.num_peers >= rhs.num_peers; }},
-        {{"num_peers", true},       [](auto const& lhs, auto const& rhs) { return lhs.num_peers < rhs.num_peers; }},
-        {{"num_seeds", false},      [](auto const& lhs, auto const& rhs) { return lhs.num_seeds >= rhs.num_seeds; }},
-        {{"num_seeds", true},       [](auto const& lhs, auto const& rhs) { return lhs.num_seeds < rhs.num_seeds; }},
-        {{"progress", false},       [](auto const& lhs, auto const& rhs) { return lhs.progress >= rhs.progress; }},
-        {{"progress", true},        [](auto const& lhs, auto const& rhs) { return lhs.progress < rhs.progress; }},
-        {
-            {"queue_position", false},
-            [](auto const& lhs, auto const& rhs)
+    auto const sep = cursor.find(':');
+
+    if (sep == std::string::npos || sep == 0)
+    {
+        return std::nullopt;
+    }
+
+    try
+    {
+        TorrentRegistry::SortCursor result{
+            .id = static_cast<TorrentRegistry::Id>(std::stoul(cursor.substr(0, sep)))
+        };
+
+        if (sep + 1 == cursor.size())
+        {
+            return result;
+        }
+
+        switch (cursor[sep + 1])
+        {
+        case 'n':
+            result.value = std::stod(cursor.substr(sep + 2));
+            return result;
+        case 's':
+            result.value = cursor.substr(sep + 2);
+            return result;
+        case 'x':
+        {
+            auto const hex = std::string_view(cursor).substr(sep + 2);
+            if (hex.size() % 2 != 0) return std::nullopt;
+
+            std::string text(hex.size() / 2, '\0');
+
+            if (!lt::aux::from_hex({ hex.data(), static_cast<std::ptrdiff_t>(hex.size()) }, text.data()))
             {
-                if (lhs.queue_position < 0) return false;
-                if (rhs.queue_position < 0) return true;
-                return lhs.queue_position >= rhs.queue_position;
+                return std::nullopt;
             }
-        },
+
+            result.value = std::move(text);
+            return result;
+        }
+        default:
+            return std::nullopt;
+        }
+    }
+    catch (const std::exception&)
+    {
+        return std::nullopt;
+    }
+}
+
+static TorrentsListRes::Item ToItem(
+    const porla::Data::MetadataCache& cache,
+    const TorrentRegistry::Entry& entry,
+    const std::optional<std::vector<std::string>>& include_metadata)
+{
+    auto const& ts = entry.status;
+
+    json category                 = entry.category.has_value() ? json(entry.category.value()) : json();
+    std::optional<json> metadata  = std::nullopt;
+    std::int64_t size             = -1;
+
+    if (include_metadata.has_value())
+    {
+        auto const stored_metadata = cache.Get(ts.info_hashes);
+        auto const& metadata_keys = include_metadata.value();
+
+        // Include metadata for all the keys specified. If ["*"], include everything.
+
+        if (stored_metadata == nullptr)
+        {
+            metadata = json::object({});
+        }
+        else if (metadata_keys.size() == 1 && metadata_keys.at(0) == "*")
+        {
+            metadata = *stored_metadata;
+        }
+        else
         {
-            {"queue_position", true},
-            [](auto const& lhs, auto const& rhs)
+            metadata = json::object({});
+
+            for (auto const& key : metadata_keys)
             {
-                if (lhs.queue_position < 0) return false;
-                if (rhs.queue_position < 0) return true;
-                return lhs.queue_position < rhs.queue_position;
+                auto const value = stored_metadata->find(key);
+                if (value == stored_metadata->end()) continue;
+                metadata.value()[key] = value->second;
             }
-        },
-        {{"save_path", false},      [](auto const& lhs, auto const& rhs) { return strcmp(lhs.save_path.c_str(), rhs.save_path.c_str()) > 0; }},
-        {{"save_path", true},       [](auto const& lhs, auto const& rhs) { return strcmp(lhs.save_path.c_str(), rhs.save_path.c_str()) < 0; }},
-        {{"size", false},           [](auto const& lhs, auto const& rhs) { return lhs.size >= rhs.size; }},
-        {{"size", true},            [](auto const& lhs, auto const& rhs) { return lhs.size < rhs.size; }},
-        {{"total", false},          [](auto const& lhs, auto const& rhs) { return lhs.total >= rhs.total; }},
-        {{"total", true},           [](auto const& lhs, auto const& rhs) { return lhs.total < rhs.total; }},
-        {{"total_done", false},     [](auto const& lhs, auto const& rhs) { return lhs.total_done >= rhs.total_done; }},
-        {{"total_done", true},      [](auto const& lhs, auto const& rhs) { return lhs.total_done < rhs.total_done; }},
-        {{"upload_rate", false},    [](auto const& lhs, auto const& rhs) { return lhs.upload_rate >= rhs.upload_rate; }},
-        {{"upload_rate", true},     [](auto const& lhs, auto const& rhs) { return lhs.upload_rate < rhs.upload_rate; }},
+        }
+    }
+
+    if (auto ti = ts.torrent_file.lock())
+        size = ti->total_size();
+
+    return TorrentsListRes::Item{
+        .all_time_download = ts.all_time_download,
+        .all_time_upload   = ts.all_time_upload,
+        .category          = category,
+        .download_rate     = ts.download_rate,
+        .error             = ts.errc,
+        .eta               = porla::Utils::ETA(ts).count(),
+        .flags             = static_cast<std::uint64_t>(ts.flags),
+        .info_hash         = ts.info_hashes,
+        .list_peers        = ts.list_peers,
+        .list_seeds        = ts.list_seeds,
+        .metadata          = metadata,
+        .moving_storage    = ts.moving_storage,
+        .name              = ts.name,
+        .num_peers         = ts.num_peers,
+        .num_seeds         = ts.num_seeds,
+        .progress          = ts.progress,
+        .queue_position    = static_cast<int>(ts.queue_position),
+        .ratio             = porla::Utils::Ratio(ts),
+        .save_path         = ts.save_path,
+        .size              = size,
+        .state             = ts.state,
+        .tags              = entry.tags,
+        .total             = ts.total,
+        .total_done        = ts.total_done,
+        .upload_rate       = ts.upload_rate,
+    };
+}
+
+// Orders the rows of the snapshot and keeps the ones on the requested page.
+static void Select(TorrentsListSnapshot& snapshot)
+{
+    auto& rows = snapshot.rows;
+
+    auto const less = [order_asc = snapshot.order_asc](auto const& lhs, auto const& rhs)
+    {
+        return TorrentRegistry::SortsBefore(order_asc, lhs.key, rhs.key);
     };
 
-    std::string field = req.order_by.value_or("queue_position");
-    bool order_asc = req.order_by_dir.value_or("asc") == "asc";
+    // Deltas are ordered but not paged.
+    if (snapshot.res.removed.has_value())
+    {
+        std::sort(rows.begin(), rows.end(), less);
+        return;
+    }
+
+    auto const page_size = static_cast<std::size_t>(snapshot.res.page_size);
+    auto const beg = std::min(snapshot.offset, rows.size());
+    auto const end = std::min(snapshot.offset + page_size + 1, rows.size());
 
-    auto const& sorter = sorters.find({field,order_asc});
+    std::partial_sort(rows.begin(), rows.begin() + static_cast<std::ptrdiff_t>(end), rows.end(), less);
 
-    if (sorter == sorters.end())
+    rows.erase(rows.begin() + static_cast<std::ptrdiff_t>(end), rows.end());
+    rows.erase(rows.begin(), rows.begin() + static_cast<std::ptrdiff_t>(beg));
+
+    if (rows.size() > page_size)
     {
-        return cb.Error(-1, "Invalid field in 'order_by'");
+        rows.pop_back();
+        snapshot.res.cursor = EncodeCursor(rows.back().key);
     }
+}
 
-    std::vector<TorrentsListRes::Item> torrents;
-    torrents.reserve(m_session.Torrents().size());
+TorrentsList::TorrentsList(
+    boost::asio::io_context& io,
+    porla::WorkerPool& pool,
+    porla::Data::MetadataCache& metadata,
+    porla::ISession& session)
+    : PooledMethod(io, pool)
+    , m_io(io)
+    , m_metadata(metadata)
+    , m_session(session)
+{
+}
 
-    for (auto const& [_, handle] : m_session.Torrents())
+std::optional<TorrentsListSnapshot> TorrentsList::Snapshot(const TorrentsListReq& req, WriteCb<TorrentsListRes>& cb)
+{
+    auto const column = SortColumns.find(req.order_by.value_or("queue_position"));
+    bool const order_asc = req.order_by_dir.value_or("asc") == "asc";
+
+    if (column == SortColumns.end())
     {
-        auto const stored_metadata = TorrentsMetadata::GetAll(m_db, handle.info_hashes());
+        cb.Error(-1, "Invalid field in 'order_by'");
+        return std::nullopt;
+    }
 
-        json category                 = json();
-        std::optional<json> metadata  = std::nullopt;
-        std::int64_t size             = -1;
-        std::vector<std::string> tags = {};
+    std::optional<TorrentRegistry::SortCursor> cursor;
+
+    if (req.cursor.has_value())
+    {
+        cursor = DecodeCursor(req.cursor.value());
 
-        if (stored_metadata.contains("category")
-            && stored_metadata.at("category").is_string())
+        if (!cursor.has_value())
         {
-            category = stored_metadata.at("category");
+            cb.Error(-3, "Invalid cursor");
+            return std::nullopt;
         }
+    }
+
+    auto const& registry = m_session.Torrents();
 
-        if (stored_metadata.contains("tags"))
+    // Filters are compiled once and evaluated to the set of matching ids,
+    // mostly by intersecting the registry bitmap indexes.
+    std::optional<porla::TorrentFilter> filter;
+
+    if (req.filters.has_value())
+    {
+        try
         {
-            stored_metadata.at("tags").get_to(tags);
+            filter = porla::TorrentFilter::Compile(req.filters.value());
         }
+        catch (const std::invalid_argument& ex)
+        {
+            cb.Error(-4, ex.what());
+            return std::nullopt;
+        }
+    }
+
+    std::optional<porla::IdBitmap> matches;
+    if (filter.has_value()) matches = filter->Evaluate(registry);
+
+    bool const filtered = matches.has_value();
+    const porla::IdBitmap* candidates = filtered ? &matches.value() : nullptr;
+
+    // With a version the client has seen, return only what changed after it -
+    // the changed torrents matching the filters, ordered but not paged, and the
+    // hashes of the ones removed or no longer matching. If the removals from
+    // that far back are no longer known, or the version is from before a
+    // restart, the client gets a full page instead.
+    std::vector<lt::info_hash_t> removed;
+
+    bool const delta = req.since.has_value()
+        && registry.Answers(req.since.value())
+        && registry.RemovedSince(req.since.value(), [&removed](auto const& hash) { removed.push_back(hash); });
+
+    int const page = req.page.value_or(0);
+    int const page_size = std::max(req.page_size.value_or(50), 1);
+
+    // A cursor replaces the page offset.
+    std::size_t const offset = cursor.has_value() ? 0 : static_cast<std::size_t>(page) * page_size;
+    std::size_t const total = filtered ? candidates->Count() : registry.Size();
+
+    if (!delta && offset > total)
+    {
+        cb.Error(-2, "Invalid page - too large.");
+        return std::nullopt;
+    }
+
+    TorrentsListSnapshot snapshot{
+        .order_asc = order_asc,
+        .offset    = offset,
+        .res       = TorrentsListRes{
+            .page           = page,
+            .page_size      = page_size,
+            .torrents_total = static_cast<int>(total),
+            .version        = registry.Version()
+        }
+    };
+
+    auto const row = [&column](const TorrentRegistry::Entry& entry)
+    {
+        return TorrentsListSnapshot::Row{
+            .key  = {
+                .value = TorrentRegistry::SortValueOf(column->second, entry.status),
+                .id    = entry.id
+            },
+            .hash = entry.status.info_hashes
+        };
+    };
+
+    if (delta)
+    {
+        porla::IdBitmap ids;
+        registry.ChangedSince(req.since.value(), [&ids](auto const& entry) { ids.Insert(entry.id); });
 
-        if (req.include_metadata.has_value())
+        porla::IdBitmap const visible = filter.has_value() ? filter->Evaluate(registry, ids) : ids;
+
+        for (auto const id : ids)
         {
-            auto const metadata_keys = req.include_metadata.value();
+            auto const entry = registry.At(id);
+
+            if (visible.Contains(id)) snapshot.rows.push_back(row(*entry));
+            else removed.push_back(entry->status.info_hashes);
+        }
+
+        snapshot.res.removed = std::move(removed);
+    }
+    else if (filtered && candidates->Count() * 8 < registry.Size())
+    {
+        // Few torrents matched, so order just those instead of walking the
+        // sort index past all the ones that did not.
+        snapshot.rows.reserve(candidates->Count());
 
-            // Include metadata for all the keys specified. If ["*"], include everything.
+        for (auto const id : *candidates)
+        {
+            auto r = row(*registry.At(id));
 
-            if (metadata_keys.size() == 1 && metadata_keys.at(0) == "*")
+            if (cursor.has_value() && !TorrentRegistry::SortsBefore(order_asc, cursor.value(), r.key))
             {
-                metadata = stored_metadata;
+                continue;
             }
-            else
-            {
-                metadata = json::object({});
 
-                for (auto const& key : metadata_keys)
-                {
-                    if (!stored_metadata.contains(key)) continue;
-                    metadata.value()[key] = stored_metadata.at(key);
-                }
-            }
+            snapshot.rows.push_back(std::move(r));
         }
+    }
+    else
+    {
+        // The sort index is already ordered, so the page is read right away.
+        // Collect one torrent more than the page size to know if there are more.
+        std::vector<const TorrentRegistry::Entry*> rows;
+        rows.reserve(page_size + 1);
 
-        auto const& ts = handle.status();
+        std::size_t skip = offset;
 
-        if (auto ti = ts.torrent_file.lock())
-            size = ti->total_size();
+        registry.Ordered(
+            column->second,
+            order_asc,
+            cursor,
+            [&](const TorrentRegistry::Entry& entry)
+            {
+                if (filtered && !candidates->Contains(entry.id)) return true;
+                if (skip > 0) { skip--; return true; }
 
-        // Filter torrents here.
-        bool filter_includes_torrent = true;
+                rows.push_back(&entry);
 
-        if (auto filters = req.filters)
+                return rows.size() <= static_cast<std::size_t>(page_size);
+            });
+
+        if (rows.size() > static_cast<std::size_t>(page_size))
         {
-            for (auto const& filter : filters.value())
-            {
-                if (filter.field == "category"
-                    && filter.args.is_string())
-                {
-                    auto const& category_value = filter.args.get<std::string>();
-                    filter_includes_torrent = category == filter.args;
-                }
-                else if (filter.field == "save_path"
-                    && filter.args.is_string())
-                {
-                    filter_includes_torrent = ts.save_path == filter.args;
-                }
-                else if (filter.field == "tags"
-                    && filter.args.is_string())
-                {
-                    auto const& tag_value = filter.args.get<std::string>();
+            rows.pop_back();
 
-                    filter_includes_torrent = std::find(
-                        tags.begin(),
-                        tags.end(),
-                        tag_value) != tags.end();
-                }
-            }
+            snapshot.res.cursor = EncodeCursor(TorrentRegistry::SortCursor{
+                .value = TorrentRegistry::SortValueOf(column->second, rows.back()->status),
+                .id    = rows.back()->id
+            });
         }
 
-        if (!filter_includes_torrent)
-        {
-            continue;
-        }
-
-        torrents.push_back(TorrentsListRes::Item{
-            .all_time_download = ts.all_time_download,
-            .all_time_upload   = ts.all_time_upload,
-            .category          = category,
-            .download_rate     = ts.download_rate,
-            .error             = ts.errc,
-            .eta               = porla::Utils::ETA(ts).count(),
-            .flags             = static_cast<std::uint64_t>(ts.flags),
-            .info_hash         = ts.info_hashes,
-            .list_peers        = ts.list_peers,
-            .list_seeds        = ts.list_seeds,
-            .metadata          = metadata,
-            .moving_storage    = ts.moving_storage,
-            .name              = ts.name,
-            .num_peers         = ts.num_peers,
-            .num_seeds         = ts.num_seeds,
-            .progress          = ts.progress,
-            .queue_position    = static_cast<int>(ts.queue_position),
-            .ratio             = porla::Utils::Ratio(ts),
-            .save_path         = ts.save_path,
-            .size              = size,
-            .state             = ts.state,
-            .tags              = tags,
-            .total             = ts.total,
-            .total_done        = ts.total_done,
-            .upload_rate       = ts.upload_rate,
-        });
+        Respond(req, rows, std::move(snapshot.res), cb);
+        return std::nullopt;
+    }
+
+    // Ordering a few torrents is cheaper than the round trip to a worker.
+    if (snapshot.rows.size() <= PoolThreshold)
+    {
+        Select(snapshot);
+        Complete(req, snapshot, cb);
+        return std::nullopt;
+    }
+
+    return snapshot;
+}
+
+TorrentsList::Completion TorrentsList::Execute(
+    const TorrentsListReq& req,
+    TorrentsListSnapshot& snapshot)
+{
+    Select(snapshot);
+
+    return [this, req, snapshot = std::move(snapshot)](WriteCb<TorrentsListRes>& cb) mutable
+    {
+        Complete(req, snapshot, cb);
+    };
+}
+
+void TorrentsList::Complete(const TorrentsListReq& req, TorrentsListSnapshot& snapshot, WriteCb<TorrentsListRes>& cb)
+{
+    auto const& registry = m_session.Torrents();
+
+    std::vector<const TorrentRegistry::Entry*> rows;
+    rows.reserve(snapshot.rows.size());
+
+    for (auto const& row : snapshot.rows)
+    {
+        // Torrents removed since the snapshot was taken are left out.
+        auto const entry = registry.At(row.key.id);
+        if (entry == nullptr || entry->status.info_hashes != row.hash) continue;
+
+        rows.push_back(entry);
     }
 
-    std::sort(
-        torrents.begin(),
-        torrents.end(),
-        [&sorter](auto const& lhs, auto const& rhs)
+    Respond(req, rows, std::move(snapshot.res), cb);
+}
+
+void TorrentsList::Respond(
+    const TorrentsListReq& req,
+    const std::vector<const TorrentRegistry::Entry*>& rows,
+    TorrentsListRes res,
+    WriteCb<TorrentsListRes>& cb)
+{
+    if (rows.size() <= StreamThreshold || cb.Encoding() != porla::Utils::WireEncoding::Json)
+    {
+        res.torrents.reserve(rows.size());
+
+        for (auto const entry : rows)
         {
-            return sorter->second(lhs, rhs);
-        });
+            res.torrents.push_back(ToItem(m_metadata, *entry, req.include_metadata));
+        }
+
+        return cb.Ok(res);
+    }
+
+    // Large lists are serialized a chunk at a time on the session thread as
+    // the response is written. Torrents removed in between are left out, and
+    // the others are written with their status at the time of their chunk.
+    json head = res;
+    head.erase("torrents");
 
-    int page_beg = req.page.value_or(0) * req.page_size.value_or(50);
-    int page_end = std::min(
-        page_beg + req.page_size.value_or(50),
-        static_cast<int>(torrents.size()));
+    auto stream = std::make_shared<Stream>();
+    stream->head = head.dump(-1, ' ', false, json::error_handler_t::replace);
+    stream->head.back() = ',';
+    stream->head += R"("torrents":[)";
+    stream->rows.reserve(rows.size());
 
-    if (page_beg > torrents.size())
+    for (auto const entry : rows)
     {
-        return cb.Error(-2, "Invalid page - too large.");
+        stream->rows.emplace_back(entry->id, entry->status.info_hashes);
     }
 
-    cb.Ok(TorrentsListRes{
-        .page = req.page.value_or(0),
-        .page_size = req.page_size.value_or(50),
-        .torrents = std::vector(
-            torrents.begin() + page_beg,
-            torrents.begin() + page_end),
-        .torrents_total = static_cast<int>(torrents.size())
-    });
+    cb.OkChunked(
+        [&io = m_io, &cache = m_metadata, &session = m_session, include_metadata = req.include_metadata, stream](
+            const porla::HttpContext::ChunkCb& write)
+        {
+            boost::asio::dispatch(
+                io,
+                [&cache, &session, include_metadata, stream, write]()
+                {
+                    auto const& registry = session.Torrents();
+
+                    std::string chunk;
+                    chunk.swap(stream->head);
+
+                    for (; stream->next < stream->rows.size() && chunk.size() < ChunkSize; stream->next++)
+                    {
+                        auto const& [id, hash] = stream->rows[stream->next];
+                        auto const entry = registry.At(id);
+
+                        if (entry == nullptr || entry->status.info_hashes != hash) continue;
+
+                        if (stream->written++ > 0) chunk.push_back(',');
+                        chunk += json(ToItem(cache, *entry, include_metadata))
+                            .dump(-1, ' ', false, json::error_handler_t::replace);
+                    }
+
+                    bool const more = stream->next < stream->rows.size();
+                    if (!more) chunk += "]}";
+
+                    write(std::move(chunk), more);
+                });
+        });
 }
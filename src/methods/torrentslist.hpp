@@ -1,8 +1,13 @@
 #pragma once
 
-#include <sqlite3.h>
+#include <cstddef>
+#include <vector>
+
+#include <boost/asio.hpp>
 
 #include "method.hpp"
+#include "../data/metadatacache.hpp"
+#include "../torrentregistry.hpp"
 #include "torrentslist_reqres.hpp"
 
 namespace porla
@@ -12,15 +17,46 @@ namespace porla
 
 namespace porla::Methods
 {
-    class TorrentsList : public Method<TorrentsListReq, TorrentsListRes>
+    // The torrents a list is ordered from, with their sort values at the time
+    // of the call, and the response without its torrents.
+    struct TorrentsListSnapshot
+    {
+        struct Row
+        {
+            TorrentRegistry::SortCursor key;
+            lt::info_hash_t hash;
+        };
+
+        std::vector<Row> rows;
+        bool order_asc;
+        std::size_t offset;
+        TorrentsListRes res;
+    };
+
+    class TorrentsList : public PooledMethod<TorrentsListReq, TorrentsListRes, TorrentsListSnapshot>
     {
     public:
-        explicit TorrentsList(sqlite3* db, porla::ISession& session);
+        explicit TorrentsList(
+            boost::asio::io_context& io,
+            WorkerPool& pool,
+            Data::MetadataCache& metadata,
+            porla::ISession& session);
 
-        void Invoke(const TorrentsListReq& req, WriteCb<TorrentsListRes> cb) override;
+    protected:
+        std::optional<TorrentsListSnapshot> Snapshot(const TorrentsListReq& req, WriteCb<TorrentsListRes>& cb) override;
+        Completion Execute(const TorrentsListReq& req, TorrentsListSnapshot& snapshot) override;
 
     private:
-        sqlite3* m_db;
+        void Complete(const TorrentsListReq& req, TorrentsListSnapshot& snapshot, WriteCb<TorrentsListRes>& cb);
+
+        void Respond(
+            const TorrentsListReq& req,
+            const std::vector<const TorrentRegistry::Entry*>& rows,
+            TorrentsListRes res,
+            WriteCb<TorrentsListRes>& cb);
+
+        boost::asio::io_context& m_io;
+        Data::MetadataCache& m_metadata;
         porla::ISession& m_session;
     };
 }
@@ -7,20 +7,16 @@
 
 namespace porla::Methods
 {
-    struct TorrentsListReqFilter
-    {
-        std::string field;
-        json args;
-    };
-
     struct TorrentsListReq
     {
-        std::optional<std::vector<TorrentsListReqFilter>> filters;
+        std::optional<std::string> cursor;
+        std::optional<json> filters;
         std::optional<std::vector<std::string>> include_metadata;
         std::optional<int> page;
         std::optional<int> page_size;
         std::optional<std::string> order_by;
         std::optional<std::string> order_by_dir;
+        std::optional<std::uint64_t> since;
     };
 
     struct TorrentsListRes
@@ -54,10 +50,13 @@ namespace porla::Methods
             int upload_rate;
         };
 
+        std::optional<std::string> cursor;
         int page;
         int page_size;
+        std::optional<std::vector<lt::info_hash_t>> removed;
 
         std::vector<Item> torrents;
         int torrents_total;
+        std::uint64_t version;
     };
 }
@@ -1,30 +1,29 @@
 #include "torrentsmetadatalist.hpp"
 
-#include "../data/models/torrentsmetadata.hpp"
 #include "../session.hpp"
 
-using porla::Data::Models::TorrentsMetadata;
 using porla::Methods::TorrentsMetadataList;
 using porla::Methods::TorrentsMetadataListReq;
 using porla::Methods::TorrentsMetadataListRes;
 
-TorrentsMetadataList::TorrentsMetadataList(sqlite3 *db, ISession &session)
-    : m_db(db)
+TorrentsMetadataList::TorrentsMetadataList(porla::Data::MetadataCache& metadata, ISession &session)
+    : m_metadata(metadata)
     , m_session(session)
 {
 }
 
 void TorrentsMetadataList::Invoke(const TorrentsMetadataListReq& req, WriteCb<TorrentsMetadataListRes> cb)
 {
-    auto const& torrents = m_session.Torrents();
-    auto const handle = torrents.find(req.info_hash);
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
 
-    if (handle == torrents.end())
+    if (torrent == nullptr)
     {
         return cb.Error(-1, "Torrent not found");
     }
 
+    auto const metadata = m_metadata.Get(req.info_hash);
+
     return cb.Ok(TorrentsMetadataListRes{
-        .metadata = TorrentsMetadata::GetAll(m_db, req.info_hash)
+        .metadata = metadata != nullptr ? *metadata : porla::Data::MetadataCache::Metadata()
     });
 }
@@ -1,8 +1,7 @@
 #pragma once
 
-#include <sqlite3.h>
-
 #include "method.hpp"
+#include "../data/metadatacache.hpp"
 #include "torrentsmetadatalist_reqres.hpp"
 
 namespace porla
@@ -15,13 +14,13 @@ namespace porla::Methods
     class TorrentsMetadataList : public Method<TorrentsMetadataListReq, TorrentsMetadataListRes>
     {
     public:
-        explicit TorrentsMetadataList(sqlite3* db, ISession& session);
+        explicit TorrentsMetadataList(Data::MetadataCache& metadata, ISession& session);
 
     protected:
         void Invoke(const TorrentsMetadataListReq& req, WriteCb<TorrentsMetadataListRes> cb) override;
 
     private:
-        sqlite3* m_db;
+        Data::MetadataCache& m_metadata;
         ISession& m_session;
     };
 }
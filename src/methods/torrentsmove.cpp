@@ -13,10 +13,9 @@ TorrentsMove::TorrentsMove(porla::ISession &session)
 
 void TorrentsMove::Invoke(const TorrentsMoveReq &req, WriteCb<TorrentsMoveRes> cb)
 {
-    auto const& torrents = m_session.Torrents();
-    auto const& handle = torrents.find(req.info_hash);
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
 
-    if (handle == torrents.end())
+    if (torrent == nullptr)
     {
         return cb.Error(-1, "Torrent not found");
     }
@@ -30,7 +29,7 @@ void TorrentsMove::Invoke(const TorrentsMoveReq &req, WriteCb<TorrentsMoveRes> c
         if (req.flags.value() == "fail_if_exist")        flags = lt::move_flags_t::fail_if_exist;
     }
 
-    handle->second.move_storage(req.path, flags);
+    torrent->handle.move_storage(req.path, flags);
 
     return cb.Ok(TorrentsMoveRes{});
 }
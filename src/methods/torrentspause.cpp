@@ -13,15 +13,14 @@ TorrentsPause::TorrentsPause(porla::ISession &session)
 
 void TorrentsPause::Invoke(const TorrentsPauseReq& req, WriteCb<TorrentsPauseRes> cb)
 {
-    auto const& torrents = m_session.Torrents();
-    auto handle = torrents.find(req.info_hash);
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
 
-    if (handle == torrents.end())
+    if (torrent == nullptr)
     {
         return cb.Error(-1, "Torrent not found");
     }
 
-    handle->second.pause();
+    torrent->handle.pause();
 
     cb.Ok(TorrentsPauseRes{});
 }
@@ -15,10 +15,9 @@ TorrentsPeersAdd::TorrentsPeersAdd(porla::ISession& session)
 
 void TorrentsPeersAdd::Invoke(const TorrentsPeersAddReq& req, WriteCb<TorrentsPeersAddRes> cb)
 {
-    auto const& torrents = m_session.Torrents();
-    auto status = torrents.find(req.info_hash);
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
 
-    if (status != torrents.end())
+    if (torrent != nullptr)
     {
         for (auto const& [ip,port] : req.peers)
         {
@@ -31,7 +30,7 @@ void TorrentsPeersAdd::Invoke(const TorrentsPeersAddReq& req, WriteCb<TorrentsPe
                 continue;
             }
 
-            status->second.connect_peer(
+            torrent->handle.connect_peer(
                 boost::asio::ip::tcp::endpoint{addr,port});
         }
     }
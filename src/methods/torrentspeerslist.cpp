@@ -11,16 +11,15 @@ TorrentsPeersList::TorrentsPeersList(porla::ISession& session)
 
 void TorrentsPeersList::Invoke(const TorrentsPeersListReq& req, WriteCb<TorrentsPeersListRes> cb)
 {
-    auto const& torrents = m_session.Torrents();
-    auto const& status = torrents.find(req.info_hash);
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
 
-    if (status == torrents.end())
+    if (torrent == nullptr)
     {
         return cb.Error(-1, "Torrent not found");
     }
 
     std::vector<lt::peer_info> peers;
-    status->second.get_peer_info(peers);
+    torrent->handle.get_peer_info(peers);
 
     cb.Ok(TorrentsPeersListRes{
         .peers = peers
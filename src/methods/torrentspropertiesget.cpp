@@ -13,9 +13,14 @@ TorrentsPropertiesGet::TorrentsPropertiesGet(porla::ISession& session)
 
 void TorrentsPropertiesGet::Invoke(const TorrentsPropertiesGetReq& req, WriteCb<TorrentsPropertiesGetRes> cb)
 {
-    auto const& torrents = m_session.Torrents();
-    auto const& torrent = torrents.find(req.info_hash);
-    auto const& handle = torrent->second;
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
+
+    if (torrent == nullptr)
+    {
+        return cb.Error(-1, "Torrent not found");
+    }
+
+    auto const& handle = torrent->handle;
 
     cb.Ok(TorrentsPropertiesGetRes{
         .download_limit  = handle.download_limit(),
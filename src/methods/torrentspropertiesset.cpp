@@ -13,15 +13,14 @@ TorrentsPropertiesSet::TorrentsPropertiesSet(porla::ISession& session)
 
 void TorrentsPropertiesSet::Invoke(const TorrentsPropertiesSetReq& req, WriteCb<TorrentsPropertiesSetRes> cb)
 {
-    auto& torrents = m_session.Torrents();
-    auto torrent = torrents.find(req.info_hash);
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
 
-    if (torrent == torrents.end())
+    if (torrent == nullptr)
     {
         return cb.Error(-1, "Torrent not found");
     }
 
-    auto& handle = torrent->second;
+    auto const& handle = torrent->handle;
 
     if (auto val = req.download_limit)
         handle.set_download_limit(*val);
@@ -11,51 +11,139 @@ using porla::Methods::TorrentsQuery;
 using porla::Methods::TorrentsQueryReq;
 using porla::Methods::TorrentsQueryRes;
 
+static void AppendString(std::string& out, const char* str)
+{
+    out += json(str).dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
 TorrentsQuery::TorrentsQuery(ISession& session)
     : m_session(session)
 {
 }
 
+static json ColumnValue(sqlite3_stmt* stmt, int i)
+{
+    switch (sqlite3_column_type(stmt, i))
+    {
+    case SQLITE_INTEGER: return sqlite3_column_int64(stmt, i);
+    case SQLITE_FLOAT:   return sqlite3_column_double(stmt, i);
+    case SQLITE_TEXT:    return reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+    case SQLITE_NULL:    return nullptr;
+    default:
+        BOOST_LOG_TRIVIAL(warning) << "Unknown column type: " << sqlite3_column_type(stmt, i);
+        return nullptr;
+    }
+}
+
 void TorrentsQuery::Invoke(const TorrentsQueryReq& req, WriteCb<TorrentsQueryRes> cb)
 {
-    TorrentsQueryRes res;
+    QueryEngine::Request const query{
+        .query  = req.query,
+        .params = req.params.value_or(json()),
+        .cursor = req.cursor,
+        .limit  = req.limit.value_or(0)
+    };
+
+    // The binary encodings are built from a json value, so the rows are
+    // collected in one instead of as text.
+    if (cb.Encoding() != porla::Utils::WireEncoding::Json)
+    {
+        json results = json::array();
+
+        auto const result = m_session.Query(
+            query,
+            [&results](sqlite3_stmt* stmt)
+            {
+                json row = json::object();
 
-    int query_result = m_session.Query(
-        req.query,
-        [&res](sqlite3_stmt* stmt)
+                for (int i = 0; i < sqlite3_column_count(stmt); i++)
+                {
+                    row[sqlite3_column_name(stmt, i)] = ColumnValue(stmt, i);
+                }
+
+                results.push_back(std::move(row));
+            });
+
+        if (result.status != SQLITE_OK)
         {
-            json j;
+            return cb.Error(-1, "Error when querying torrents: " + result.error);
+        }
 
-            for (int i = 0; i < sqlite3_column_count(stmt); i++)
+        json res = {{"results", std::move(results)}};
+        if (result.cursor.has_value()) res["cursor"] = result.cursor.value();
+
+        return cb.Ok(res);
+    }
+
+    // Rows are serialized straight into the response text as they are stepped.
+    // The column names are the same for every row, so they are escaped once.
+    std::string out = R"({"results":[)";
+    std::vector<std::string> keys;
+
+    auto const result = m_session.Query(
+        query,
+        [&out, &keys](sqlite3_stmt* stmt)
+        {
+            if (keys.empty())
             {
-                std::string col_name = sqlite3_column_name(stmt, i);
+                for (int i = 0; i < sqlite3_column_count(stmt); i++)
+                {
+                    std::string key;
+                    AppendString(key, sqlite3_column_name(stmt, i));
+                    key.push_back(':');
+                    keys.push_back(std::move(key));
+                }
+            }
+            else
+            {
+                out.push_back(',');
+            }
+
+            out.push_back('{');
+
+            for (int i = 0; i < static_cast<int>(keys.size()); i++)
+            {
+                if (i > 0) out.push_back(',');
+                out += keys[i];
 
                 switch (sqlite3_column_type(stmt, i))
                 {
                 case SQLITE_INTEGER:
-                    j[col_name] = sqlite3_column_int64(stmt, i);
-                    continue;
+                    out += std::to_string(sqlite3_column_int64(stmt, i));
+                    break;
                 case SQLITE_FLOAT:
-                    j[col_name] = sqlite3_column_double(stmt, i);
-                    continue;
+                    out += json(sqlite3_column_double(stmt, i)).dump();
+                    break;
                 case SQLITE_TEXT:
-                    j[col_name] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
-                    continue;
+                    AppendString(out, reinterpret_cast<const char*>(sqlite3_column_text(stmt, i)));
+                    break;
+                case SQLITE_NULL:
+                    out += "null";
+                    break;
                 default:
                     BOOST_LOG_TRIVIAL(warning) << "Unknown column type: " << sqlite3_column_type(stmt, i);
-                    continue;
+                    out += "null";
+                    break;
                 }
             }
 
-            res.results.push_back(j);
-
-            return 0;
+            out.push_back('}');
         });
 
-    if (query_result != SQLITE_OK)
+    if (result.status != SQLITE_OK)
+    {
+        return cb.Error(-1, "Error when querying torrents: " + result.error);
+    }
+
+    out.push_back(']');
+
+    if (result.cursor.has_value())
     {
-        return cb.Error(-1, "Error when querying torrents");
+        out += R"(,"cursor":)";
+        AppendString(out, result.cursor->c_str());
     }
 
-    return cb.Ok(res);
+    out.push_back('}');
+
+    return cb.OkSerialized(std::move(out));
 }
@@ -1,16 +1,24 @@
 #pragma once
 
+#include <optional>
 #include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
 
 namespace porla::Methods
 {
     struct TorrentsQueryReq
     {
         std::string query;
+        std::optional<nlohmann::json> params;
+        std::optional<std::string> cursor;
+        std::optional<int> limit;
     };
 
     struct TorrentsQueryRes
     {
         std::vector<nlohmann::json> results;
+        std::optional<std::string> cursor;
     };
 }
@@ -16,10 +16,9 @@ TorrentsRecheck::TorrentsRecheck(porla::ISession &session)
 
 void TorrentsRecheck::Invoke(const TorrentsRecheckReq &req, WriteCb<TorrentsRecheckRes> cb)
 {
-    auto const& torrents = m_session.Torrents();
-    auto const& handle = torrents.find(req.info_hash);
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
 
-    if (handle == torrents.end())
+    if (torrent == nullptr)
     {
         return cb.Error(-1, "Torrent not found");
     }
@@ -13,15 +13,14 @@ TorrentsResume::TorrentsResume(porla::ISession& session)
 
 void TorrentsResume::Invoke(const TorrentsResumeReq& req, WriteCb<TorrentsResumeRes> cb)
 {
-    auto const& torrents = m_session.Torrents();
-    auto status = torrents.find(req.info_hash);
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
 
-    if (status == torrents.end())
+    if (torrent == nullptr)
     {
         return cb.Error(-1, "Torrent not found");
     }
 
-    status->second.resume();
+    torrent->handle.resume();
 
     cb.Ok(TorrentsResumeRes{});
 }
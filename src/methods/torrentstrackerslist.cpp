@@ -13,20 +13,19 @@ TorrentsTrackersList::TorrentsTrackersList(porla::ISession& session)
 
 void TorrentsTrackersList::Invoke(const TorrentsTrackersListReq& req, WriteCb<TorrentsTrackersListRes> cb)
 {
-    auto const& torrents = m_session.Torrents();
-    auto const torrent = torrents.find(req.info_hash);
+    auto const torrent = m_session.Torrents().Find(req.info_hash);
 
-    if (torrent == torrents.end())
+    if (torrent == nullptr)
     {
         return cb.Error(-1, "Torrent not found");
     }
 
-    if (!torrent->second.is_valid())
+    if (!torrent->handle.is_valid())
     {
         return cb.Error(-2, "Torrent not valid");
     }
 
     cb.Ok(TorrentsTrackersListRes{
-        .trackers = torrent->second.trackers()
+        .trackers = torrent->handle.trackers()
     });
 }
@@ -1,11 +1,21 @@
 #include "metricshandler.hpp"
 
+#include "data/resumedataqueue.hpp"
+#include "queuelatencyprobe.hpp"
+#include "requestmetrics.hpp"
 #include "session.hpp"
+#include "workerpool.hpp"
 
 using porla::MetricsHandler;
 
-MetricsHandler::MetricsHandler(porla::ISession &session)
-    : m_session(session)
+MetricsHandler::MetricsHandler(const MetricsHandlerOptions& options)
+    : m_http_latency(options.http_latency)
+    , m_http_requests(options.http_requests)
+    , m_resume_data_queue(options.resume_data_queue)
+    , m_rpc_requests(options.rpc_requests)
+    , m_session(options.session)
+    , m_session_latency(options.session_latency)
+    , m_workers(options.workers)
 {
     m_sessionStatsConnection = m_session.OnSessionStats([this](auto s) { OnSessionStats(s); });
 }
@@ -27,6 +37,39 @@ void MetricsHandler::operator()(const std::shared_ptr<porla::HttpContext> &ctx)
         out << "libtorrent_" << key_replaced << " " << val << "\n";
     }
 
+    auto const rdq = m_resume_data_queue.GetStats();
+
+    out << "porla_resume_data_queue_depth " << rdq.depth << "\n";
+    out << "porla_resume_data_flushes_total " << rdq.flushes << "\n";
+    out << "porla_resume_data_flush_duration_last_us " << rdq.flush_duration_last_us << "\n";
+    out << "porla_resume_data_flush_duration_total_us " << rdq.flush_duration_total_us << "\n";
+    out << "porla_resume_data_rows_skipped_total " << rdq.rows_skipped << "\n";
+    out << "porla_resume_data_rows_written_total " << rdq.rows_written << "\n";
+
+    for (auto const& alert : m_session.Alerts().GetStats())
+    {
+        out << "porla_alerts_total{type=\"" << alert.name << "\"} " << alert.count << "\n";
+        out << "porla_alerts_dropped_total{type=\"" << alert.name << "\"} " << alert.dropped << "\n";
+        out << "porla_alert_handler_duration_total_us{type=\"" << alert.name << "\"} " << alert.handler_time_us << "\n";
+    }
+
+    auto const http_latency = m_http_latency.GetStats();
+    auto const session_latency = m_session_latency.GetStats();
+
+    out << "porla_io_queue_latency_last_us{context=\"http\"} " << http_latency.last_us << "\n";
+    out << "porla_io_queue_latency_last_us{context=\"session\"} " << session_latency.last_us << "\n";
+    out << "porla_io_queue_latency_max_us{context=\"http\"} " << http_latency.max_us << "\n";
+    out << "porla_io_queue_latency_max_us{context=\"session\"} " << session_latency.max_us << "\n";
+
+    auto const workers = m_workers.GetStats();
+
+    out << "porla_rpc_workers_completed_total " << workers.completed << "\n";
+    out << "porla_rpc_workers_pending " << workers.pending << "\n";
+    out << "porla_rpc_workers_rejected_total " << workers.rejected << "\n";
+
+    m_http_requests.Write(out, "porla_http_requests", "route");
+    m_rpc_requests.Write(out, "porla_rpc_requests", "method", false);
+
     ctx->Write(out.str());
 }
 
@@ -6,12 +6,31 @@
 
 namespace porla
 {
+    namespace Data
+    {
+        class ResumeDataQueue;
+    }
+
     class ISession;
+    class QueueLatencyProbe;
+    class RequestMetrics;
+    class WorkerPool;
+
+    struct MetricsHandlerOptions
+    {
+        const QueueLatencyProbe& http_latency;
+        const RequestMetrics& http_requests;
+        const Data::ResumeDataQueue& resume_data_queue;
+        const RequestMetrics& rpc_requests;
+        ISession& session;
+        const QueueLatencyProbe& session_latency;
+        const WorkerPool& workers;
+    };
 
     class MetricsHandler
     {
     public:
-        explicit MetricsHandler(ISession& session);
+        explicit MetricsHandler(const MetricsHandlerOptions& options);
         explicit MetricsHandler(const MetricsHandler&) = delete;
         explicit MetricsHandler(const MetricsHandler&&) = delete;
 
@@ -22,7 +41,13 @@ namespace porla
     private:
         void OnSessionStats(const std::map<std::string, int64_t>& stats);
 
+        const QueueLatencyProbe& m_http_latency;
+        const RequestMetrics& m_http_requests;
+        const Data::ResumeDataQueue& m_resume_data_queue;
+        const RequestMetrics& m_rpc_requests;
         ISession& m_session;
+        const QueueLatencyProbe& m_session_latency;
+        const WorkerPool& m_workers;
         boost::signals2::connection m_sessionStatsConnection;
         std::map<std::string, int64_t> m_stats;
     };
@@ -0,0 +1,99 @@
+#include "peersvt.hpp"
+
+#include <libtorrent/peer_info.hpp>
+
+#include "childvt.hpp"
+
+namespace lt = libtorrent;
+
+using porla::PeersVTable;
+
+typedef porla::ChildVTable<lt::peer_info> Table;
+
+static Table::Column Flag(lt::peer_flags_t flag)
+{
+    return [flag](const lt::peer_info& pi, sqlite3_context* ctx)
+    {
+        sqlite3_result_int(ctx, (pi.flags & flag) ? 1 : 0);
+    };
+}
+
+int PeersVTable::Install(sqlite3* db, const porla::TorrentRegistry& torrents)
+{
+    return Table::Install(
+        db,
+        "peers",
+        torrents,
+        {
+            {"ip", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                std::string ip = pi.ip.address().to_string();
+                sqlite3_result_text(ctx, ip.c_str(), -1, SQLITE_TRANSIENT);
+            }},
+            {"port", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.ip.port());
+            }},
+            {"client", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_text(ctx, pi.client.c_str(), -1, SQLITE_TRANSIENT);
+            }},
+            {"connection_type", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, static_cast<uint8_t>(pi.connection_type));
+            }},
+            {"flags", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int64(ctx, static_cast<uint32_t>(pi.flags));
+            }},
+            {"source", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, static_cast<uint8_t>(pi.source));
+            }},
+            {"interesting",       Flag(lt::peer_info::interesting)},
+            {"choked",            Flag(lt::peer_info::choked)},
+            {"remote_interested", Flag(lt::peer_info::remote_interested)},
+            {"remote_choked",     Flag(lt::peer_info::remote_choked)},
+            {"seed",              Flag(lt::peer_info::seed)},
+            {"down_speed", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.down_speed);
+            }},
+            {"up_speed", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.up_speed);
+            }},
+            {"payload_down_speed", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.payload_down_speed);
+            }},
+            {"payload_up_speed", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.payload_up_speed);
+            }},
+            {"total_download", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int64(ctx, pi.total_download);
+            }},
+            {"total_upload", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int64(ctx, pi.total_upload);
+            }},
+            {"progress", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_double(ctx, pi.progress);
+            }},
+            {"num_pieces", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.num_pieces);
+            }},
+            {"rtt", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.rtt);
+            }},
+            {"failcount", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.failcount);
+            }},
+            {"num_hashfails", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.num_hashfails);
+            }},
+            {"download_queue_length", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.download_queue_length);
+            }},
+            {"upload_queue_length", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, pi.upload_queue_length);
+            }},
+            {"last_active", [](const lt::peer_info& pi, sqlite3_context* ctx) {
+                sqlite3_result_int64(ctx, lt::total_seconds(pi.last_active));
+            }},
+        },
+        [](const porla::TorrentRegistry::Entry& entry, std::vector<lt::peer_info>& rows)
+        {
+            entry.handle.get_peer_info(rows);
+        });
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <sqlite3.h>
+
+#include "torrentregistry.hpp"
+
+namespace porla
+{
+    class PeersVTable
+    {
+    public:
+        static int Install(sqlite3* db, const TorrentRegistry& torrents);
+    };
+}
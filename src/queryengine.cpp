@@ -0,0 +1,269 @@
+#include "queryengine.hpp"
+
+#include <sstream>
+
+#include <boost/log/trivial.hpp>
+
+using json = nlohmann::json;
+
+using porla::QueryEngine;
+
+// The number of VM instructions between each call to the progress handler.
+static constexpr int ProgressInterval = 1000;
+
+// Cursors are "<offset>:<digest>", where the digest is of the query and its
+// parameters so a cursor can not be used to continue another query.
+static std::string Digest(const std::string& query, const json& params)
+{
+    std::size_t seed = std::hash<std::string>{}(query);
+    seed ^= std::hash<std::string>{}(params.dump()) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+
+    std::stringstream ss;
+    ss << std::hex << seed;
+    return ss.str();
+}
+
+static bool ParseCursor(const std::string& cursor, const std::string& digest, std::int64_t& offset)
+{
+    auto const sep = cursor.find(':');
+
+    if (sep == std::string::npos || sep == 0 || cursor.substr(sep + 1) != digest)
+    {
+        return false;
+    }
+
+    try
+    {
+        std::size_t pos = 0;
+        offset = std::stoll(cursor.substr(0, sep), &pos);
+        return pos == sep && offset >= 0;
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+}
+
+static int Bind(sqlite3_stmt* stmt, int idx, const json& value)
+{
+    switch (value.type())
+    {
+    case json::value_t::null:
+        return sqlite3_bind_null(stmt, idx);
+    case json::value_t::boolean:
+        return sqlite3_bind_int(stmt, idx, value.get<bool>() ? 1 : 0);
+    case json::value_t::number_integer:
+    case json::value_t::number_unsigned:
+        return sqlite3_bind_int64(stmt, idx, value.get<sqlite3_int64>());
+    case json::value_t::number_float:
+        return sqlite3_bind_double(stmt, idx, value.get<double>());
+    case json::value_t::string:
+    {
+        auto const& str = value.get_ref<const std::string&>();
+        return sqlite3_bind_text(stmt, idx, str.c_str(), static_cast<int>(str.size()), SQLITE_TRANSIENT);
+    }
+    default:
+        return SQLITE_MISMATCH;
+    }
+}
+
+QueryEngine::QueryEngine(const QueryEngineOptions& options)
+    : m_db(options.db)
+    , m_cache_size(std::max<std::size_t>(options.cache_size, 1))
+    , m_max_steps(options.max_steps)
+    , m_timeout(options.timeout)
+    , m_running(false)
+    , m_exceeded(false)
+    , m_steps(0)
+{
+    sqlite3_progress_handler(m_db, ProgressInterval, &OnProgress, this);
+}
+
+QueryEngine::~QueryEngine()
+{
+    sqlite3_progress_handler(m_db, 0, nullptr, nullptr);
+
+    for (auto const& entry : m_lru)
+    {
+        sqlite3_finalize(entry.stmt);
+    }
+}
+
+QueryEngine::Result QueryEngine::Run(const Request& req, const RowCb& cb)
+{
+    Result result{
+        .status = SQLITE_OK,
+        .rows   = 0
+    };
+
+    if (!req.params.is_null() && !req.params.is_array())
+    {
+        result.status = SQLITE_MISUSE;
+        result.error  = "Query parameters must be an array";
+        return result;
+    }
+
+    std::string const digest = Digest(req.query, req.params);
+    std::int64_t offset = 0;
+
+    if (req.cursor.has_value() && !ParseCursor(req.cursor.value(), digest, offset))
+    {
+        result.status = SQLITE_MISUSE;
+        result.error  = "Invalid cursor";
+        return result;
+    }
+
+    sqlite3_stmt* stmt = Prepare(req.query, result.error);
+
+    if (stmt == nullptr)
+    {
+        result.status = SQLITE_ERROR;
+        return result;
+    }
+
+    if (req.params.is_array())
+    {
+        if (static_cast<int>(req.params.size()) != sqlite3_bind_parameter_count(stmt))
+        {
+            result.status = SQLITE_RANGE;
+            result.error  = "Expected " + std::to_string(sqlite3_bind_parameter_count(stmt)) + " query parameter(s)";
+            return result;
+        }
+
+        for (std::size_t i = 0; i < req.params.size(); i++)
+        {
+            if (Bind(stmt, static_cast<int>(i) + 1, req.params[i]) != SQLITE_OK)
+            {
+                sqlite3_clear_bindings(stmt);
+
+                result.status = SQLITE_MISMATCH;
+                result.error  = "Unsupported type of query parameter " + std::to_string(i + 1);
+                return result;
+            }
+        }
+    }
+
+    int const limit = req.limit > 0 ? std::min(req.limit, MaxLimit) : MaxLimit;
+
+    m_running  = true;
+    m_exceeded = false;
+    m_steps    = 0;
+    m_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_timeout);
+
+    std::int64_t skipped = 0;
+    int res;
+
+    while ((res = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        if (skipped < offset)
+        {
+            skipped++;
+            continue;
+        }
+
+        // One row past the limit tells us there are more rows, which the
+        // next run picks up from.
+        if (result.rows == limit)
+        {
+            result.cursor = std::to_string(offset + result.rows) + ":" + digest;
+            break;
+        }
+
+        cb(stmt);
+        result.rows++;
+    }
+
+    m_running = false;
+
+    if (res != SQLITE_ROW && res != SQLITE_DONE)
+    {
+        result.status = res;
+        result.error  = m_exceeded
+            ? "Query exceeded its time or step budget"
+            : sqlite3_errmsg(m_db);
+
+        BOOST_LOG_TRIVIAL(warning) << "Torrents query failed: " << result.error;
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    return result;
+}
+
+int QueryEngine::OnProgress(void* user)
+{
+    auto self = static_cast<QueryEngine*>(user);
+
+    if (!self->m_running)
+    {
+        return 0;
+    }
+
+    self->m_steps += ProgressInterval;
+
+    if ((self->m_max_steps > 0 && self->m_steps > self->m_max_steps)
+        || (self->m_timeout > 0 && std::chrono::steady_clock::now() > self->m_deadline))
+    {
+        self->m_exceeded = true;
+        return 1;
+    }
+
+    return 0;
+}
+
+sqlite3_stmt* QueryEngine::Prepare(const std::string_view& query, std::string& error)
+{
+    if (auto existing = m_entries.find(query); existing != m_entries.end())
+    {
+        m_lru.splice(m_lru.begin(), m_lru, existing->second);
+        return existing->second->stmt;
+    }
+
+    sqlite3_stmt* stmt = nullptr;
+
+    int res = sqlite3_prepare_v3(
+        m_db,
+        query.data(),
+        static_cast<int>(query.size()),
+        SQLITE_PREPARE_PERSISTENT,
+        &stmt,
+        nullptr);
+
+    if (res != SQLITE_OK)
+    {
+        error = sqlite3_errmsg(m_db);
+        BOOST_LOG_TRIVIAL(error) << "Failed to prepare torrents query: " << error;
+        return nullptr;
+    }
+
+    if (stmt == nullptr)
+    {
+        error = "Empty query";
+        return nullptr;
+    }
+
+    if (!sqlite3_stmt_readonly(stmt))
+    {
+        sqlite3_finalize(stmt);
+        error = "Only read-only queries are allowed";
+        return nullptr;
+    }
+
+    if (m_lru.size() >= m_cache_size)
+    {
+        auto& oldest = m_lru.back();
+        m_entries.erase(oldest.query);
+        sqlite3_finalize(oldest.stmt);
+        m_lru.pop_back();
+    }
+
+    m_lru.push_front(Entry{
+        .query = std::string(query),
+        .stmt  = stmt
+    });
+
+    m_entries.insert({ m_lru.front().query, m_lru.begin() });
+
+    return stmt;
+}
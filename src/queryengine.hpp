@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <nlohmann/json.hpp>
+#include <sqlite3.h>
+
+namespace porla
+{
+    struct QueryEngineOptions
+    {
+        sqlite3* db = nullptr;
+        std::size_t cache_size = 32;
+        int max_steps = 10000000;
+        int timeout = 5000;
+    };
+
+    /*
+     * Runs read-only queries against the virtual torrents database. Prepared
+     * statements are kept in an LRU cache keyed on the SQL text, and each run
+     * is bounded by a VM step budget and a wall-clock budget which are checked
+     * from the SQLite progress handler.
+     *
+     * A run returns at most `limit` rows. If there are more, the result has a
+     * cursor which continues the query from the row after the last one. The
+     * statement is reset between runs since the virtual tables read the live
+     * registry, so a continued query is executed again and the rows before the
+     * cursor are stepped past without being read.
+     */
+    class QueryEngine
+    {
+    public:
+        static constexpr int MaxLimit = 10000;
+
+        struct Request
+        {
+            std::string query;
+            nlohmann::json params;
+            std::optional<std::string> cursor;
+            int limit;
+        };
+
+        struct Result
+        {
+            int status;
+            std::string error;
+            std::optional<std::string> cursor;
+            std::int64_t rows;
+        };
+
+        typedef std::function<void(sqlite3_stmt*)> RowCb;
+
+        explicit QueryEngine(const QueryEngineOptions& options);
+        QueryEngine(const QueryEngine&) = delete;
+        QueryEngine& operator=(const QueryEngine&) = delete;
+
+        ~QueryEngine();
+
+        Result Run(const Request& req, const RowCb& cb);
+
+    private:
+        struct Entry
+        {
+            std::string query;
+            sqlite3_stmt* stmt;
+        };
+
+        static int OnProgress(void* user);
+
+        sqlite3_stmt* Prepare(const std::string_view& query, std::string& error);
+
+        sqlite3* m_db;
+        std::size_t m_cache_size;
+        int m_max_steps;
+        int m_timeout;
+
+        // Most recently used first.
+        std::list<Entry> m_lru;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> m_entries;
+
+        // The budget of the run in progress.
+        bool m_running;
+        bool m_exceeded;
+        std::int64_t m_steps;
+        std::chrono::steady_clock::time_point m_deadline;
+    };
+}
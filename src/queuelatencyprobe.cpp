@@ -0,0 +1,65 @@
+#include "queuelatencyprobe.hpp"
+
+#include <boost/log/trivial.hpp>
+
+using porla::QueueLatencyProbe;
+
+QueueLatencyProbe::QueueLatencyProbe(boost::asio::io_context& io, int interval)
+    : m_io(io)
+    , m_timer(io)
+    , m_interval(interval)
+{
+    ScheduleSample();
+}
+
+QueueLatencyProbe::~QueueLatencyProbe()
+{
+    boost::system::error_code ec;
+    m_timer.cancel(ec);
+}
+
+QueueLatencyProbe::Stats QueueLatencyProbe::GetStats() const
+{
+    return Stats{
+        .last_us = m_last_us,
+        .max_us  = m_max_us
+    };
+}
+
+void QueueLatencyProbe::ScheduleSample()
+{
+    boost::system::error_code ec;
+    m_timer.expires_from_now(boost::posix_time::milliseconds(m_interval), ec);
+
+    if (ec)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Failed to set queue latency timer expiry: " << ec.message();
+        return;
+    }
+
+    m_timer.async_wait(
+        [this](boost::system::error_code ec)
+        {
+            if (ec == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+
+            auto const posted = std::chrono::steady_clock::now();
+
+            boost::asio::post(
+                m_io,
+                [this, posted]()
+                {
+                    std::uint64_t const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - posted).count();
+
+                    m_last_us = elapsed;
+
+                    std::uint64_t max = m_max_us;
+                    while (elapsed > max && !m_max_us.compare_exchange_weak(max, elapsed)) {}
+
+                    ScheduleSample();
+                });
+        });
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <boost/asio.hpp>
+
+namespace porla
+{
+    /*
+     * Measures how long a handler posted to an io_context waits before it runs.
+     * A sample is taken every interval, and the last and the largest observed
+     * delays are kept.
+     */
+    class QueueLatencyProbe
+    {
+    public:
+        struct Stats
+        {
+            std::uint64_t last_us;
+            std::uint64_t max_us;
+        };
+
+        explicit QueueLatencyProbe(boost::asio::io_context& io, int interval = 1000);
+        QueueLatencyProbe(const QueueLatencyProbe&) = delete;
+        QueueLatencyProbe& operator=(const QueueLatencyProbe&) = delete;
+
+        ~QueueLatencyProbe();
+
+        [[nodiscard]] Stats GetStats() const;
+
+    private:
+        void ScheduleSample();
+
+        boost::asio::io_context& m_io;
+        boost::asio::deadline_timer m_timer;
+        int m_interval;
+
+        std::atomic_uint64_t m_last_us{0};
+        std::atomic_uint64_t m_max_us{0};
+    };
+}
@@ -0,0 +1,115 @@
+#include "requestmetrics.hpp"
+
+using porla::RequestMetrics;
+
+static constexpr const char* Other = "other";
+
+void RequestMetrics::Series::Begin()
+{
+    m_in_flight.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RequestMetrics::Series::End(
+    std::chrono::steady_clock::duration elapsed,
+    int error,
+    std::uint64_t request_bytes,
+    std::uint64_t response_bytes)
+{
+    auto const us = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+
+    m_in_flight.fetch_sub(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_duration_us.fetch_add(us, std::memory_order_relaxed);
+    m_request_bytes.fetch_add(request_bytes, std::memory_order_relaxed);
+    m_response_bytes.fetch_add(response_bytes, std::memory_order_relaxed);
+
+    // Buckets are counted non-cumulatively here and summed when written.
+    for (std::size_t i = 0; i < Buckets.size(); i++)
+    {
+        if (us <= Buckets[i])
+        {
+            m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    if (error == 0)
+    {
+        return;
+    }
+
+    for (std::size_t i = 0; i < ErrorSlots; i++)
+    {
+        int code = m_errors[i].code.load(std::memory_order_relaxed);
+
+        if (code == 0 && m_errors[i].code.compare_exchange_strong(code, error, std::memory_order_relaxed))
+        {
+            code = error;
+        }
+
+        if (code == error)
+        {
+            m_errors[i].count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    m_errors[ErrorSlots].count.fetch_add(1, std::memory_order_relaxed);
+}
+
+RequestMetrics::RequestMetrics(const std::vector<std::string>& labels)
+{
+    for (auto const& label : labels)
+    {
+        m_series.emplace(label, std::make_shared<Series>());
+    }
+
+    m_series.emplace(Other, std::make_shared<Series>());
+}
+
+std::shared_ptr<RequestMetrics::Series> RequestMetrics::Get(std::string_view label)
+{
+    auto series = m_series.find(label);
+    if (series == m_series.end()) series = m_series.find(Other);
+    return series->second;
+}
+
+void RequestMetrics::Write(std::ostream& out, const std::string& prefix, const std::string& label_name, bool sizes) const
+{
+    for (auto const& [label, series] : m_series)
+    {
+        std::string const l = label_name + "=\"" + label + "\"";
+
+        out << prefix << "_in_flight{" << l << "} " << series->m_in_flight.load() << "\n";
+
+        std::uint64_t cumulative = 0;
+
+        for (std::size_t i = 0; i < Series::Buckets.size(); i++)
+        {
+            cumulative += series->m_buckets[i].load();
+            out << prefix << "_duration_seconds_bucket{" << l << ",le=\"" << static_cast<double>(Series::Buckets[i]) / 1000000 << "\"} " << cumulative << "\n";
+        }
+
+        out << prefix << "_duration_seconds_bucket{" << l << ",le=\"+Inf\"} " << series->m_count.load() << "\n";
+        out << prefix << "_duration_seconds_sum{" << l << "} " << static_cast<double>(series->m_duration_us.load()) / 1000000 << "\n";
+        out << prefix << "_duration_seconds_count{" << l << "} " << series->m_count.load() << "\n";
+
+        if (sizes)
+        {
+            out << prefix << "_request_bytes_total{" << l << "} " << series->m_request_bytes.load() << "\n";
+            out << prefix << "_response_bytes_total{" << l << "} " << series->m_response_bytes.load() << "\n";
+        }
+
+        for (std::size_t i = 0; i < series->m_errors.size(); i++)
+        {
+            auto const count = series->m_errors[i].count.load();
+            if (count == 0) continue;
+
+            auto const code = i < Series::ErrorSlots
+                ? std::to_string(series->m_errors[i].code.load())
+                : std::string(Other);
+
+            out << prefix << "_errors_total{" << l << ",code=\"" << code << "\"} " << count << "\n";
+        }
+    }
+}
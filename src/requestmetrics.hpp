@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace porla
+{
+    /*
+     * Latency histograms, error counters, request and response sizes and
+     * in-flight gauges for a fixed set of labels, such as the JSON-RPC methods
+     * or the HTTP routes. The labels are given up front so recording only
+     * touches atomics. Requests for any other label are counted as "other".
+     *
+     * The series are shared with the requests recording in them, which may
+     * outlive the metrics when their handlers are destroyed at shutdown.
+     */
+    class RequestMetrics
+    {
+    public:
+        class Series
+        {
+        public:
+            void Begin();
+
+            // The error is a JSON-RPC error code or an HTTP status of 400 or
+            // more, and zero for requests which succeeded.
+            void End(
+                std::chrono::steady_clock::duration elapsed,
+                int error,
+                std::uint64_t request_bytes = 0,
+                std::uint64_t response_bytes = 0);
+
+        private:
+            friend class RequestMetrics;
+
+            // Upper bounds of the latency buckets, in microseconds.
+            static constexpr std::array<std::uint64_t, 12> Buckets = {
+                500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 5000000
+            };
+
+            // Errors are counted per code in a small table which codes are
+            // added to as they are seen. Codes which do not fit are counted in
+            // the last slot, and written with code "other".
+            struct ErrorSlot
+            {
+                std::atomic_int code{0};
+                std::atomic_uint64_t count{0};
+            };
+
+            static constexpr std::size_t ErrorSlots = 16;
+
+            std::atomic_int64_t m_in_flight{0};
+            std::atomic_uint64_t m_count{0};
+            std::atomic_uint64_t m_duration_us{0};
+            std::array<std::atomic_uint64_t, Buckets.size()> m_buckets{};
+            std::atomic_uint64_t m_request_bytes{0};
+            std::atomic_uint64_t m_response_bytes{0};
+            std::array<ErrorSlot, ErrorSlots + 1> m_errors{};
+        };
+
+        explicit RequestMetrics(const std::vector<std::string>& labels);
+        RequestMetrics(const RequestMetrics&) = delete;
+        RequestMetrics& operator=(const RequestMetrics&) = delete;
+
+        std::shared_ptr<Series> Get(std::string_view label);
+
+        // Writes the series in the Prometheus text format, as <prefix>_* with
+        // the label named by label_name. Sizes are left out for series which
+        // do not record them.
+        void Write(std::ostream& out, const std::string& prefix, const std::string& label_name, bool sizes = true) const;
+
+    private:
+        std::map<std::string, std::shared_ptr<Series>, std::less<>> m_series;
+    };
+}
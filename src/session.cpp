@@ -1,9 +1,13 @@
 #include "session.hpp"
 
 #include <fstream>
+#include <semaphore>
+#include <thread>
+#include <unordered_set>
 
 #include <boost/log/trivial.hpp>
 #include <libtorrent/alert_types.hpp>
+#include <libtorrent/error_code.hpp>
 #include <libtorrent/extensions/ut_metadata.hpp>
 #include <libtorrent/extensions/ut_pex.hpp>
 #include <libtorrent/extensions/smart_ban.hpp>
@@ -11,14 +15,17 @@
 #include <utility>
 
 #include "data/models/addtorrentparams.hpp"
-#include "data/models/torrentsmetadata.hpp"
+#include "filesvt.hpp"
+#include "metadatavt.hpp"
+#include "peersvt.hpp"
 #include "torrentsvt.hpp"
+#include "trackersvt.hpp"
 
 namespace fs = std::filesystem;
 namespace lt = libtorrent;
+using json = nlohmann::json;
 
 using porla::Data::Models::AddTorrentParams;
-using porla::Data::Models::TorrentsMetadata;
 using porla::Session;
 
 template<typename T>
@@ -91,6 +98,395 @@ private:
     std::function<void()> m_callback;
 };
 
+/*
+ * Loads the torrents from storage in three stages. Rows are streamed out of
+ * SQLite on a worker thread, over a read-only connection which is closed when
+ * they have all been read, and handed in batches to a thread pool where the
+ * resume data is decoded. Decoded batches are posted back to the io thread,
+ * reordered to keep the queue positions and added to the session with
+ * async_add_torrent. The handles are collected from the add_torrent_alert, or
+ * from the session if those alerts were dropped.
+ */
+class Session::Loader
+{
+public:
+    explicit Loader(Session& session, int total)
+        : m_session(session)
+        , m_pool(std::max(1u, std::thread::hardware_concurrency()) + 1)
+        , m_slots(MaxBatchesInFlight)
+        , m_total(total)
+    {
+    }
+
+    Loader(const Loader&) = delete;
+    Loader& operator=(const Loader&) = delete;
+
+    ~Loader()
+    {
+        m_cancelled = true;
+
+        m_pool.stop();
+        m_pool.join();
+    }
+
+    [[nodiscard]] int Current() const { return m_current; }
+    [[nodiscard]] bool Finished() const { return m_finished; }
+    [[nodiscard]] int Total() const { return m_total; }
+
+    void Start()
+    {
+        boost::asio::post(m_pool, [this]() { Read(); });
+    }
+
+    void OnTorrentAdded(const lt::add_torrent_alert* ata)
+    {
+        auto const adding = m_adding.find(HashOf(ata->params));
+
+        // Already counted when reconciling after dropped alerts.
+        if (adding == m_adding.end())
+        {
+            return;
+        }
+
+        m_adding.erase(adding);
+
+        m_current++;
+        m_outstanding--;
+
+        AddDecoded();
+
+        if (ata->error)
+        {
+            BOOST_LOG_TRIVIAL(error) << "Failed to add torrent " << ata->params.name << ": " << ata->error.message();
+        }
+        else
+        {
+            // Keep a minimal status for the torrent until the registry is seeded
+            // when all torrents are loaded.
+            lt::torrent_status ts;
+            ts.handle = ata->handle;
+            ts.info_hashes = ata->handle.info_hashes();
+            ts.name = ata->params.name;
+            ts.save_path = ata->params.save_path;
+
+            if (m_session.m_torrents.Find(ts.info_hashes) == nullptr)
+            {
+                m_session.m_torrents.Insert(ts);
+            }
+        }
+
+        if (m_current % 1000 == 0 && m_current != m_total)
+        {
+            BOOST_LOG_TRIVIAL(info) << m_current << " torrents (of " << m_total << ") added";
+        }
+
+        MaybeFinish();
+    }
+
+    // Without their add_torrent_alert we would never know when loading is done,
+    // so the torrents still being added are looked up in the session instead.
+    // The session answers after it has handled every add posted before, so the
+    // ones it does not have failed.
+    void OnAddsDropped()
+    {
+        if (m_finished || m_adding.empty())
+        {
+            return;
+        }
+
+        int added = 0;
+
+        for (auto const& th : m_session.m_session->get_torrents())
+        {
+            auto const hash = th.info_hashes();
+            auto const adding = m_adding.find(hash);
+
+            if (adding == m_adding.end())
+            {
+                continue;
+            }
+
+            m_adding.erase(adding);
+
+            lt::torrent_status ts;
+            ts.handle = th;
+            ts.info_hashes = hash;
+
+            if (m_session.m_torrents.Find(hash) == nullptr)
+            {
+                m_session.m_torrents.Insert(ts);
+            }
+
+            added++;
+        }
+
+        BOOST_LOG_TRIVIAL(warning) << "Lost the alerts of " << m_outstanding << " torrent(s) being added, "
+                                   << added << " of them were added";
+
+        m_current += m_outstanding;
+        m_outstanding = 0;
+        m_adding.clear();
+
+        AddDecoded();
+        MaybeFinish();
+    }
+
+private:
+    static constexpr std::size_t BatchSize = 256;
+    static constexpr std::ptrdiff_t MaxBatchesInFlight = 64;
+
+    struct Batch
+    {
+        int failed;
+        std::vector<lt::add_torrent_params> params;
+    };
+
+    static lt::info_hash_t HashOf(const lt::add_torrent_params& atp)
+    {
+        return atp.ti ? atp.ti->info_hashes() : atp.info_hashes;
+    }
+
+    // Runs on the pool.
+    void Read()
+    {
+        std::uint64_t seq = 0;
+        std::vector<AddTorrentParams::Blob> batch;
+        batch.reserve(BatchSize);
+
+        auto const dispatch = [&]()
+        {
+            // Wait for a free slot so a slow session does not make us buffer
+            // every blob in memory.
+            while (!m_slots.try_acquire_for(std::chrono::milliseconds(100)))
+            {
+                if (m_cancelled) return false;
+            }
+
+            boost::asio::post(
+                m_pool,
+                [this, seq = seq++, blobs = std::move(batch)]()
+                {
+                    Decode(seq, blobs);
+                });
+
+            batch = {};
+            batch.reserve(BatchSize);
+
+            return true;
+        };
+
+        // Read on a connection of our own. A statement open on the session's
+        // connection would join the transactions of the resume data queue,
+        // and its commits would fail while we step it.
+        sqlite3* db = OpenReader();
+
+        if (db == nullptr)
+        {
+            return Finish(seq);
+        }
+
+        try
+        {
+            AddTorrentParams::ForEachBlob(
+                db,
+                [&](AddTorrentParams::Blob&& blob)
+                {
+                    if (m_cancelled) return false;
+
+                    batch.push_back(std::move(blob));
+
+                    return batch.size() < BatchSize || dispatch();
+                });
+
+            if (!batch.empty())
+            {
+                dispatch();
+            }
+        }
+        catch (const std::exception& ex)
+        {
+            BOOST_LOG_TRIVIAL(error) << "Failed to read torrents from storage: " << ex.what();
+        }
+
+        if (sqlite3_close(db) != SQLITE_OK)
+        {
+            BOOST_LOG_TRIVIAL(error) << "Failed to close database: " << sqlite3_errmsg(db);
+        }
+
+        Finish(seq);
+    }
+
+    // Runs on the pool.
+    sqlite3* OpenReader()
+    {
+        char const* filename = sqlite3_db_filename(m_session.m_db, "main");
+
+        if (filename == nullptr || filename[0] == '\0')
+        {
+            BOOST_LOG_TRIVIAL(error) << "Failed to read torrents from storage: the database has no file";
+            return nullptr;
+        }
+
+        sqlite3* db = nullptr;
+
+        if (sqlite3_open_v2(filename, &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK)
+        {
+            BOOST_LOG_TRIVIAL(error) << "Failed to open database for reading: " << sqlite3_errmsg(db);
+            sqlite3_close(db);
+            return nullptr;
+        }
+
+        return db;
+    }
+
+    // Runs on the pool.
+    void Finish(std::uint64_t batches)
+    {
+        boost::asio::post(
+            m_session.m_io,
+            [this, batches]()
+            {
+                m_batches = batches;
+                MaybeFinish();
+            });
+    }
+
+    // Runs on the pool.
+    void Decode(std::uint64_t seq, const std::vector<AddTorrentParams::Blob>& blobs)
+    {
+        if (m_cancelled) return;
+
+        Batch batch{ .failed = 0 };
+        batch.params.reserve(blobs.size());
+
+        for (auto const& blob : blobs)
+        {
+            lt::add_torrent_params atp;
+
+            if (!AddTorrentParams::Decode(blob, atp))
+            {
+                batch.failed++;
+                continue;
+            }
+
+            atp.userdata = lt::client_data_t(this);
+            batch.params.push_back(std::move(atp));
+        }
+
+        boost::asio::post(
+            m_session.m_io,
+            [this, seq, batch = std::move(batch)]() mutable
+            {
+                OnDecoded(seq, std::move(batch));
+            });
+    }
+
+    void OnDecoded(std::uint64_t seq, Batch batch)
+    {
+        m_decoded.insert({ seq, std::move(batch) });
+
+        AddDecoded();
+        MaybeFinish();
+    }
+
+    void AddDecoded()
+    {
+        // Each torrent we add posts an add_torrent_alert. Keep the number of
+        // outstanding adds well below the alert queue size so we do not lose
+        // any of them, since we would never know when loading is done.
+        int const limit = std::max(m_session.m_alert_queue_size / 2, static_cast<int>(BatchSize));
+
+        // Batches are decoded out of order, but torrents must be added in the
+        // order they were read to keep their queue positions.
+        for (auto it = m_decoded.find(m_next);
+             it != m_decoded.end() && m_outstanding < limit;
+             it = m_decoded.find(m_next))
+        {
+            m_current += it->second.failed;
+
+            for (auto& atp : it->second.params)
+            {
+                m_adding.insert(HashOf(atp));
+                m_session.m_session->async_add_torrent(std::move(atp));
+                m_outstanding++;
+            }
+
+            m_decoded.erase(it);
+            m_next++;
+            m_slots.release();
+        }
+    }
+
+    void MaybeFinish()
+    {
+        if (m_finished
+            || !m_batches.has_value()
+            || m_next < m_batches.value()
+            || m_outstanding > 0)
+        {
+            return;
+        }
+
+        m_finished = true;
+        m_pool.join();
+
+        if (m_total > 0)
+        {
+            BOOST_LOG_TRIVIAL(info) << "Added " << m_current << " (of " << m_total << ") torrent(s) to session";
+        }
+
+        m_total = m_current;
+
+        // Seed the registry with a single round trip to the session. After this,
+        // the statuses are kept up-to-date by the state updates we receive.
+        std::vector<lt::torrent_status> statuses;
+        m_session.m_session->get_torrent_status(&statuses, [](auto const&) { return true; }, TorrentRegistry::StatusFlags);
+
+        for (auto const& ts : statuses)
+        {
+            m_session.m_torrents.Insert(ts);
+        }
+
+        // Index the category and tags of every torrent.
+        try
+        {
+            m_session.m_metadata.ForEachKey(
+                "category",
+                [this](const lt::info_hash_t& hash, const json& value)
+                {
+                    if (value.is_string()) m_session.m_torrents.SetCategory(hash, value.get<std::string>());
+                });
+
+            m_session.m_metadata.ForEachKey(
+                "tags",
+                [this](const lt::info_hash_t& hash, const json& value)
+                {
+                    if (value.is_array()) m_session.m_torrents.SetTags(hash, value.get<std::vector<std::string>>());
+                });
+        }
+        catch (const std::exception& ex)
+        {
+            BOOST_LOG_TRIVIAL(error) << "Failed to read torrent metadata: " << ex.what();
+        }
+    }
+
+    Session& m_session;
+    boost::asio::thread_pool m_pool;
+    std::counting_semaphore<MaxBatchesInFlight> m_slots;
+    std::atomic_bool m_cancelled = false;
+
+    // Only accessed from the io thread.
+    std::map<std::uint64_t, Batch> m_decoded;
+    std::optional<std::uint64_t> m_batches;
+    // The same torrent may be stored twice, and the second add fails.
+    std::unordered_multiset<lt::info_hash_t> m_adding;
+    std::uint64_t m_next = 0;
+    int m_current = 0;
+    int m_outstanding = 0;
+    int m_total;
+    bool m_finished = false;
+};
+
 static lt::session_params ReadSessionParams(const fs::path& file)
 {
     if (fs::exists(file))
@@ -148,9 +544,29 @@ Session::Session(boost::asio::io_context& io, porla::SessionOptions const& optio
     , m_session_params_file(options.session_params_file)
     , m_stats(lt::session_stats_metrics())
     , m_tdb(nullptr)
+    , m_metadata(options.metadata)
+    , m_resume_data_queue(options.resume_data_queue)
+    , m_shutdown_timeout(options.shutdown_timeout)
 {
+    m_alerts.Subscribe<lt::add_torrent_alert>([this](auto a) { OnAddTorrentAlert(a); });
+    m_alerts.Subscribe<lt::alerts_dropped_alert>([this](auto a) { OnAlertsDroppedAlert(a); });
+    m_alerts.Subscribe<lt::metadata_received_alert>([this](auto a) { OnMetadataReceivedAlert(a); });
+    m_alerts.Subscribe<lt::save_resume_data_alert>([this](auto a) { OnSaveResumeDataAlert(a); });
+    m_alerts.Subscribe<lt::save_resume_data_failed_alert>([this](auto a) { OnSaveResumeDataFailedAlert(a); });
+    m_alerts.Subscribe<lt::session_stats_alert>([this](auto a) { OnSessionStatsAlert(a); });
+    m_alerts.Subscribe<lt::state_update_alert>([this](auto a) { OnStateUpdateAlert(a); });
+    m_alerts.Subscribe<lt::storage_moved_alert>([this](auto a) { OnStorageMovedAlert(a); });
+    m_alerts.Subscribe<lt::torrent_checked_alert>([this](auto a) { OnTorrentCheckedAlert(a); });
+    m_alerts.Subscribe<lt::torrent_finished_alert>([this](auto a) { OnTorrentFinishedAlert(a); });
+    m_alerts.Subscribe<lt::torrent_paused_alert>([this](auto a) { OnTorrentPausedAlert(a); });
+    m_alerts.Subscribe<lt::torrent_removed_alert>([this](auto a) { OnTorrentRemovedAlert(a); });
+    m_alerts.Subscribe<lt::torrent_resumed_alert>([this](auto a) { OnTorrentResumedAlert(a); });
+
     lt::session_params params = ReadSessionParams(m_session_params_file);
     params.settings = options.settings;
+    params.settings.set_int(lt::settings_pack::alert_mask, m_alerts.Mask());
+
+    m_alert_queue_size = params.settings.get_int(lt::settings_pack::alert_queue_size);
 
     m_session = std::make_unique<lt::session>(std::move(params));
 
@@ -172,6 +588,16 @@ Session::Session(boost::asio::io_context& io, porla::SessionOptions const& optio
         m_session->add_extension(&lt::create_smart_ban_plugin);
     }
 
+    // Components subscribing to alerts after the session is created might need
+    // categories we do not already receive.
+    m_alerts.OnMaskChanged(
+        [this](lt::alert_category_t mask)
+        {
+            lt::settings_pack settings;
+            settings.set_int(lt::settings_pack::alert_mask, mask);
+            m_session->apply_settings(settings);
+        });
+
     m_session->set_alert_notify(
         [this]()
         {
@@ -185,7 +611,7 @@ Session::Session(boost::asio::io_context& io, porla::SessionOptions const& optio
         m_timers.emplace_back(m_io, options.timer_session_stats, [&]() { m_session->post_session_stats(); });
 
     if (options.timer_torrent_updates > 0)
-        m_timers.emplace_back(m_io, options.timer_torrent_updates, [&]() { m_session->post_torrent_updates(); });
+        m_timers.emplace_back(m_io, options.timer_torrent_updates, [&]() { m_session->post_torrent_updates(TorrentRegistry::StatusFlags); });
 
     if (sqlite3_open(":memory:", &m_tdb) != SQLITE_OK)
     {
@@ -194,6 +620,16 @@ Session::Session(boost::asio::io_context& io, porla::SessionOptions const& optio
     else
     {
         porla::TorrentsVTable::Install(m_tdb, m_torrents);
+        porla::FilesVTable::Install(m_tdb, m_torrents);
+        porla::MetadataVTable::Install(m_tdb, m_torrents, m_metadata);
+        porla::PeersVTable::Install(m_tdb, m_torrents);
+        porla::TrackersVTable::Install(m_tdb, m_torrents);
+
+        m_query = std::make_unique<QueryEngine>(QueryEngineOptions{
+            .db        = m_tdb,
+            .max_steps = options.query_max_steps,
+            .timeout   = options.query_timeout
+        });
     }
 }
 
@@ -201,6 +637,15 @@ Session::~Session()
 {
     BOOST_LOG_TRIVIAL(info) << "Shutting down session";
 
+    if (m_loader && !m_loader->Finished())
+    {
+        BOOST_LOG_TRIVIAL(warning) << "Shutting down before all torrents were loaded ("
+                                   << m_loader->Current() << " of " << m_loader->Total() << ")";
+    }
+
+    m_loader.reset();
+    m_query.reset();
+
     if (sqlite3_close(m_tdb) != SQLITE_OK)
     {
         BOOST_LOG_TRIVIAL(error) << "Failed to close in-memory torrents table: " << sqlite3_errmsg(m_tdb);
@@ -215,117 +660,221 @@ Session::~Session()
 
     m_session->pause();
 
-    int chunk_size = 1000;
-    int chunks = static_cast<int>(m_torrents.size() / chunk_size) + 1;
+    // Refresh the registry with the torrents that need their resume data saved
+    // in a single round trip, instead of asking each handle for its status.
+    std::vector<lt::torrent_status> need_save;
+    m_session->get_torrent_status(
+        &need_save,
+        [](lt::torrent_status const& ts) { return ts.need_save_resume; },
+        {});
 
-    BOOST_LOG_TRIVIAL(info) << "Saving resume data in " << chunks << " chunk(s) - total torrents: " << m_torrents.size();
+    for (auto const& ts : need_save)
+    {
+        m_torrents.Update(ts.info_hashes, [](lt::torrent_status& status) { status.need_save_resume = true; });
+    }
 
-    auto current = m_torrents.begin();
+    // Hold the queue so everything we collect is written in a single transaction.
+    m_resume_data_queue.Hold();
 
-    for (int i = 0; i < chunks; i++)
+    std::unordered_map<lt::info_hash_t, std::string> outstanding;
+
+    for (auto const& entry : m_torrents)
     {
-        int chunk_items = std::min(
-            chunk_size,
-            static_cast<int>(std::distance(current, m_torrents.end())));
+        if (!entry.handle.is_valid()
+            || !entry.status.has_metadata
+            || !entry.status.need_save_resume)
+        {
+            continue;
+        }
+
+        outstanding.insert({ entry.status.info_hashes, entry.status.name });
+    }
 
-        int outstanding = 0;
+    // Torrents with a request still in flight may already have had their
+    // need_save_resume cleared, and their alert may have been dropped, so they
+    // are asked again without only_if_modified. So is every outstanding torrent
+    // after a drop during shutdown. A not modified answer for one of these is an
+    // answer to an earlier request, and the forced one is still to come.
+    std::unordered_set<lt::info_hash_t> forced;
 
-        for (int j = 0; j < chunk_items; j++)
+    for (auto const& [hash, again] : m_saving)
+    {
+        auto const entry = m_torrents.Find(hash);
+
+        if (entry == nullptr || !entry->handle.is_valid())
         {
-            auto const& th = current->second;
-            auto const& ts = th.status();
+            continue;
+        }
 
-            if (!th.is_valid()
-                || !ts.has_metadata
-                || !ts.need_save_resume)
-            {
-                std::advance(current, 1);
-                continue;
-            }
+        outstanding.insert({ hash, entry->status.name });
+        forced.insert(hash);
+    }
+
+    // Every request posts an alert at once, so make sure they fit in the queue.
+    if (static_cast<int>(outstanding.size()) >= m_alert_queue_size / 2)
+    {
+        lt::settings_pack settings;
+        settings.set_int(lt::settings_pack::alert_queue_size, static_cast<int>(outstanding.size()) * 2);
+        m_session->apply_settings(settings);
+    }
+
+    auto const save = [this, &forced](const lt::info_hash_t& hash)
+    {
+        if (auto const entry = m_torrents.Find(hash))
+        {
+            lt::resume_data_flags_t flags = lt::torrent_handle::flush_disk_cache | lt::torrent_handle::save_info_dict;
+            if (!forced.contains(hash)) flags |= lt::torrent_handle::only_if_modified;
+
+            entry->handle.save_resume_data(flags);
+        }
+    };
+
+    for (auto const& [hash, name] : outstanding)
+    {
+        save(hash);
+    }
 
-            th.save_resume_data(
-                lt::torrent_handle::flush_disk_cache
-                | lt::torrent_handle::save_info_dict
-                | lt::torrent_handle::only_if_modified);
+    std::size_t const requested = outstanding.size();
+    std::vector<std::pair<lt::info_hash_t, std::string>> failed;
 
-            outstanding++;
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_shutdown_timeout);
+    auto next_progress = std::chrono::steady_clock::now() + std::chrono::seconds(1);
 
-            std::advance(current, 1);
+    BOOST_LOG_TRIVIAL(info) << "Saving resume data for " << requested << " torrent(s) (out of " << m_torrents.Size() << ")";
+
+    while (!outstanding.empty())
+    {
+        auto const now = std::chrono::steady_clock::now();
+
+        if (now >= deadline)
+        {
+            BOOST_LOG_TRIVIAL(warning) << "Shutdown timeout of " << m_shutdown_timeout << "ms reached";
+            break;
+        }
+
+        if (now >= next_progress)
+        {
+            BOOST_LOG_TRIVIAL(info) << "Saved resume data for " << requested - outstanding.size() << " (of " << requested << ") torrent(s)";
+            next_progress = now + std::chrono::seconds(1);
         }
 
-        BOOST_LOG_TRIVIAL(info) << "Chunk " << i + 1 << " - Saving state for " << outstanding << " torrent(s) (out of " << chunk_items << ")";
+        auto const wait = std::min(
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now),
+            std::chrono::milliseconds(500));
 
-        while (outstanding > 0)
+        if (m_session->wait_for_alert(wait) == nullptr)
         {
-            lt::alert const* tmp = m_session->wait_for_alert(lt::seconds(10));
-            if (tmp == nullptr) { continue; }
+            continue;
+        }
 
-            std::vector<lt::alert*> alerts;
-            m_session->pop_alerts(&alerts);
+        std::vector<lt::alert*> alerts;
+        m_session->pop_alerts(&alerts);
 
-            for (lt::alert* a : alerts)
+        for (lt::alert* a : alerts)
+        {
+            switch (a->type())
             {
-                if (lt::alert_cast<lt::torrent_paused_alert>(a))
-                {
-                    continue;
-                }
+            case lt::alerts_dropped_alert::alert_type:
+            {
+                auto ada = lt::alert_cast<lt::alerts_dropped_alert>(a);
 
-                if (auto fail = lt::alert_cast<lt::save_resume_data_failed_alert>(a))
+                if (ada->dropped_alerts.test(lt::save_resume_data_alert::alert_type)
+                    || ada->dropped_alerts.test(lt::save_resume_data_failed_alert::alert_type))
                 {
-                    outstanding--;
-
-                    BOOST_LOG_TRIVIAL(error)
-                        << "Failed to save resume data for "
-                        << fail->torrent_name()
-                        << ": " << fail->message();
+                    BOOST_LOG_TRIVIAL(warning) << "Resume data alerts were dropped, requesting " << outstanding.size() << " again";
 
-                    continue;
+                    for (auto const& [hash, name] : outstanding)
+                    {
+                        forced.insert(hash);
+                        save(hash);
+                    }
                 }
 
-                auto* rd = lt::alert_cast<lt::save_resume_data_alert>(a);
-                if (!rd) { continue; }
+                break;
+            }
+            case lt::save_resume_data_alert::alert_type:
+            {
+                auto rd = lt::alert_cast<lt::save_resume_data_alert>(a);
+                auto const hash = rd->handle.info_hashes();
+
+                if (outstanding.erase(hash) == 0)
+                {
+                    break;
+                }
 
-                outstanding--;
+                auto const entry = m_torrents.Find(hash);
 
-                AddTorrentParams::Update(m_db, rd->handle.info_hashes(), AddTorrentParams{
+                m_resume_data_queue.Enqueue(hash, AddTorrentParams{
                     .name = rd->params.name,
                     .params = rd->params,
-                    .queue_position = static_cast<int>(rd->handle.status().queue_position),
+                    .queue_position = entry != nullptr ? static_cast<int>(entry->status.queue_position) : -1,
                     .save_path = rd->params.save_path
                 });
+
+                break;
+            }
+            case lt::save_resume_data_failed_alert::alert_type:
+            {
+                auto fail = lt::alert_cast<lt::save_resume_data_failed_alert>(a);
+                auto const hash = fail->handle.info_hashes();
+
+                auto it = outstanding.find(hash);
+                if (it == outstanding.end())
+                {
+                    break;
+                }
+
+                bool const not_modified = fail->error == lt::errors::resume_data_not_modified;
+
+                // Keep waiting for the forced request, which is only ever
+                // answered with data or a real failure.
+                if (not_modified && forced.contains(hash))
+                {
+                    break;
+                }
+
+                if (!not_modified)
+                {
+                    BOOST_LOG_TRIVIAL(error) << "Failed to save resume data for " << it->second << ": " << fail->message();
+                    failed.emplace_back(it->first, it->second);
+                }
+
+                outstanding.erase(it);
+
+                break;
+            }
             }
         }
     }
 
-    BOOST_LOG_TRIVIAL(info) << "All state saved";
+    m_resume_data_queue.Flush();
+
+    for (auto const& [hash, name] : outstanding)
+    {
+        failed.emplace_back(hash, name);
+    }
+
+    if (!failed.empty())
+    {
+        BOOST_LOG_TRIVIAL(warning) << "Resume data could not be saved for " << failed.size() << " torrent(s)";
+
+        for (auto const& [hash, name] : failed)
+        {
+            BOOST_LOG_TRIVIAL(warning) << " - " << name << " (" << ToString(hash) << ")";
+        }
+    }
+
+    BOOST_LOG_TRIVIAL(info) << "Saved resume data for " << requested - failed.size() << " (of " << requested << ") torrent(s)";
 }
 
 void Session::Load()
 {
     int count = AddTorrentParams::Count(m_db);
-    int current = 0;
 
     BOOST_LOG_TRIVIAL(info) << "Loading " << count << " torrent(s) from storage";
 
-    AddTorrentParams::ForEach(
-        m_db,
-        [&](lt::add_torrent_params& params)
-        {
-            current++;
-
-            lt::torrent_handle th = m_session->add_torrent(params);
-            m_torrents.insert({ th.info_hashes(), th });
-
-            if (current % 1000 == 0 && current != count)
-            {
-                BOOST_LOG_TRIVIAL(info) << current << " torrents (of " << count << ") added";
-            }
-        });
-
-    if (count > 0)
-    {
-        BOOST_LOG_TRIVIAL(info) << "Added " << current << " (of " << count << ") torrent(s) to session";
-    }
+    m_loader = std::make_unique<Loader>(*this, count);
+    m_loader->Start();
 }
 
 lt::info_hash_t Session::AddTorrent(lt::add_torrent_params const& p)
@@ -339,7 +888,7 @@ lt::info_hash_t Session::AddTorrent(lt::add_torrent_params const& p)
         return {};
     }
 
-    lt::torrent_status ts = th.status();
+    lt::torrent_status ts = th.status(TorrentRegistry::StatusFlags);
 
     AddTorrentParams::Insert(m_db, ts.info_hashes, AddTorrentParams{
         .name = ts.name,
@@ -348,12 +897,9 @@ lt::info_hash_t Session::AddTorrent(lt::add_torrent_params const& p)
         .save_path = ts.save_path,
     });
 
-    th.save_resume_data(
-        lt::torrent_handle::flush_disk_cache
-        | lt::torrent_handle::save_info_dict
-        | lt::torrent_handle::only_if_modified);
+    SaveResumeData(th);
 
-    m_torrents.insert({ ts.info_hashes, th });
+    m_torrents.Insert(ts);
     m_torrentAdded(ts);
 
     return ts.info_hashes;
@@ -362,44 +908,68 @@ lt::info_hash_t Session::AddTorrent(lt::add_torrent_params const& p)
 void Session::ApplySettings(const libtorrent::settings_pack& settings)
 {
     BOOST_LOG_TRIVIAL(debug) << "Applying session settings";
-    m_session->apply_settings(settings);
-}
 
-void Session::Pause()
-{
-    m_session->pause();
-}
+    lt::settings_pack pack = settings;
 
-int Session::Query(const std::string_view& query, const std::function<int(sqlite3_stmt*)>& cb)
-{
-    sqlite3_stmt* stmt;
-    int res = sqlite3_prepare_v2(m_tdb, query.data(), -1, &stmt, nullptr);
+    // Never mask out the alerts we are subscribed to.
+    if (pack.has_val(lt::settings_pack::alert_mask))
+    {
+        pack.set_int(
+            lt::settings_pack::alert_mask,
+            pack.get_int(lt::settings_pack::alert_mask) | static_cast<int>(static_cast<std::uint32_t>(m_alerts.Mask())));
+    }
 
-    if (res != SQLITE_OK)
+    if (pack.has_val(lt::settings_pack::alert_queue_size))
     {
-        BOOST_LOG_TRIVIAL(error) << "Failed to prepare torrents query: " << sqlite3_errmsg(m_tdb);
-        return res;
+        m_alert_queue_size = pack.get_int(lt::settings_pack::alert_queue_size);
     }
 
-    while (sqlite3_step(stmt) == SQLITE_ROW)
+    m_session->apply_settings(pack);
+}
+
+porla::SessionLoadProgress Session::LoadProgress()
+{
+    if (!m_loader)
     {
-        cb(stmt);
+        return { .loading = false, .current = 0, .total = 0 };
     }
 
-    res = sqlite3_finalize(stmt);
+    return {
+        .loading = !m_loader->Finished(),
+        .current = m_loader->Current(),
+        .total   = m_loader->Total()
+    };
+}
 
-    if (res != SQLITE_OK)
+void Session::Pause()
+{
+    m_session->pause();
+}
+
+porla::QueryEngine::Result Session::Query(const QueryEngine::Request& req, const QueryEngine::RowCb& cb)
+{
+    if (!m_query)
     {
-        BOOST_LOG_TRIVIAL(error) << "Failed to finalize torrents query statement: " << sqlite3_errmsg(m_tdb);
-        return res;
+        return QueryEngine::Result{
+            .status = SQLITE_ERROR,
+            .error  = "Torrents database is not available",
+            .rows   = 0
+        };
     }
 
-    return SQLITE_OK;
+    return m_query->Run(req, cb);
 }
 
 void Session::Recheck(const lt::info_hash_t &hash)
 {
-    const auto& handle = m_torrents.at(hash);
+    auto const entry = m_torrents.Find(hash);
+
+    if (entry == nullptr)
+    {
+        throw std::out_of_range("Torrent not found");
+    }
+
+    lt::torrent_handle handle = entry->handle;
 
     // If the torrent is paused, it must be resumed in order to be rechecked.
     // It should also not be auto managed, so remove it from that as well.
@@ -429,7 +999,9 @@ void Session::Recheck(const lt::info_hash_t &hash)
     m_oneshot_torrent_callbacks.at({ alert_type, hash }).emplace_back(
         [&, hash, was_auto_managed, was_paused]()
         {
-            if (!m_torrents.contains(hash))
+            auto const entry = m_torrents.Find(hash);
+
+            if (entry == nullptr)
             {
                 return;
             }
@@ -439,12 +1011,12 @@ void Session::Recheck(const lt::info_hash_t &hash)
 
             if (was_auto_managed)
             {
-                m_torrents.at(hash).set_flags(lt::torrent_flags::auto_managed);
+                entry->handle.set_flags(lt::torrent_flags::auto_managed);
             }
 
             if (was_paused)
             {
-                m_torrents.at(hash).pause();
+                entry->handle.pause();
             }
         });
 
@@ -453,9 +1025,14 @@ void Session::Recheck(const lt::info_hash_t &hash)
 
 void Session::Remove(const lt::info_hash_t& hash, bool remove_data)
 {
-    lt::torrent_handle th = m_torrents.at(hash);
+    auto const entry = m_torrents.Find(hash);
+
+    if (entry == nullptr)
+    {
+        throw std::out_of_range("Torrent not found");
+    }
 
-    m_session->remove_torrent(th, remove_data ? lt::session::delete_files : lt::remove_flags_t{});
+    m_session->remove_torrent(entry->handle, remove_data ? lt::session::delete_files : lt::remove_flags_t{});
 }
 
 void Session::Resume()
@@ -468,7 +1045,34 @@ lt::settings_pack Session::Settings()
     return m_session->get_settings();
 }
 
-const std::map<lt::info_hash_t, lt::torrent_handle>& Session::Torrents()
+void Session::SetMetadata(const lt::info_hash_t& hash, const std::string& key, const json& value)
+{
+    m_metadata.Set(hash, key, value);
+
+    if (key == "category")
+    {
+        m_torrents.SetCategory(
+            hash,
+            value.is_string() ? std::optional(value.get<std::string>()) : std::nullopt);
+    }
+    else if (key == "tags")
+    {
+        m_torrents.SetTags(
+            hash,
+            value.is_array() ? value.get<std::vector<std::string>>() : std::vector<std::string>());
+    }
+    else
+    {
+        m_torrents.Touch(hash);
+    }
+}
+
+porla::AlertDispatcher& Session::Alerts()
+{
+    return m_alerts;
+}
+
+const porla::TorrentRegistry& Session::Torrents()
 {
     return m_torrents;
 }
@@ -480,161 +1084,332 @@ void Session::ReadAlerts()
 
     for (auto const alert : alerts)
     {
-        BOOST_LOG_TRIVIAL(trace) << "Session alert: " << alert->message();
+        m_alerts.Dispatch(alert);
+    }
+}
 
-        switch (alert->type())
-        {
-        case lt::dht_stats_alert::alert_type:
-        {
-            auto dsa = lt::alert_cast<lt::dht_stats_alert>(alert);
-            // TODO: emit signal
-            break;
-        }
-        case lt::metadata_received_alert::alert_type:
-        {
-            auto mra = lt::alert_cast<lt::metadata_received_alert>(alert);
+void Session::OnAddTorrentAlert(const lt::add_torrent_alert* ata)
+{
+    // Torrents added with AddTorrent are handled synchronously. Only the
+    // ones added by the loader are tagged with it as user data.
+    if (m_loader && ata->params.userdata.get<Loader*>() == m_loader.get())
+    {
+        m_loader->OnTorrentAdded(ata);
+    }
+}
 
-            BOOST_LOG_TRIVIAL(info) << "Metadata received for torrent " << mra->handle.status().name;
+void Session::OnAlertsDroppedAlert(const lt::alerts_dropped_alert* ada)
+{
+    std::stringstream types;
 
-            mra->handle.save_resume_data(
-                lt::torrent_handle::flush_disk_cache
-                | lt::torrent_handle::save_info_dict
-                | lt::torrent_handle::only_if_modified);
+    for (int i = 0; i < lt::num_alert_types; i++)
+    {
+        if (ada->dropped_alerts.test(i)) types << " " << lt::alert_name(i);
+    }
 
-            break;
-        }
-        case lt::save_resume_data_alert::alert_type:
-        {
-            auto srda = lt::alert_cast<lt::save_resume_data_alert>(alert);
-            auto const& status = srda->handle.status();
+    BOOST_LOG_TRIVIAL(warning) << "Session dropped alerts:" << types.str();
 
-            AddTorrentParams::Update(m_db, status.info_hashes, AddTorrentParams{
-                .name = status.name,
-                .params = srda->params,
-                .queue_position = static_cast<int>(status.queue_position),
-                .save_path = status.save_path
-            });
+    // Make room for more alerts so this does not happen again under the same load.
+    if (m_alert_queue_size < MaxAlertQueueSize)
+    {
+        m_alert_queue_size = std::min(m_alert_queue_size * 2, MaxAlertQueueSize);
 
-            BOOST_LOG_TRIVIAL(info) << "Resume data saved for " << status.name;
+        lt::settings_pack settings;
+        settings.set_int(lt::settings_pack::alert_queue_size, m_alert_queue_size);
+        m_session->apply_settings(settings);
 
-            break;
-        }
-        case lt::session_stats_alert::alert_type:
+        BOOST_LOG_TRIVIAL(info) << "Alert queue size raised to " << m_alert_queue_size;
+    }
+
+    if (m_loader && ada->dropped_alerts.test(lt::add_torrent_alert::alert_type))
+    {
+        m_loader->OnAddsDropped();
+    }
+
+    // Only the torrents with a request in flight can have lost their resume
+    // data. libtorrent has cleared their need_save_resume when it generated the
+    // data, so they are asked again without only_if_modified.
+    if (ada->dropped_alerts.test(lt::save_resume_data_alert::alert_type)
+        || ada->dropped_alerts.test(lt::save_resume_data_failed_alert::alert_type))
+    {
+        m_dropped_saves.clear();
+        m_dropped_saves_in_flight = 0;
+
+        for (auto& [hash, again] : m_saving)
         {
-            auto ssa = lt::alert_cast<lt::session_stats_alert>(alert);
-            auto const& counters = ssa->counters();
+            again = false;
+            m_dropped_saves.push_back(hash);
+        }
 
-            std::map<std::string, int64_t> metrics;
+        BOOST_LOG_TRIVIAL(info) << "Requesting resume data again for " << m_dropped_saves.size() << " torrent(s)";
 
-            for (auto const& stats : m_stats)
-            {
-                metrics.insert({ stats.name, counters[stats.value_index] });
-            }
+        RequestDroppedResumeData();
+    }
 
-            m_sessionStats(metrics);
+    // The state updates asked for by finished torrents might be gone, and
+    // their events with them. Ask for them again.
+    if (ada->dropped_alerts.test(lt::state_update_alert::alert_type) && !m_finishing.empty())
+    {
+        auto const finishing = std::move(m_finishing);
+        m_finishing.clear();
 
-            break;
-        }
-        case lt::state_update_alert::alert_type:
+        for (auto const& hash : finishing)
         {
-            auto sua = lt::alert_cast<lt::state_update_alert>(alert);
+            auto const entry = m_torrents.Find(hash);
 
-            m_stateUpdate(sua->status);
+            if (entry == nullptr || !entry->handle.is_valid())
+            {
+                continue;
+            }
 
-            break;
+            m_finishing.insert(hash);
+            entry->handle.post_status(TorrentRegistry::StatusFlags);
         }
-        case lt::storage_moved_alert::alert_type:
-        {
-            auto const sma = lt::alert_cast<lt::storage_moved_alert>(alert);
 
-            BOOST_LOG_TRIVIAL(info) << "Torrent " << sma->torrent_name() << " moved to " << sma->storage_path();
+        BOOST_LOG_TRIVIAL(info) << "Requesting status again for " << m_finishing.size() << " finished torrent(s)";
+    }
+}
 
-            if (sma->handle.need_save_resume_data())
-            {
-                sma->handle.save_resume_data(lt::torrent_handle::flush_disk_cache
-                                             | lt::torrent_handle::save_info_dict
-                                             | lt::torrent_handle::only_if_modified);
-            }
+void Session::SaveResumeData(const lt::torrent_handle& th, bool only_if_modified)
+{
+    lt::resume_data_flags_t flags = lt::torrent_handle::flush_disk_cache | lt::torrent_handle::save_info_dict;
+    if (only_if_modified) flags |= lt::torrent_handle::only_if_modified;
 
-            m_storageMoved(sma->handle);
+    // Keep a request made again after a drop marked as such until it is done.
+    m_saving.try_emplace(th.info_hashes(), false);
 
-            break;
-        }
-        case lt::torrent_checked_alert::alert_type:
-        {
-            const auto tca = lt::alert_cast<lt::torrent_checked_alert>(alert);
-            BOOST_LOG_TRIVIAL(info) << "Torrent " << tca->torrent_name() << " finished checking";
+    th.save_resume_data(flags);
+}
 
-            if (m_oneshot_torrent_callbacks.contains({ alert->type(), tca->handle.info_hashes()}))
-            {
-                for (auto && cb : m_oneshot_torrent_callbacks.at({ alert->type(), tca->handle.info_hashes() }))
-                {
-                    cb();
-                }
+void Session::OnResumeDataDone(const lt::info_hash_t& hash)
+{
+    auto const it = m_saving.find(hash);
 
-                m_oneshot_torrent_callbacks.erase({ alert->type(), tca->handle.info_hashes() });
-            }
+    if (it == m_saving.end())
+    {
+        return;
+    }
 
-            break;
-        }
-        case lt::torrent_finished_alert::alert_type:
-        {
-            auto tfa = lt::alert_cast<lt::torrent_finished_alert>(alert);
-            auto const& status = tfa->handle.status();
+    if (it->second) m_dropped_saves_in_flight--;
 
+    m_saving.erase(it);
 
-            if (status.total_download > 0)
-            {
-                // Only emit this event if we have downloaded any data this session.
-                BOOST_LOG_TRIVIAL(info) << "Torrent " << status.name << " finished";
-                m_torrentFinished(status);
-            }
+    RequestDroppedResumeData();
+}
 
-            if (status.need_save_resume)
-            {
-                status.handle.save_resume_data(lt::torrent_handle::flush_disk_cache
-                                               | lt::torrent_handle::save_info_dict
-                                               | lt::torrent_handle::only_if_modified);
-            }
+void Session::RequestDroppedResumeData()
+{
+    // Each request posts an alert into the queue that just overflowed, so
+    // keep the ones in flight well below its size.
+    int const limit = std::max(m_alert_queue_size / 4, 1);
 
-            break;
+    while (!m_dropped_saves.empty() && m_dropped_saves_in_flight < limit)
+    {
+        auto const hash = m_dropped_saves.back();
+        m_dropped_saves.pop_back();
+
+        auto const saving = m_saving.find(hash);
+        auto const entry = m_torrents.Find(hash);
+
+        // Answered while it was waiting here.
+        if (saving == m_saving.end())
+        {
+            continue;
         }
-        case lt::torrent_paused_alert::alert_type:
+
+        if (entry == nullptr || !entry->handle.is_valid())
         {
-            auto tpa = lt::alert_cast<lt::torrent_paused_alert>(alert);
-            auto const& status = tpa->handle.status();
+            m_saving.erase(saving);
+            continue;
+        }
 
-            BOOST_LOG_TRIVIAL(debug) << "Torrent " << status.name << " paused";
+        saving->second = true;
+        m_dropped_saves_in_flight++;
 
-            m_torrentPaused(status);
+        SaveResumeData(entry->handle, false);
+    }
+}
 
-            break;
-        }
-        case lt::torrent_removed_alert::alert_type:
-        {
-            auto tra = lt::alert_cast<lt::torrent_removed_alert>(alert);
+void Session::OnMetadataReceivedAlert(const lt::metadata_received_alert* mra)
+{
+    BOOST_LOG_TRIVIAL(info) << "Metadata received for torrent " << mra->torrent_name();
+
+    SaveResumeData(mra->handle);
+}
+
+void Session::OnSaveResumeDataAlert(const lt::save_resume_data_alert* srda)
+{
+    OnResumeDataDone(srda->handle.info_hashes());
 
-            AddTorrentParams::Remove(m_db, tra->info_hashes);
-            TorrentsMetadata::RemoveAll(m_db, tra->info_hashes);
+    auto const entry = m_torrents.Find(srda->handle.info_hashes());
 
-            m_torrents.erase(tra->info_hashes);
-            m_torrentRemoved(tra->info_hashes);
+    if (entry == nullptr)
+    {
+        BOOST_LOG_TRIVIAL(warning) << "Resume data saved for unknown torrent " << srda->torrent_name();
+        return;
+    }
 
-            BOOST_LOG_TRIVIAL(info) << "Torrent " << tra->torrent_name() << " removed";
+    auto const& status = entry->status;
 
-            break;
+    m_resume_data_queue.Enqueue(status.info_hashes, AddTorrentParams{
+        .name = status.name,
+        .params = srda->params,
+        .queue_position = static_cast<int>(status.queue_position),
+        .save_path = status.save_path
+    });
+
+    BOOST_LOG_TRIVIAL(debug) << "Resume data queued for " << status.name;
+}
+
+void Session::OnSaveResumeDataFailedAlert(const lt::save_resume_data_failed_alert* srdfa)
+{
+    OnResumeDataDone(srdfa->handle.info_hashes());
+
+    if (srdfa->error != lt::errors::resume_data_not_modified)
+    {
+        BOOST_LOG_TRIVIAL(error) << "Failed to save resume data for " << srdfa->torrent_name() << ": " << srdfa->message();
+    }
+}
+
+void Session::OnSessionStatsAlert(const lt::session_stats_alert* ssa)
+{
+    auto const& counters = ssa->counters();
+
+    std::map<std::string, int64_t> metrics;
+
+    for (auto const& stats : m_stats)
+    {
+        metrics.insert({ stats.name, counters[stats.value_index] });
+    }
+
+    m_sessionStats(metrics);
+}
+
+void Session::OnStateUpdateAlert(const lt::state_update_alert* sua)
+{
+    m_torrents.Patch(sua->status);
+    m_stateUpdate(sua->status);
+
+    if (m_finishing.empty())
+    {
+        return;
+    }
+
+    for (auto const& ts : sua->status)
+    {
+        if (m_finishing.erase(ts.info_hashes) == 0)
+        {
+            continue;
         }
-        case lt::torrent_resumed_alert::alert_type:
+
+        // Only emit this event if we have downloaded any data this session.
+        if (ts.total_download > 0)
         {
-            auto tra = lt::alert_cast<lt::torrent_resumed_alert>(alert);
-            auto const& status = tra->handle.status();
+            BOOST_LOG_TRIVIAL(info) << "Torrent " << ts.name << " finished";
+            m_torrentFinished(ts);
+        }
+    }
+}
 
-            BOOST_LOG_TRIVIAL(debug) << "Torrent " << status.name << " resumed";
+void Session::OnStorageMovedAlert(const lt::storage_moved_alert* sma)
+{
+    BOOST_LOG_TRIVIAL(info) << "Torrent " << sma->torrent_name() << " moved to " << sma->storage_path();
 
-            m_torrentResumed(status);
+    m_torrents.Update(
+        sma->handle.info_hashes(),
+        [&sma](lt::torrent_status& status) { status.save_path = sma->storage_path(); });
 
-            break;
-        }
+    SaveResumeData(sma->handle);
+
+    m_storageMoved(sma->handle);
+}
+
+void Session::OnTorrentCheckedAlert(const lt::torrent_checked_alert* tca)
+{
+    BOOST_LOG_TRIVIAL(info) << "Torrent " << tca->torrent_name() << " finished checking";
+
+    auto const key = std::make_pair(static_cast<int>(lt::torrent_checked_alert::alert_type), tca->handle.info_hashes());
+
+    if (m_oneshot_torrent_callbacks.contains(key))
+    {
+        for (auto && cb : m_oneshot_torrent_callbacks.at(key))
+        {
+            cb();
         }
+
+        m_oneshot_torrent_callbacks.erase(key);
+    }
+}
+
+void Session::OnTorrentFinishedAlert(const lt::torrent_finished_alert* tfa)
+{
+    auto const hash = tfa->handle.info_hashes();
+
+    if (!m_torrents.Update(hash, [](lt::torrent_status& status) { status.is_finished = true; }))
+    {
+        return;
+    }
+
+    // The registry is only as fresh as the last state update, which may not
+    // have the final counters and state yet. Ask for a state update with
+    // them and emit the event from it, instead of waiting on the network
+    // thread here.
+    m_finishing.insert(hash);
+    tfa->handle.post_status(TorrentRegistry::StatusFlags);
+
+    // The registry might not have caught up with need_save_resume yet, but a
+    // finished torrent always has new state. libtorrent skips the save if not.
+    SaveResumeData(tfa->handle);
+}
+
+void Session::OnTorrentPausedAlert(const lt::torrent_paused_alert* tpa)
+{
+    auto const hash = tpa->handle.info_hashes();
+
+    if (!m_torrents.Update(hash, [](lt::torrent_status& status) { status.flags |= lt::torrent_flags::paused; }))
+    {
+        return;
     }
+
+    auto const status = &m_torrents.Find(hash)->status;
+
+    BOOST_LOG_TRIVIAL(debug) << "Torrent " << status->name << " paused";
+
+    m_torrentPaused(*status);
+}
+
+void Session::OnTorrentRemovedAlert(const lt::torrent_removed_alert* tra)
+{
+    m_resume_data_queue.Discard(tra->info_hashes);
+    m_finishing.erase(tra->info_hashes);
+
+    if (auto const it = m_saving.find(tra->info_hashes); it != m_saving.end())
+    {
+        if (it->second) m_dropped_saves_in_flight--;
+        m_saving.erase(it);
+    }
+
+    AddTorrentParams::Remove(m_db, tra->info_hashes);
+    m_metadata.RemoveAll(tra->info_hashes);
+
+    m_torrents.Erase(tra->info_hashes);
+    m_torrentRemoved(tra->info_hashes);
+
+    BOOST_LOG_TRIVIAL(info) << "Torrent " << tra->torrent_name() << " removed";
+}
+
+void Session::OnTorrentResumedAlert(const lt::torrent_resumed_alert* tra)
+{
+    auto const hash = tra->handle.info_hashes();
+
+    if (!m_torrents.Update(hash, [](lt::torrent_status& status) { status.flags &= ~lt::torrent_flags::paused; }))
+    {
+        return;
+    }
+
+    auto const status = &m_torrents.Find(hash)->status;
+
+    BOOST_LOG_TRIVIAL(debug) << "Torrent " << status->name << " resumed";
+
+    m_torrentResumed(*status);
 }
@@ -4,13 +4,22 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/signals2.hpp>
 #include <libtorrent/session.hpp>
+#include <nlohmann/json.hpp>
 #include <sqlite3.h>
 
+#include "alertdispatcher.hpp"
+#include "data/metadatacache.hpp"
+#include "data/resumedataqueue.hpp"
+#include "queryengine.hpp"
+#include "torrentregistry.hpp"
+
 typedef std::function<std::shared_ptr<libtorrent::torrent_plugin>(libtorrent:: torrent_handle const&, libtorrent::client_data_t)> lt_plugin;
 
 namespace porla
@@ -18,14 +27,26 @@ namespace porla
     struct SessionOptions
     {
         sqlite3* db = nullptr;
+        Data::MetadataCache& metadata;
+        Data::ResumeDataQueue& resume_data_queue;
         std::optional<std::vector<lt_plugin>> extensions;
         lt::settings_pack settings = lt::default_settings();
         std::filesystem::path session_params_file = std::filesystem::path();
+        int query_max_steps = 10000000;
+        int query_timeout = 5000;
+        int shutdown_timeout = 30000;
         int timer_dht_stats = 5000;
         int timer_session_stats = 5000;
         int timer_torrent_updates = 1000;
     };
 
+    struct SessionLoadProgress
+    {
+        bool loading;
+        int current;
+        int total;
+    };
+
     class ISession
     {
     public:
@@ -46,14 +67,17 @@ namespace porla
         virtual boost::signals2::connection OnTorrentResumed(const TorrentStatusSignal::slot_type& subscriber) = 0;
 
         virtual libtorrent::info_hash_t AddTorrent(libtorrent::add_torrent_params const& p) = 0;
+        virtual AlertDispatcher& Alerts() = 0;
         virtual void ApplySettings(const libtorrent::settings_pack& settings) = 0;
+        virtual SessionLoadProgress LoadProgress() = 0;
         virtual void Pause() = 0;
-        virtual int Query(const std::string_view& query, const std::function<int(sqlite3_stmt*)>& cb) = 0;
+        virtual QueryEngine::Result Query(const QueryEngine::Request& req, const QueryEngine::RowCb& cb) = 0;
         virtual void Recheck(const lt::info_hash_t& hash) = 0;
         virtual void Remove(const lt::info_hash_t& hash, bool remove_data) = 0;
         virtual void Resume() = 0;
+        virtual void SetMetadata(const lt::info_hash_t& hash, const std::string& key, const nlohmann::json& value) = 0;
         virtual libtorrent::settings_pack Settings() = 0;
-        virtual const std::map<lt::info_hash_t, lt::torrent_handle>& Torrents() = 0;
+        virtual const TorrentRegistry& Torrents() = 0;
     };
 
     class Session : public ISession
@@ -116,20 +140,47 @@ namespace porla
         void Load();
 
         libtorrent::info_hash_t AddTorrent(libtorrent::add_torrent_params const& p) override;
+        AlertDispatcher& Alerts() override;
         void ApplySettings(const libtorrent::settings_pack& settings) override;
+        SessionLoadProgress LoadProgress() override;
         void Pause() override;
-        int Query(const std::string_view& query, const std::function<int(sqlite3_stmt*)>& cb) override;
+        QueryEngine::Result Query(const QueryEngine::Request& req, const QueryEngine::RowCb& cb) override;
         void Recheck(const lt::info_hash_t& hash) override;
         void Remove(const lt::info_hash_t& hash, bool remove_data) override;
         void Resume() override;
+        void SetMetadata(const lt::info_hash_t& hash, const std::string& key, const nlohmann::json& value) override;
         libtorrent::settings_pack Settings() override;
-        const std::map<lt::info_hash_t, lt::torrent_handle>& Torrents() override;
+        const TorrentRegistry& Torrents() override;
 
     private:
+        class Loader;
         class Timer;
 
+        static constexpr int MaxAlertQueueSize = 1000000;
+
         void ReadAlerts();
 
+        // Requests resume data and keeps track of it until its alert arrives.
+        // Without only_if_modified the data is saved even if libtorrent thinks
+        // it was saved already, for requests whose alert was dropped.
+        void SaveResumeData(const libtorrent::torrent_handle& th, bool only_if_modified = true);
+        void OnResumeDataDone(const libtorrent::info_hash_t& hash);
+        void RequestDroppedResumeData();
+
+        void OnAddTorrentAlert(const libtorrent::add_torrent_alert* ata);
+        void OnAlertsDroppedAlert(const libtorrent::alerts_dropped_alert* ada);
+        void OnMetadataReceivedAlert(const libtorrent::metadata_received_alert* mra);
+        void OnSaveResumeDataAlert(const libtorrent::save_resume_data_alert* srda);
+        void OnSaveResumeDataFailedAlert(const libtorrent::save_resume_data_failed_alert* srdfa);
+        void OnSessionStatsAlert(const libtorrent::session_stats_alert* ssa);
+        void OnStateUpdateAlert(const libtorrent::state_update_alert* sua);
+        void OnStorageMovedAlert(const libtorrent::storage_moved_alert* sma);
+        void OnTorrentCheckedAlert(const libtorrent::torrent_checked_alert* tca);
+        void OnTorrentFinishedAlert(const libtorrent::torrent_finished_alert* tfa);
+        void OnTorrentPausedAlert(const libtorrent::torrent_paused_alert* tpa);
+        void OnTorrentRemovedAlert(const libtorrent::torrent_removed_alert* tra);
+        void OnTorrentResumedAlert(const libtorrent::torrent_resumed_alert* tra);
+
         boost::asio::io_context& m_io;
         std::vector<Timer> m_timers;
         std::vector<lt::stats_metric> m_stats;
@@ -148,9 +199,27 @@ namespace porla
 
         sqlite3* m_db;
         sqlite3* m_tdb;
+        Data::MetadataCache& m_metadata;
+        std::unique_ptr<QueryEngine> m_query;
+        Data::ResumeDataQueue& m_resume_data_queue;
+        int m_shutdown_timeout;
+        int m_alert_queue_size;
+
+        // The torrents with a resume data request in flight, and whether it is
+        // one made again after its alert may have been dropped.
+        std::unordered_map<libtorrent::info_hash_t, bool> m_saving;
+        std::vector<libtorrent::info_hash_t> m_dropped_saves;
+        int m_dropped_saves_in_flight = 0;
+
+        // Finished torrents whose event waits for the state update with their
+        // final status.
+        std::unordered_set<libtorrent::info_hash_t> m_finishing;
+
+        AlertDispatcher m_alerts;
 
         std::unique_ptr<libtorrent::session> m_session;
-        std::map<libtorrent::info_hash_t, libtorrent::torrent_handle> m_torrents;
+        std::unique_ptr<Loader> m_loader;
+        TorrentRegistry m_torrents;
         std::map<std::pair<int, libtorrent::info_hash_t>, std::vector<std::function<void()>>> m_oneshot_torrent_callbacks;
     };
 }
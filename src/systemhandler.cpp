@@ -1,19 +1,44 @@
 #include "systemhandler.hpp"
 
 #include "data/models/users.hpp"
+#include "session.hpp"
 
 using porla::SystemHandler;
 
-SystemHandler::SystemHandler(sqlite3* db)
+SystemHandler::SystemHandler(sqlite3* db, porla::ISession& session)
     : m_db(db)
+    , m_session(session)
 {
 }
 
 void SystemHandler::operator()(const std::shared_ptr<HttpContext>& ctx)
 {
     auto any_users = porla::Data::Models::Users::Any(m_db);
+    auto progress = m_session.LoadProgress();
+
+    if (!any_users)
+    {
+        ctx->WriteJson({
+            {"status", "setup"}
+        });
+
+        return;
+    }
+
+    if (progress.loading)
+    {
+        ctx->WriteJson({
+            {"status", "loading"},
+            {"loading", {
+                {"current", progress.current},
+                {"total", progress.total}
+            }}
+        });
+
+        return;
+    }
 
     ctx->WriteJson({
-        {"status", any_users ? "ok" : "setup"}
+        {"status", "ok"}
     });
 }
@@ -6,13 +6,16 @@
 
 namespace porla
 {
+    class ISession;
+
     class SystemHandler
     {
     public:
-        explicit SystemHandler(sqlite3* db);
+        explicit SystemHandler(sqlite3* db, ISession& session);
         void operator()(const std::shared_ptr<HttpContext>&);
 
     private:
         sqlite3* m_db;
+        ISession& m_session;
     };
 }
\ No newline at end of file
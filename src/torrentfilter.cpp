@@ -0,0 +1,403 @@
+#include "torrentfilter.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <optional>
+#include <stdexcept>
+
+#include <libtorrent/torrent_info.hpp>
+
+#include "utils/ratio.hpp"
+
+namespace lt = libtorrent;
+using json = nlohmann::json;
+
+using porla::IdBitmap;
+using porla::TorrentFilter;
+using porla::TorrentRegistry;
+
+typedef std::function<double(const TorrentRegistry::Entry&)> NumericField;
+
+// Calls the test with each value of the field, and is true if any passes.
+typedef std::function<bool(const TorrentRegistry::Entry&, const std::function<bool(const std::string&)>&)> StringField;
+
+static const std::map<std::string, NumericField> NumericFields =
+{
+    {"download_rate",  [](auto const& e) { return e.status.download_rate; }},
+    {"list_peers",     [](auto const& e) { return e.status.list_peers; }},
+    {"list_seeds",     [](auto const& e) { return e.status.list_seeds; }},
+    {"num_peers",      [](auto const& e) { return e.status.num_peers; }},
+    {"num_seeds",      [](auto const& e) { return e.status.num_seeds; }},
+    {"progress",       [](auto const& e) { return e.status.progress; }},
+    {"queue_position", [](auto const& e) { return static_cast<int>(e.status.queue_position); }},
+    {"ratio",          [](auto const& e) { return porla::Utils::Ratio(e.status); }},
+    {"size",           [](auto const& e)
+    {
+        auto const ti = e.status.torrent_file.lock();
+        return static_cast<double>(ti ? ti->total_size() : -1);
+    }},
+    {"state",          [](auto const& e) { return static_cast<int>(e.status.state); }},
+    {"total",          [](auto const& e) { return static_cast<double>(e.status.total); }},
+    {"total_done",     [](auto const& e) { return static_cast<double>(e.status.total_done); }},
+    {"upload_rate",    [](auto const& e) { return e.status.upload_rate; }},
+};
+
+static const std::map<std::string, StringField> StringFields =
+{
+    {"category",  [](auto const& e, auto const& test) { return e.category.has_value() && test(e.category.value()); }},
+    {"name",      [](auto const& e, auto const& test) { return test(e.status.name); }},
+    {"save_path", [](auto const& e, auto const& test) { return test(e.status.save_path); }},
+    {"tags",      [](auto const& e, auto const& test) { return std::any_of(e.tags.begin(), e.tags.end(), test); }},
+};
+
+struct TorrentFilter::Node
+{
+    enum class Type
+    {
+        And,
+        Or,
+        Not,
+        Indexed,
+        Predicate
+    };
+
+    Type type;
+    std::vector<std::shared_ptr<const Node>> children;
+    std::vector<std::function<const IdBitmap*(const TorrentRegistry&)>> lookups;
+    std::function<bool(const TorrentRegistry::Entry&)> predicate;
+};
+
+typedef std::shared_ptr<const TorrentFilter::Node> NodePtr;
+
+static std::vector<json> Values(const json& args)
+{
+    return args.is_array()
+        ? args.get<std::vector<json>>()
+        : std::vector<json>{ args };
+}
+
+static NodePtr Indexed(const std::string& field, const json& args)
+{
+    auto node = std::make_shared<TorrentFilter::Node>();
+    node->type = TorrentFilter::Node::Type::Indexed;
+
+    for (auto const& value : Values(args))
+    {
+        if (field == "state")
+        {
+            if (!value.is_number_integer())
+            {
+                throw std::invalid_argument("Filter on 'state' expects an integer");
+            }
+
+            auto const state = static_cast<lt::torrent_status::state_t>(value.get<int>());
+            node->lookups.emplace_back([state](auto const& torrents) { return torrents.ByState(state); });
+            continue;
+        }
+
+        if (!value.is_string())
+        {
+            throw std::invalid_argument("Filter on '" + field + "' expects a string");
+        }
+
+        auto const str = value.get<std::string>();
+
+        if (field == "category")
+            node->lookups.emplace_back([str](auto const& torrents) { return torrents.ByCategory(str); });
+        else if (field == "save_path")
+            node->lookups.emplace_back([str](auto const& torrents) { return torrents.BySavePath(str); });
+        else
+            node->lookups.emplace_back([str](auto const& torrents) { return torrents.ByTag(str); });
+    }
+
+    return node;
+}
+
+static NodePtr Predicate(std::function<bool(const TorrentRegistry::Entry&)> predicate)
+{
+    auto node = std::make_shared<TorrentFilter::Node>();
+    node->type = TorrentFilter::Node::Type::Predicate;
+    node->predicate = std::move(predicate);
+    return node;
+}
+
+static NodePtr CompileField(const json& filter)
+{
+    std::string field = filter.at("field").get<std::string>();
+    std::string const op = filter.contains("op") ? filter["op"].get<std::string>() : "eq";
+    json const& args = filter.at("args");
+
+    if (field == "tag") field = "tags";
+
+    auto const numeric = NumericFields.find(field);
+    auto const string = StringFields.find(field);
+
+    if (numeric == NumericFields.end() && string == StringFields.end())
+    {
+        throw std::invalid_argument("Unknown filter field '" + field + "'");
+    }
+
+    if (op == "eq")
+    {
+        if (field == "category" || field == "save_path" || field == "state" || field == "tags")
+        {
+            return Indexed(field, args);
+        }
+
+        if (numeric != NumericFields.end())
+        {
+            std::vector<double> values;
+
+            for (auto const& value : Values(args))
+            {
+                if (!value.is_number()) throw std::invalid_argument("Filter on '" + field + "' expects a number");
+                values.push_back(value.get<double>());
+            }
+
+            return Predicate(
+                [get = numeric->second, values](auto const& entry)
+                {
+                    return std::find(values.begin(), values.end(), get(entry)) != values.end();
+                });
+        }
+
+        std::vector<std::string> values;
+
+        for (auto const& value : Values(args))
+        {
+            if (!value.is_string()) throw std::invalid_argument("Filter on '" + field + "' expects a string");
+            values.push_back(value.get<std::string>());
+        }
+
+        return Predicate(
+            [get = string->second, values](auto const& entry)
+            {
+                return get(entry, [&values](const std::string& str)
+                {
+                    return std::find(values.begin(), values.end(), str) != values.end();
+                });
+            });
+    }
+
+    if (op == "range")
+    {
+        if (numeric == NumericFields.end())
+        {
+            throw std::invalid_argument("Range filter on non-numeric field '" + field + "'");
+        }
+
+        if (!args.is_object())
+        {
+            throw std::invalid_argument("Range filter expects an object with gt, gte, lt or lte");
+        }
+
+        auto const bound = [&args](const char* name) -> std::optional<double>
+        {
+            if (!args.contains(name)) return std::nullopt;
+            if (!args[name].is_number()) throw std::invalid_argument("Range bound '" + std::string(name) + "' must be a number");
+            return args[name].get<double>();
+        };
+
+        return Predicate(
+            [get = numeric->second, gt = bound("gt"), gte = bound("gte"), lt = bound("lt"), lte = bound("lte")](auto const& entry)
+            {
+                double const value = get(entry);
+
+                return (!gt  || value >  *gt)
+                    && (!gte || value >= *gte)
+                    && (!lt  || value <  *lt)
+                    && (!lte || value <= *lte);
+            });
+    }
+
+    // Patterns are matched literally. Filters are run on the session thread,
+    // where a regex with catastrophic backtracking would stall everything.
+    if (op == "prefix" || op == "contains")
+    {
+        if (string == StringFields.end())
+        {
+            throw std::invalid_argument("Filter '" + op + "' on non-string field '" + field + "'");
+        }
+
+        if (!args.is_string())
+        {
+            throw std::invalid_argument("Filter '" + op + "' expects a string");
+        }
+
+        if (op == "prefix")
+        {
+            return Predicate(
+                [get = string->second, prefix = args.get<std::string>()](auto const& entry)
+                {
+                    return get(entry, [&prefix](const std::string& str) { return str.starts_with(prefix); });
+                });
+        }
+
+        return Predicate(
+            [get = string->second, needle = args.get<std::string>()](auto const& entry)
+            {
+                return get(entry, [&needle](const std::string& str) { return str.find(needle) != std::string::npos; });
+            });
+    }
+
+    throw std::invalid_argument("Unknown filter op '" + op + "'");
+}
+
+// Filters are compiled and evaluated recursively on the session thread, so
+// how deep they nest is limited to keep a hostile one from overflowing its
+// stack.
+static constexpr int MaxDepth = 64;
+
+static NodePtr CompileNode(const json& filter, int depth);
+
+static NodePtr CompileList(TorrentFilter::Node::Type type, const json& filters, int depth)
+{
+    if (!filters.is_array())
+    {
+        throw std::invalid_argument("Expected an array of filters");
+    }
+
+    auto node = std::make_shared<TorrentFilter::Node>();
+    node->type = type;
+
+    for (auto const& filter : filters)
+    {
+        node->children.push_back(CompileNode(filter, depth));
+    }
+
+    // Run the index lookups of an AND first, so the predicates only need to
+    // test what is left after them.
+    if (type == TorrentFilter::Node::Type::And)
+    {
+        std::stable_partition(
+            node->children.begin(),
+            node->children.end(),
+            [](auto const& child) { return child->type == TorrentFilter::Node::Type::Indexed; });
+    }
+
+    return node;
+}
+
+static NodePtr CompileNode(const json& filter, int depth)
+{
+    if (++depth > MaxDepth)
+    {
+        throw std::invalid_argument("Filter is nested more than " + std::to_string(MaxDepth) + " levels deep");
+    }
+
+    if (filter.is_array())
+    {
+        return CompileList(TorrentFilter::Node::Type::And, filter, depth);
+    }
+
+    if (!filter.is_object())
+    {
+        throw std::invalid_argument("Expected a filter object");
+    }
+
+    if (filter.contains("and")) return CompileList(TorrentFilter::Node::Type::And, filter["and"], depth);
+    if (filter.contains("or"))  return CompileList(TorrentFilter::Node::Type::Or, filter["or"], depth);
+
+    if (filter.contains("not"))
+    {
+        auto node = std::make_shared<TorrentFilter::Node>();
+        node->type = TorrentFilter::Node::Type::Not;
+        node->children.push_back(CompileNode(filter["not"], depth));
+        return node;
+    }
+
+    return CompileField(filter);
+}
+
+// Evaluates the node for the torrents in `within`, or for every torrent.
+static IdBitmap Eval(const TorrentFilter::Node& node, const TorrentRegistry& torrents, const IdBitmap* within)
+{
+    switch (node.type)
+    {
+    case TorrentFilter::Node::Type::And:
+    {
+        std::optional<IdBitmap> matches;
+
+        for (auto const& child : node.children)
+        {
+            matches = Eval(*child, torrents, matches.has_value() ? &matches.value() : within);
+            if (matches->Empty()) break;
+        }
+
+        if (matches.has_value()) return std::move(matches.value());
+        return within != nullptr ? *within : torrents.All();
+    }
+    case TorrentFilter::Node::Type::Or:
+    {
+        IdBitmap matches;
+
+        for (auto const& child : node.children)
+        {
+            matches |= Eval(*child, torrents, within);
+        }
+
+        return matches;
+    }
+    case TorrentFilter::Node::Type::Not:
+    {
+        IdBitmap matches = within != nullptr ? *within : torrents.All();
+        matches -= Eval(*node.children.front(), torrents, within);
+        return matches;
+    }
+    case TorrentFilter::Node::Type::Indexed:
+    {
+        IdBitmap matches;
+
+        for (auto const& lookup : node.lookups)
+        {
+            if (auto const ids = lookup(torrents)) matches |= *ids;
+        }
+
+        if (within != nullptr) matches &= *within;
+
+        return matches;
+    }
+    case TorrentFilter::Node::Type::Predicate:
+    {
+        IdBitmap matches;
+
+        for (auto const id : within != nullptr ? *within : torrents.All())
+        {
+            auto const entry = torrents.At(id);
+            if (entry != nullptr && node.predicate(*entry)) matches.Insert(id);
+        }
+
+        return matches;
+    }
+    }
+
+    return {};
+}
+
+TorrentFilter TorrentFilter::Compile(const json& filter)
+{
+    try
+    {
+        return TorrentFilter(CompileNode(filter, 0));
+    }
+    catch (const json::exception& ex)
+    {
+        throw std::invalid_argument("Invalid filter: " + std::string(ex.what()));
+    }
+}
+
+TorrentFilter::TorrentFilter(std::shared_ptr<const Node> root)
+    : m_root(std::move(root))
+{
+}
+
+IdBitmap TorrentFilter::Evaluate(const TorrentRegistry& torrents) const
+{
+    return Eval(*m_root, torrents, nullptr);
+}
+
+IdBitmap TorrentFilter::Evaluate(const TorrentRegistry& torrents, const IdBitmap& within) const
+{
+    return Eval(*m_root, torrents, &within);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+
+#include <nlohmann/json.hpp>
+
+#include "idbitmap.hpp"
+#include "torrentregistry.hpp"
+
+namespace porla
+{
+    /*
+     * A torrent filter compiled from its JSON form into a predicate tree. A
+     * filter is one of
+     *
+     *   [f1, f2, ...]                                  all of the filters
+     *   {"and": [...]} / {"or": [...]} / {"not": f}
+     *   {"field": "category", "args": "movies"}        equality, or any of
+     *                                                  the values if args is
+     *                                                  an array
+     *   {"field": "size", "op": "range", "args": {"gte": 1, "lt": 5}}
+     *   {"field": "name", "op": "prefix", "args": "ubuntu"}
+     *   {"field": "name", "op": "contains", "args": "22.04"}
+     *
+     * Equality on category, save_path, state and tags is answered from the
+     * registry bitmap indexes. Other predicates are evaluated per torrent, and
+     * only for the torrents left after the indexed siblings in an AND.
+     */
+    class TorrentFilter
+    {
+    public:
+        struct Node;
+
+        // Throws std::invalid_argument if the filter is malformed, or nested
+        // more than 64 levels deep.
+        static TorrentFilter Compile(const nlohmann::json& filter);
+
+        [[nodiscard]] IdBitmap Evaluate(const TorrentRegistry& torrents) const;
+
+        // Evaluates the filter for only the torrents in `within`.
+        [[nodiscard]] IdBitmap Evaluate(const TorrentRegistry& torrents, const IdBitmap& within) const;
+
+    private:
+        explicit TorrentFilter(std::shared_ptr<const Node> root);
+
+        std::shared_ptr<const Node> m_root;
+    };
+}
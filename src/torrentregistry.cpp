@@ -0,0 +1,581 @@
+#include "torrentregistry.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include <libtorrent/torrent_info.hpp>
+
+namespace lt = libtorrent;
+
+using porla::TorrentRegistry;
+
+static constexpr std::size_t MinSlots = 64;
+static constexpr std::size_t NoSlot = SIZE_MAX;
+
+// The number of removals kept for RemovedSince.
+static constexpr std::size_t MaxRemoved = 10000;
+
+static std::size_t HashOf(const lt::info_hash_t& hash)
+{
+    return std::hash<lt::info_hash_t>{}(hash);
+}
+
+static bool SortValueChanged(TorrentRegistry::SortColumn column, const lt::torrent_status& prev, const lt::torrent_status& next)
+{
+    // Compare the strings in place to not copy them on every state update.
+    switch (column)
+    {
+    case TorrentRegistry::SortColumn::Name:     return prev.name != next.name;
+    case TorrentRegistry::SortColumn::SavePath: return prev.save_path != next.save_path;
+    default:
+        return TorrentRegistry::SortValueOf(column, prev) != TorrentRegistry::SortValueOf(column, next);
+    }
+}
+
+TorrentRegistry::const_iterator::const_iterator(const std::vector<std::optional<Entry>>* entries, std::size_t pos)
+    : m_entries(entries)
+    , m_pos(pos)
+{
+    SkipEmpty();
+}
+
+TorrentRegistry::const_iterator& TorrentRegistry::const_iterator::operator++()
+{
+    m_pos++;
+    SkipEmpty();
+    return *this;
+}
+
+void TorrentRegistry::const_iterator::SkipEmpty()
+{
+    while (m_pos < m_entries->size() && !(*m_entries)[m_pos].has_value())
+    {
+        m_pos++;
+    }
+}
+
+template<typename K>
+const porla::IdBitmap* TorrentRegistry::Index<K>::Find(const K& key) const
+{
+    auto const ids = m_ids.find(key);
+    return ids == m_ids.end() ? nullptr : &ids->second;
+}
+
+template<typename K>
+void TorrentRegistry::Index<K>::Remove(const K& key, Id id)
+{
+    auto ids = m_ids.find(key);
+    if (ids == m_ids.end()) return;
+
+    ids->second.Erase(id);
+
+    if (ids->second.Empty())
+    {
+        m_ids.erase(ids);
+    }
+}
+
+TorrentRegistry::TorrentRegistry()
+    : m_slots(MinSlots, EmptySlot)
+    , m_size(0)
+    , m_used_slots(0)
+    , m_version(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count())
+    , m_removed_floor(m_version)
+{
+}
+
+const TorrentRegistry::Entry* TorrentRegistry::At(Id id) const
+{
+    if (id >= m_entries.size() || !m_entries[id].has_value())
+    {
+        return nullptr;
+    }
+
+    return &m_entries[id].value();
+}
+
+const TorrentRegistry::Entry* TorrentRegistry::Find(const lt::info_hash_t& hash) const
+{
+    std::size_t const slot = FindSlot(hash);
+    return slot == NoSlot ? nullptr : &m_entries[m_slots[slot]].value();
+}
+
+const TorrentRegistry::Entry* TorrentRegistry::FindV1(const lt::sha1_hash& hash) const
+{
+    auto const id = m_by_v1.find(hash);
+    return id == m_by_v1.end() ? nullptr : At(id->second);
+}
+
+const TorrentRegistry::Entry* TorrentRegistry::FindV2(const lt::sha256_hash& hash) const
+{
+    auto const id = m_by_v2.find(hash);
+    return id == m_by_v2.end() ? nullptr : At(id->second);
+}
+
+void TorrentRegistry::Clear()
+{
+    m_entries.clear();
+    m_free.clear();
+    m_all = {};
+    m_slots.assign(MinSlots, EmptySlot);
+    m_size = 0;
+    m_used_slots = 0;
+
+    m_by_category.Clear();
+    m_by_save_path.Clear();
+    m_by_state.Clear();
+    m_by_tag.Clear();
+    m_by_v1.clear();
+    m_sort = {};
+    m_by_v2.clear();
+
+    // Versions keep counting, but nothing from before the clear can be
+    // answered anymore.
+    m_by_version.clear();
+    m_removed.clear();
+    m_removed_floor = m_version;
+}
+
+void TorrentRegistry::Erase(const lt::info_hash_t& hash)
+{
+    std::size_t const slot = FindSlot(hash);
+    if (slot == NoSlot) return;
+
+    Id const id = m_slots[slot];
+
+    RemoveFromIndexes(m_entries[id].value());
+
+    m_by_version.erase(m_entries[id]->version);
+    m_removed.emplace_back(++m_version, m_entries[id]->status.info_hashes);
+
+    if (m_removed.size() > MaxRemoved)
+    {
+        m_removed_floor = m_removed.front().first;
+        m_removed.pop_front();
+    }
+
+    m_entries[id].reset();
+    m_free.push_back(id);
+    m_all.Erase(id);
+    m_slots[slot] = Tombstone;
+    m_size--;
+}
+
+TorrentRegistry::Id TorrentRegistry::Insert(const lt::torrent_status& ts)
+{
+    if (auto existing = Mutable(ts.info_hashes))
+    {
+        RemoveFromIndexes(*existing);
+
+        existing->handle = ts.handle;
+        existing->status = ts;
+
+        AddToIndexes(*existing);
+        Bump(*existing);
+
+        return existing->id;
+    }
+
+    if ((m_used_slots + 1) * 2 > m_slots.size())
+    {
+        Grow();
+    }
+
+    Id id;
+
+    if (m_free.empty())
+    {
+        id = static_cast<Id>(m_entries.size());
+        m_entries.emplace_back();
+    }
+    else
+    {
+        id = m_free.back();
+        m_free.pop_back();
+    }
+
+    m_entries[id] = Entry{
+        .id     = id,
+        .handle = ts.handle,
+        .status  = ts,
+        .version = 0
+    };
+
+    std::size_t const mask = m_slots.size() - 1;
+
+    for (std::size_t i = HashOf(ts.info_hashes) & mask;; i = (i + 1) & mask)
+    {
+        if (m_slots[i] == EmptySlot)
+        {
+            m_used_slots++;
+        }
+        else if (m_slots[i] != Tombstone)
+        {
+            continue;
+        }
+
+        m_slots[i] = id;
+        break;
+    }
+
+    m_size++;
+    m_all.Insert(id);
+
+    AddToIndexes(m_entries[id].value());
+    Bump(m_entries[id].value());
+
+    return id;
+}
+
+void TorrentRegistry::Patch(const std::vector<lt::torrent_status>& statuses)
+{
+    for (auto const& ts : statuses)
+    {
+        // Only patch torrents we know of. A state update may arrive for a torrent
+        // that was removed since the update was posted.
+        auto entry = Mutable(ts.info_hashes);
+        if (entry == nullptr) continue;
+
+        Reindex(*entry, ts);
+        entry->status = ts;
+
+        Bump(*entry);
+    }
+}
+
+void TorrentRegistry::SetCategory(const lt::info_hash_t& hash, const std::optional<std::string>& category)
+{
+    auto entry = Mutable(hash);
+    if (entry == nullptr) return;
+
+    if (entry->category.has_value()) m_by_category.Remove(entry->category.value(), entry->id);
+    entry->category = category;
+    if (entry->category.has_value()) m_by_category.Add(entry->category.value(), entry->id);
+
+    Bump(*entry);
+}
+
+void TorrentRegistry::SetTags(const lt::info_hash_t& hash, const std::vector<std::string>& tags)
+{
+    auto entry = Mutable(hash);
+    if (entry == nullptr) return;
+
+    for (auto const& tag : entry->tags) m_by_tag.Remove(tag, entry->id);
+    entry->tags = tags;
+    for (auto const& tag : entry->tags) m_by_tag.Add(tag, entry->id);
+
+    Bump(*entry);
+}
+
+void TorrentRegistry::Touch(const lt::info_hash_t& hash)
+{
+    if (auto entry = Mutable(hash)) Bump(*entry);
+}
+
+bool TorrentRegistry::Update(const lt::info_hash_t& hash, const std::function<void(lt::torrent_status&)>& cb)
+{
+    auto entry = Mutable(hash);
+    if (entry == nullptr) return false;
+
+    lt::torrent_status next = entry->status;
+    cb(next);
+
+    Reindex(*entry, next);
+    entry->status = std::move(next);
+
+    Bump(*entry);
+
+    return true;
+}
+
+const porla::IdBitmap* TorrentRegistry::ByCategory(const std::string& category) const
+{
+    return m_by_category.Find(category);
+}
+
+const porla::IdBitmap* TorrentRegistry::BySavePath(const std::string& save_path) const
+{
+    return m_by_save_path.Find(save_path);
+}
+
+const porla::IdBitmap* TorrentRegistry::ByState(lt::torrent_status::state_t state) const
+{
+    return m_by_state.Find(state);
+}
+
+const porla::IdBitmap* TorrentRegistry::ByTag(const std::string& tag) const
+{
+    return m_by_tag.Find(tag);
+}
+
+void TorrentRegistry::Ordered(
+    SortColumn column,
+    bool ascending,
+    const std::optional<SortCursor>& after,
+    const std::function<bool(const Entry&)>& cb) const
+{
+    auto const& index = m_sort[static_cast<std::size_t>(column)];
+
+    auto const visit = [&](Id id)
+    {
+        auto const entry = At(id);
+        return entry == nullptr || cb(*entry);
+    };
+
+    // Torrents with a value come first. They are skipped entirely when the
+    // cursor is at a torrent without one.
+    if (!after.has_value() || after->value.has_value())
+    {
+        if (ascending)
+        {
+            auto it = after.has_value()
+                ? index.keyed.upper_bound({ after->value.value(), after->id })
+                : index.keyed.begin();
+
+            for (; it != index.keyed.end(); ++it)
+            {
+                if (!visit(it->second)) return;
+            }
+        }
+        else
+        {
+            auto it = after.has_value()
+                ? std::make_reverse_iterator(index.keyed.lower_bound({ after->value.value(), after->id }))
+                : index.keyed.rbegin();
+
+            for (; it != index.keyed.rend(); ++it)
+            {
+                if (!visit(it->second)) return;
+            }
+        }
+    }
+
+    auto it = after.has_value() && !after->value.has_value()
+        ? index.unkeyed.upper_bound(after->id)
+        : index.unkeyed.begin();
+
+    for (; it != index.unkeyed.end(); ++it)
+    {
+        if (!visit(*it)) return;
+    }
+}
+
+void TorrentRegistry::ChangedSince(std::uint64_t version, const std::function<void(const Entry&)>& cb) const
+{
+    for (auto it = m_by_version.upper_bound(version); it != m_by_version.end(); ++it)
+    {
+        cb(m_entries[it->second].value());
+    }
+}
+
+bool TorrentRegistry::RemovedSince(std::uint64_t version, const std::function<void(const lt::info_hash_t&)>& cb) const
+{
+    if (version < m_removed_floor)
+    {
+        return false;
+    }
+
+    auto it = std::upper_bound(
+        m_removed.begin(),
+        m_removed.end(),
+        version,
+        [](std::uint64_t v, auto const& removed) { return v < removed.first; });
+
+    for (; it != m_removed.end(); ++it)
+    {
+        cb(it->second);
+    }
+
+    return true;
+}
+
+bool TorrentRegistry::SortsBefore(bool ascending, const SortCursor& lhs, const SortCursor& rhs)
+{
+    if (lhs.value.has_value() != rhs.value.has_value())
+    {
+        return lhs.value.has_value();
+    }
+
+    if (!lhs.value.has_value())
+    {
+        return lhs.id < rhs.id;
+    }
+
+    auto const l = std::tie(lhs.value.value(), lhs.id);
+    auto const r = std::tie(rhs.value.value(), rhs.id);
+
+    return ascending ? l < r : r < l;
+}
+
+std::optional<TorrentRegistry::SortValue> TorrentRegistry::SortValueOf(SortColumn column, const lt::torrent_status& ts)
+{
+    switch (column)
+    {
+    case SortColumn::DownloadRate: return static_cast<double>(ts.download_rate);
+    case SortColumn::ListPeers:    return static_cast<double>(ts.list_peers);
+    case SortColumn::ListSeeds:    return static_cast<double>(ts.list_seeds);
+    case SortColumn::Name:         return ts.name;
+    case SortColumn::NumPeers:     return static_cast<double>(ts.num_peers);
+    case SortColumn::NumSeeds:     return static_cast<double>(ts.num_seeds);
+    case SortColumn::Progress:     return static_cast<double>(ts.progress);
+    case SortColumn::QueuePosition:
+        return static_cast<int>(ts.queue_position) >= 0
+            ? std::optional<SortValue>(static_cast<double>(static_cast<int>(ts.queue_position)))
+            : std::nullopt;
+    case SortColumn::SavePath:     return ts.save_path;
+    case SortColumn::Size:
+    {
+        auto const ti = ts.torrent_file.lock();
+        return static_cast<double>(ti ? ti->total_size() : -1);
+    }
+    case SortColumn::Total:        return static_cast<double>(ts.total);
+    case SortColumn::TotalDone:    return static_cast<double>(ts.total_done);
+    case SortColumn::UploadRate:   return static_cast<double>(ts.upload_rate);
+    }
+
+    return std::nullopt;
+}
+
+void TorrentRegistry::Bump(Entry& entry)
+{
+    if (entry.version > 0) m_by_version.erase(entry.version);
+    entry.version = ++m_version;
+    m_by_version.emplace(entry.version, entry.id);
+}
+
+void TorrentRegistry::AddToIndexes(const Entry& entry)
+{
+    if (entry.category.has_value()) m_by_category.Add(entry.category.value(), entry.id);
+    m_by_save_path.Add(entry.status.save_path, entry.id);
+    m_by_state.Add(entry.status.state, entry.id);
+    for (auto const& tag : entry.tags) m_by_tag.Add(tag, entry.id);
+    if (entry.status.info_hashes.has_v1()) m_by_v1.insert_or_assign(entry.status.info_hashes.v1, entry.id);
+    if (entry.status.info_hashes.has_v2()) m_by_v2.insert_or_assign(entry.status.info_hashes.v2, entry.id);
+
+    for (std::size_t i = 0; i < SortColumnCount; i++)
+    {
+        auto const column = static_cast<SortColumn>(i);
+        AddToSortIndex(column, SortValueOf(column, entry.status), entry.id);
+    }
+}
+
+void TorrentRegistry::RemoveFromIndexes(const Entry& entry)
+{
+    if (entry.category.has_value()) m_by_category.Remove(entry.category.value(), entry.id);
+    m_by_save_path.Remove(entry.status.save_path, entry.id);
+    m_by_state.Remove(entry.status.state, entry.id);
+    for (auto const& tag : entry.tags) m_by_tag.Remove(tag, entry.id);
+    if (entry.status.info_hashes.has_v1()) m_by_v1.erase(entry.status.info_hashes.v1);
+    if (entry.status.info_hashes.has_v2()) m_by_v2.erase(entry.status.info_hashes.v2);
+
+    for (std::size_t i = 0; i < SortColumnCount; i++)
+    {
+        auto const column = static_cast<SortColumn>(i);
+        RemoveFromSortIndex(column, SortValueOf(column, entry.status), entry.id);
+    }
+}
+
+void TorrentRegistry::Reindex(const Entry& entry, const lt::torrent_status& next)
+{
+    auto const& prev = entry.status;
+
+    if (prev.save_path != next.save_path)
+    {
+        m_by_save_path.Remove(prev.save_path, entry.id);
+        m_by_save_path.Add(next.save_path, entry.id);
+    }
+
+    if (prev.state != next.state)
+    {
+        m_by_state.Remove(prev.state, entry.id);
+        m_by_state.Add(next.state, entry.id);
+    }
+
+    for (std::size_t i = 0; i < SortColumnCount; i++)
+    {
+        auto const column = static_cast<SortColumn>(i);
+
+        if (SortValueChanged(column, prev, next))
+        {
+            RemoveFromSortIndex(column, SortValueOf(column, prev), entry.id);
+            AddToSortIndex(column, SortValueOf(column, next), entry.id);
+        }
+    }
+}
+
+void TorrentRegistry::AddToSortIndex(SortColumn column, const std::optional<SortValue>& value, Id id)
+{
+    auto& index = m_sort[static_cast<std::size_t>(column)];
+
+    if (value.has_value()) index.keyed.insert({ value.value(), id });
+    else                   index.unkeyed.insert(id);
+}
+
+void TorrentRegistry::RemoveFromSortIndex(SortColumn column, const std::optional<SortValue>& value, Id id)
+{
+    auto& index = m_sort[static_cast<std::size_t>(column)];
+
+    if (value.has_value()) index.keyed.erase({ value.value(), id });
+    else                   index.unkeyed.erase(id);
+}
+
+std::size_t TorrentRegistry::FindSlot(const lt::info_hash_t& hash) const
+{
+    std::size_t const mask = m_slots.size() - 1;
+
+    // The table is never more than half full (counting tombstones), so the
+    // probe always ends at an empty slot.
+    for (std::size_t i = HashOf(hash) & mask;; i = (i + 1) & mask)
+    {
+        Id const id = m_slots[i];
+
+        if (id == EmptySlot)
+        {
+            return NoSlot;
+        }
+
+        if (id != Tombstone && m_entries[id]->status.info_hashes == hash)
+        {
+            return i;
+        }
+    }
+}
+
+void TorrentRegistry::Grow()
+{
+    // Size the table for the live entries only. Tombstones are dropped, so a
+    // table full of them is rebuilt without growing.
+    std::size_t capacity = MinSlots;
+
+    while (capacity < (m_size + 1) * 4)
+    {
+        capacity *= 2;
+    }
+
+    m_slots.assign(capacity, EmptySlot);
+    m_used_slots = 0;
+
+    std::size_t const mask = capacity - 1;
+
+    for (auto const& entry : m_entries)
+    {
+        if (!entry.has_value()) continue;
+
+        std::size_t i = HashOf(entry->status.info_hashes) & mask;
+
+        while (m_slots[i] != EmptySlot)
+        {
+            i = (i + 1) & mask;
+        }
+
+        m_slots[i] = entry->id;
+        m_used_slots++;
+    }
+}
+
+TorrentRegistry::Entry* TorrentRegistry::Mutable(const lt::info_hash_t& hash)
+{
+    std::size_t const slot = FindSlot(hash);
+    return slot == NoSlot ? nullptr : &m_entries[m_slots[slot]].value();
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <array>
+#include <deque>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include <libtorrent/info_hash.hpp>
+#include <libtorrent/torrent_handle.hpp>
+#include <libtorrent/torrent_status.hpp>
+
+#include "idbitmap.hpp"
+
+namespace porla
+{
+    /*
+     * Keeps every torrent in the session along with its last known status. The
+     * torrents are looked up by info hash in an open-addressing hash table and
+     * each one gets a dense integer id which stays the same for as long as the
+     * torrent is in the session. Ids of removed torrents are reused.
+     *
+     * Statuses are kept with the fields in StatusFlags. Bitmap indexes by save
+     * path, state, category and tag, and an ordered index for each column
+     * in SortColumn, are maintained as torrents are inserted, updated and
+     * erased.
+     *
+     * Every change to a torrent gives it the next version from a counter kept
+     * by the registry, and removals are logged with theirs, so readers can ask
+     * what changed since a version they have seen. The counter starts at the
+     * time the registry was created, in microseconds, so versions handed out
+     * by an earlier process are below the first one of this and are not
+     * mistaken for versions of this registry.
+     */
+    class TorrentRegistry
+    {
+    public:
+        typedef std::uint32_t Id;
+        typedef std::variant<double, std::string> SortValue;
+
+        enum class SortColumn
+        {
+            DownloadRate,
+            ListPeers,
+            ListSeeds,
+            Name,
+            NumPeers,
+            NumSeeds,
+            Progress,
+            QueuePosition,
+            SavePath,
+            Size,
+            Total,
+            TotalDone,
+            UploadRate
+        };
+
+        static constexpr std::size_t SortColumnCount = static_cast<std::size_t>(SortColumn::UploadRate) + 1;
+
+        // A position in a sort order. Visiting from a cursor continues with the
+        // torrent after it, so pages stay consistent as torrents move around.
+        struct SortCursor
+        {
+            std::optional<SortValue> value;
+            Id id;
+        };
+
+        struct Entry
+        {
+            Id id;
+            libtorrent::torrent_handle handle;
+            libtorrent::torrent_status status;
+            std::optional<std::string> category;
+            std::vector<std::string> tags;
+            std::uint64_t version;
+        };
+
+        class const_iterator
+        {
+        public:
+            const_iterator(const std::vector<std::optional<Entry>>* entries, std::size_t pos);
+
+            const Entry& operator*() const { return *(*m_entries)[m_pos]; }
+            const Entry* operator->() const { return &*(*m_entries)[m_pos]; }
+
+            const_iterator& operator++();
+
+            bool operator==(const const_iterator& other) const { return m_pos == other.m_pos; }
+            bool operator!=(const const_iterator& other) const { return m_pos != other.m_pos; }
+
+        private:
+            void SkipEmpty();
+
+            const std::vector<std::optional<Entry>>* m_entries;
+            std::size_t m_pos;
+        };
+
+        // The status flags the statuses in the registry are fetched with. The
+        // ones left out are costly for libtorrent to compute for every update.
+        static constexpr libtorrent::status_flags_t StatusFlags =
+            libtorrent::torrent_handle::query_accurate_download_counters
+            | libtorrent::torrent_handle::query_last_seen_complete
+            | libtorrent::torrent_handle::query_name
+            | libtorrent::torrent_handle::query_save_path
+            | libtorrent::torrent_handle::query_torrent_file;
+
+        TorrentRegistry();
+
+        const Entry* At(Id id) const;
+        const Entry* Find(const libtorrent::info_hash_t& hash) const;
+        const Entry* FindV1(const libtorrent::sha1_hash& hash) const;
+        const Entry* FindV2(const libtorrent::sha256_hash& hash) const;
+
+        void Clear();
+        void Erase(const libtorrent::info_hash_t& hash);
+        Id Insert(const libtorrent::torrent_status& ts);
+        void Patch(const std::vector<libtorrent::torrent_status>& statuses);
+        void SetCategory(const libtorrent::info_hash_t& hash, const std::optional<std::string>& category);
+        void SetTags(const libtorrent::info_hash_t& hash, const std::vector<std::string>& tags);
+        void Touch(const libtorrent::info_hash_t& hash);
+        bool Update(const libtorrent::info_hash_t& hash, const std::function<void(libtorrent::torrent_status&)>& cb);
+
+        const IdBitmap* ByCategory(const std::string& category) const;
+        const IdBitmap* BySavePath(const std::string& save_path) const;
+        const IdBitmap* ByState(libtorrent::torrent_status::state_t state) const;
+        const IdBitmap* ByTag(const std::string& tag) const;
+
+        // The ids of every torrent in the registry.
+        [[nodiscard]] const IdBitmap& All() const { return m_all; }
+
+        // Visits torrents ordered by the column, with ties broken by id. Torrents
+        // without a value in the column, such as torrents which are not queued
+        // for QueuePosition, come last in either direction. Visiting starts
+        // after the cursor if one is given, and stops when cb returns false.
+        void Ordered(
+            SortColumn column,
+            bool ascending,
+            const std::optional<SortCursor>& after,
+            const std::function<bool(const Entry&)>& cb) const;
+
+        // True if the first torrent comes before the second in the sort order.
+        static bool SortsBefore(bool ascending, const SortCursor& lhs, const SortCursor& rhs);
+        static std::optional<SortValue> SortValueOf(SortColumn column, const libtorrent::torrent_status& ts);
+
+        // The version of the latest change to the registry.
+        [[nodiscard]] std::uint64_t Version() const { return m_version; }
+
+        // Whether the changes after the version can be answered. Versions from
+        // before a clear, from before the oldest removal kept, or from another
+        // process cannot, and the reader has to start over.
+        [[nodiscard]] bool Answers(std::uint64_t version) const { return version >= m_removed_floor && version <= m_version; }
+
+        // Visits the torrents changed after the version, oldest change first.
+        void ChangedSince(std::uint64_t version, const std::function<void(const Entry&)>& cb) const;
+
+        // Visits the info hashes of the torrents removed after the version. Only
+        // the latest removals are kept, and this returns false without visiting
+        // any if older ones are needed.
+        bool RemovedSince(std::uint64_t version, const std::function<void(const libtorrent::info_hash_t&)>& cb) const;
+
+        [[nodiscard]] std::size_t SavePathCount() const { return m_by_save_path.Size(); }
+
+        // One past the largest id in use. Ids below this may be unused.
+        [[nodiscard]] Id IdLimit() const { return static_cast<Id>(m_entries.size()); }
+        [[nodiscard]] std::size_t Size() const { return m_size; }
+
+        [[nodiscard]] const_iterator begin() const { return { &m_entries, 0 }; }
+        [[nodiscard]] const_iterator end() const { return { &m_entries, m_entries.size() }; }
+
+    private:
+        template<typename K>
+        class Index
+        {
+        public:
+            void Add(const K& key, Id id) { m_ids[key].Insert(id); }
+            void Clear() { m_ids.clear(); }
+            const IdBitmap* Find(const K& key) const;
+            void Remove(const K& key, Id id);
+            [[nodiscard]] std::size_t Size() const { return m_ids.size(); }
+
+        private:
+            std::unordered_map<K, IdBitmap> m_ids;
+        };
+
+        struct SortIndex
+        {
+            std::set<std::pair<SortValue, Id>> keyed;
+            std::set<Id> unkeyed;
+        };
+
+        static constexpr Id EmptySlot = UINT32_MAX;
+        static constexpr Id Tombstone = UINT32_MAX - 1;
+
+        void AddToIndexes(const Entry& entry);
+        void RemoveFromIndexes(const Entry& entry);
+        void Reindex(const Entry& entry, const libtorrent::torrent_status& next);
+
+        void Bump(Entry& entry);
+
+        void AddToSortIndex(SortColumn column, const std::optional<SortValue>& value, Id id);
+        void RemoveFromSortIndex(SortColumn column, const std::optional<SortValue>& value, Id id);
+
+        std::size_t FindSlot(const libtorrent::info_hash_t& hash) const;
+        void Grow();
+
+        Entry* Mutable(const libtorrent::info_hash_t& hash);
+
+        std::vector<std::optional<Entry>> m_entries;
+        std::vector<Id> m_free;
+        std::vector<Id> m_slots;
+        std::size_t m_size;
+        std::size_t m_used_slots;
+
+        IdBitmap m_all;
+
+        Index<std::string> m_by_category;
+        Index<std::string> m_by_save_path;
+        Index<int> m_by_state;
+        Index<std::string> m_by_tag;
+        std::array<SortIndex, SortColumnCount> m_sort;
+
+        std::uint64_t m_version;
+        std::map<std::uint64_t, Id> m_by_version;
+        std::deque<std::pair<std::uint64_t, libtorrent::info_hash_t>> m_removed;
+        std::uint64_t m_removed_floor;
+
+        // Hybrid torrents are keyed on both hashes in the table above, so these
+        // find them by either one of them.
+        std::unordered_map<libtorrent::sha1_hash, Id> m_by_v1;
+        std::unordered_map<libtorrent::sha256_hash, Id> m_by_v2;
+    };
+}
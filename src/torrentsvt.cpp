@@ -1,6 +1,12 @@
 #include "torrentsvt.hpp"
 
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <sstream>
+
 #include <boost/log/trivial.hpp>
+#include <libtorrent/hex.hpp>
 #include <libtorrent/torrent_status.hpp>
 #include <sqlite3ext.h>
 
@@ -147,7 +153,11 @@ static const std::vector<std::tuple<std::string, std::function<void(const lt::to
     {"num_pieces", [](const lt::torrent_status& ts, sqlite3_context* ctx) {
         sqlite3_result_int(ctx, ts.num_pieces);
     }},
-    // TODO: distributed_copies
+    {"distributed_copies", [](const lt::torrent_status& ts, sqlite3_context* ctx) {
+        ts.distributed_copies >= 0
+        ? sqlite3_result_double(ctx, ts.distributed_copies)
+        : sqlite3_result_null(ctx);
+    }},
     {"block_size", [](const lt::torrent_status& ts, sqlite3_context* ctx) {
         sqlite3_result_int(ctx, ts.block_size);
     }},
@@ -217,19 +227,274 @@ static const std::vector<std::tuple<std::string, std::function<void(const lt::to
     }},
 };
 
+// The status flags a column needs. Columns not listed here only need the
+// fields libtorrent always fills in.
+static const std::map<std::string, lt::status_flags_t> ColumnFlags =
+{
+    {"distributed_copies", lt::torrent_handle::query_distributed_copies},
+    {"last_seen_complete", lt::torrent_handle::query_last_seen_complete},
+    {"name",               lt::torrent_handle::query_name},
+    {"save_path",          lt::torrent_handle::query_save_path},
+    {"total_done",         lt::torrent_handle::query_accurate_download_counters},
+    {"total_wanted",       lt::torrent_handle::query_accurate_download_counters},
+    {"total_wanted_done",  lt::torrent_handle::query_accurate_download_counters},
+};
+
+static lt::status_flags_t FlagsForColumn(std::size_t column)
+{
+    if (column >= Tbl.size())
+    {
+        return {};
+    }
+
+    auto const flags = ColumnFlags.find(std::get<0>(Tbl[column]));
+    return flags == ColumnFlags.end() ? lt::status_flags_t{} : flags->second;
+}
+
+static int ColumnIndex(const std::string& name)
+{
+    for (std::size_t i = 0; i < Tbl.size(); i++)
+    {
+        if (std::get<0>(Tbl[i]) == name) return static_cast<int>(i);
+    }
+
+    return -1;
+}
+
+static const int ColInfoHashV1   = ColumnIndex("info_hash_v1");
+static const int ColInfoHashV2   = ColumnIndex("info_hash_v2");
+static const int ColIsFinished   = ColumnIndex("is_finished");
+static const int ColIsSeeding    = ColumnIndex("is_seeding");
+static const int ColQueuePos     = ColumnIndex("queue_position");
+static const int ColSavePath     = ColumnIndex("save_path");
+
+// A constraint evaluated by the cursor. The values are copied out of argv
+// since they only live for the duration of xFilter. SQLite checks every
+// constraint again, so the cursor may return rows that do not match, but it
+// must never skip a row that does.
+struct PushedConstraint
+{
+    int column;
+    unsigned char op;
+    bool in;
+
+    // Set if a value cannot be compared by us, in which case every row is
+    // passed on to SQLite.
+    bool any = false;
+
+    std::vector<std::string> text;
+    std::vector<double> numbers;
+};
+
 struct TorrentVTable
 {
     sqlite3_vtab base;
     sqlite3* db;
-    std::map<lt::info_hash_t, lt::torrent_handle>* torrents;
+    const porla::TorrentRegistry* torrents;
 };
 
 struct TorrentVTableCursor
 {
     sqlite3_vtab_cursor base{};
-    std::map<lt::info_hash_t, lt::torrent_handle>::iterator current;
+    porla::TorrentRegistry::Id current;
+
+    // The status flags needed by the columns the query reads, beyond the ones
+    // the registry keeps. If any, the status is fetched once per row.
+    lt::status_flags_t flags;
+
+    std::vector<PushedConstraint> constraints;
+
+    // The ids to visit, in order, when a constraint could be answered by a
+    // lookup in the registry. Otherwise every id is visited.
+    std::optional<std::vector<porla::TorrentRegistry::Id>> candidates;
+    std::size_t candidate;
+
+    // The status of the current row, or nullptr at the end. Points either at
+    // the registry or at the status fetched for the row.
+    const lt::torrent_status* status;
+    lt::torrent_status fetched;
 };
 
+static bool IsTextColumn(int column)
+{
+    return column == ColInfoHashV1 || column == ColInfoHashV2 || column == ColSavePath;
+}
+
+static bool vt_in(sqlite3_index_info* info, int constraint, int handle)
+{
+#if SQLITE_VERSION_NUMBER >= 3038000
+    return sqlite3_vtab_in(info, constraint, handle) != 0;
+#else
+    return false;
+#endif
+}
+
+// Pushed down text constraints are compared byte for byte, which only finds
+// the rows SQLite would match when the constraint uses BINARY collation.
+static bool vt_binary(sqlite3_index_info* info, int constraint)
+{
+#if SQLITE_VERSION_NUMBER >= 3022000
+    auto const collation = sqlite3_vtab_collation(info, constraint);
+    return collation == nullptr || sqlite3_stricmp(collation, "BINARY") == 0;
+#else
+    return false;
+#endif
+}
+
+static void vt_collect(PushedConstraint& constraint, sqlite3_value* value)
+{
+    bool const numeric = sqlite3_value_type(value) == SQLITE_INTEGER
+        || sqlite3_value_type(value) == SQLITE_FLOAT;
+
+    if (IsTextColumn(constraint.column) && sqlite3_value_type(value) == SQLITE_TEXT)
+    {
+        constraint.text.emplace_back(reinterpret_cast<const char*>(sqlite3_value_text(value)));
+    }
+    else if (!IsTextColumn(constraint.column) && numeric)
+    {
+        constraint.numbers.push_back(sqlite3_value_double(value));
+    }
+    else
+    {
+        constraint.any = true;
+    }
+}
+
+static bool vt_matches(const PushedConstraint& constraint, const lt::torrent_status& ts)
+{
+    if (constraint.any)
+    {
+        return true;
+    }
+
+    if (IsTextColumn(constraint.column))
+    {
+        std::string value;
+
+        if (constraint.column == ColSavePath)
+        {
+            value = ts.save_path;
+        }
+        else if (constraint.column == ColInfoHashV1 && ts.info_hashes.has_v1())
+        {
+            value = ToString(ts.info_hashes.v1);
+        }
+        else if (constraint.column == ColInfoHashV2 && ts.info_hashes.has_v2())
+        {
+            value = ToString(ts.info_hashes.v2);
+        }
+        else
+        {
+            return false;
+        }
+
+        return std::find(constraint.text.begin(), constraint.text.end(), value) != constraint.text.end();
+    }
+
+    double value = 0;
+
+    if (constraint.column == ColIsFinished)      value = ts.is_finished ? 1 : 0;
+    else if (constraint.column == ColIsSeeding)  value = ts.is_seeding ? 1 : 0;
+    else if (constraint.column == ColQueuePos)   value = static_cast<int>(ts.queue_position);
+
+    for (double const number : constraint.numbers)
+    {
+        switch (constraint.op)
+        {
+        case SQLITE_INDEX_CONSTRAINT_EQ: if (value == number) return true; break;
+        case SQLITE_INDEX_CONSTRAINT_GT: if (value > number)  return true; break;
+        case SQLITE_INDEX_CONSTRAINT_GE: if (value >= number) return true; break;
+        case SQLITE_INDEX_CONSTRAINT_LT: if (value < number)  return true; break;
+        case SQLITE_INDEX_CONSTRAINT_LE: if (value <= number) return true; break;
+        default: return true;
+        }
+    }
+
+    return false;
+}
+
+// Looks up the ids matching a constraint on an indexed column.
+static std::vector<porla::TorrentRegistry::Id> vt_lookup(const PushedConstraint& constraint, const porla::TorrentRegistry* torrents)
+{
+    std::vector<porla::TorrentRegistry::Id> ids;
+
+    for (auto const& value : constraint.text)
+    {
+        const porla::TorrentRegistry::Entry* entry = nullptr;
+
+        if (constraint.column == ColInfoHashV1 && value.size() == 40)
+        {
+            lt::sha1_hash hash;
+            if (lt::aux::from_hex({ value.c_str(), 40 }, hash.data())) entry = torrents->FindV1(hash);
+        }
+        else if (constraint.column == ColInfoHashV2 && value.size() == 64)
+        {
+            lt::sha256_hash hash;
+            if (lt::aux::from_hex({ value.c_str(), 64 }, hash.data())) entry = torrents->FindV2(hash);
+        }
+        else if (constraint.column == ColSavePath)
+        {
+            if (auto const matching = torrents->BySavePath(value))
+            {
+                ids.insert(ids.end(), matching->begin(), matching->end());
+            }
+        }
+
+        if (entry != nullptr)
+        {
+            ids.push_back(entry->id);
+        }
+    }
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    return ids;
+}
+
+// Moves the cursor to the first matching row at or after its current position
+// and points it at the status for that row.
+static void vt_advance(TorrentVTableCursor* cursor, const porla::TorrentRegistry* torrents)
+{
+    for (;; cursor->candidates ? cursor->candidate++ : cursor->current++)
+    {
+        if (cursor->candidates)
+        {
+            if (cursor->candidate >= cursor->candidates->size()) break;
+            cursor->current = (*cursor->candidates)[cursor->candidate];
+        }
+        else if (cursor->current >= torrents->IdLimit())
+        {
+            break;
+        }
+
+        auto const entry = torrents->At(cursor->current);
+
+        if (entry == nullptr
+            || !std::all_of(
+                cursor->constraints.begin(),
+                cursor->constraints.end(),
+                [entry](auto const& c) { return vt_matches(c, entry->status); }))
+        {
+            continue;
+        }
+
+        if (cursor->flags == lt::status_flags_t{})
+        {
+            cursor->status = &entry->status;
+        }
+        else
+        {
+            cursor->fetched = entry->handle.status(porla::TorrentRegistry::StatusFlags | cursor->flags);
+            cursor->status = &cursor->fetched;
+        }
+
+        return;
+    }
+
+    cursor->status = nullptr;
+}
+
 static int vt_destructor(sqlite3_vtab *pVtab)
 {
     delete reinterpret_cast<TorrentVTable*>(pVtab);
@@ -240,7 +505,7 @@ static int vt_create(sqlite3 *db, void* aux, int argc, const char* const* argv,
 {
     auto vtab = new TorrentVTable();
     vtab->db = db;
-    vtab->torrents = static_cast<std::map<lt::info_hash_t, lt::torrent_handle>*>(aux);
+    vtab->torrents = static_cast<const porla::TorrentRegistry*>(aux);
 
     std::stringstream spec;
     spec << "CREATE TABLE torrents (\n";
@@ -280,9 +545,11 @@ static int vt_destroy(sqlite3_vtab *pVtab)
 
 static int vt_open(sqlite3_vtab *pVTab, sqlite3_vtab_cursor **pp_cursor)
 {
-    auto vtab = reinterpret_cast<TorrentVTable*>(pVTab);
     auto cursor = new TorrentVTableCursor();
-    cursor->current = vtab->torrents->begin();
+    cursor->current = 0;
+    cursor->flags = {};
+    cursor->candidate = 0;
+    cursor->status = nullptr;
 
     *pp_cursor = reinterpret_cast<sqlite3_vtab_cursor*>(cursor);
 
@@ -298,9 +565,8 @@ static int vt_close(sqlite3_vtab_cursor *cur)
 static int vt_eof(sqlite3_vtab_cursor *cur)
 {
     auto cursor = reinterpret_cast<TorrentVTableCursor*>(cur);
-    auto vtab = reinterpret_cast<TorrentVTable*>(cur->pVtab);
 
-    return cursor->current == vtab->torrents->cend() ? 1 : 0;
+    return cursor->status == nullptr ? 1 : 0;
 }
 
 static int vt_next(sqlite3_vtab_cursor *cur)
@@ -308,9 +574,10 @@ static int vt_next(sqlite3_vtab_cursor *cur)
     auto cursor = reinterpret_cast<TorrentVTableCursor*>(cur);
     auto vtab = reinterpret_cast<TorrentVTable*>(cur->pVtab);
 
-    if (cursor->current != vtab->torrents->cend())
+    if (cursor->status != nullptr)
     {
-        cursor->current++;
+        cursor->candidates ? cursor->candidate++ : cursor->current++;
+        vt_advance(cursor, vtab->torrents);
     }
 
     return SQLITE_OK;
@@ -319,10 +586,15 @@ static int vt_next(sqlite3_vtab_cursor *cur)
 static int vt_column(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i)
 {
     auto cursor = reinterpret_cast<TorrentVTableCursor*>(cur);
-    auto const& th = cursor->current->second;
 
-    auto const& [_, resolver] = Tbl.at(i);
-    resolver(th.status(), ctx); // TODO: Check torrent status flags
+    if (cursor->status == nullptr || i < 0 || static_cast<std::size_t>(i) >= Tbl.size())
+    {
+        sqlite3_result_null(ctx);
+        return SQLITE_OK;
+    }
+
+    auto const& [_, resolver] = Tbl[i];
+    resolver(*cursor->status, ctx);
 
     return SQLITE_OK;
 }
@@ -330,25 +602,189 @@ static int vt_column(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i)
 static int vt_rowid(sqlite3_vtab_cursor *cur, sqlite_int64 *p_rowid)
 {
     auto cursor = reinterpret_cast<TorrentVTableCursor*>(cur);
-    auto vtab = reinterpret_cast<TorrentVTable*>(cur->pVtab);
 
-    *p_rowid = std::distance(vtab->torrents->begin(), cursor->current);
+    *p_rowid = static_cast<sqlite_int64>(cursor->current);
 
     return SQLITE_OK;
 }
 
+// The plan in idxStr is the extra status flags to fetch, followed by one
+// "column:op:in" entry per pushed constraint, in argv order. idxNum is the
+// argv position (plus one) of the constraint to look rows up by, or zero for
+// a full scan.
 static int vt_filter(sqlite3_vtab_cursor *p_vtc, int idxNum, const char *idxStr, int argc, sqlite3_value **argv)
 {
     auto cursor = reinterpret_cast<TorrentVTableCursor*>(p_vtc);
     auto vtab = reinterpret_cast<TorrentVTable*>(p_vtc->pVtab);
 
-    cursor->current = vtab->torrents->begin();
+    std::istringstream plan(idxStr != nullptr ? idxStr : "0");
+
+    std::uint32_t flags = 0;
+    plan >> flags;
+
+    cursor->flags = lt::status_flags_t(flags);
+    cursor->constraints.clear();
+    cursor->candidates.reset();
+    cursor->candidate = 0;
+    cursor->current = 0;
+
+    for (int i = 0; i < argc; i++)
+    {
+        PushedConstraint constraint{};
+        int op = 0;
+        int in = 0;
+        char sep;
+
+        if (!(plan >> constraint.column >> sep >> op >> sep >> in))
+        {
+            break;
+        }
+
+        constraint.op = static_cast<unsigned char>(op);
+        constraint.in = in != 0;
+
+#if SQLITE_VERSION_NUMBER >= 3038000
+        if (constraint.in)
+        {
+            sqlite3_value* value = nullptr;
+
+            for (int rc = sqlite3_vtab_in_first(argv[i], &value);
+                 rc == SQLITE_OK && value != nullptr;
+                 rc = sqlite3_vtab_in_next(argv[i], &value))
+            {
+                vt_collect(constraint, value);
+            }
+        }
+        else
+#endif
+        {
+            vt_collect(constraint, argv[i]);
+        }
+
+        cursor->constraints.push_back(std::move(constraint));
+    }
+
+    if (idxNum > 0
+        && idxNum <= static_cast<int>(cursor->constraints.size())
+        && !cursor->constraints[idxNum - 1].any)
+    {
+        cursor->candidates = vt_lookup(cursor->constraints[idxNum - 1], vtab->torrents);
+    }
+
+    vt_advance(cursor, vtab->torrents);
 
     return SQLITE_OK;
 }
 
 static int vt_best_index(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo)
 {
+    auto vtab = reinterpret_cast<TorrentVTable*>(tab);
+    double const total = std::max<double>(static_cast<double>(vtab->torrents->Size()), 1);
+
+    // Collect the status flags needed by the columns the query uses. The last
+    // bit of colUsed stands for every column from 63 and up.
+    lt::status_flags_t flags{};
+
+    for (std::size_t i = 0; i < Tbl.size(); i++)
+    {
+        if (pIdxInfo->colUsed & (static_cast<sqlite3_uint64>(1) << std::min<std::size_t>(i, 63)))
+        {
+            flags |= FlagsForColumn(i);
+        }
+    }
+
+    flags &= ~porla::TorrentRegistry::StatusFlags;
+
+    std::stringstream plan;
+    plan << static_cast<std::uint32_t>(flags);
+
+    // Pick the most selective indexed constraint to look rows up by. Info
+    // hashes are unique, save paths are shared by roughly total / paths rows.
+    int argc = 0;
+    int lookup = 0;
+    int lookup_rank = 0;
+    double lookup_rows = total;
+    bool unique = false;
+    double selectivity = 1;
+
+    for (int i = 0; i < pIdxInfo->nConstraint; i++)
+    {
+        auto const& constraint = pIdxInfo->aConstraint[i];
+
+        if (!constraint.usable)
+        {
+            continue;
+        }
+
+        int const column = constraint.iColumn;
+        unsigned char const op = constraint.op;
+        bool const in = vt_in(pIdxInfo, i, -1);
+
+        int rank = 0;
+        double rows = total;
+
+        if (IsTextColumn(column) && op == SQLITE_INDEX_CONSTRAINT_EQ && vt_binary(pIdxInfo, i))
+        {
+            if (column == ColSavePath)
+            {
+                rank = in ? 1 : 2;
+                rows = total / std::max<double>(static_cast<double>(vtab->torrents->SavePathCount()), 1) * (in ? 3 : 1);
+            }
+            else
+            {
+                rank = in ? 3 : 4;
+                rows = in ? 10 : 1;
+            }
+        }
+        else if ((column == ColIsFinished || column == ColIsSeeding) && op == SQLITE_INDEX_CONSTRAINT_EQ)
+        {
+            selectivity *= 0.5;
+        }
+        else if (column == ColQueuePos
+            && (op == SQLITE_INDEX_CONSTRAINT_EQ
+                || op == SQLITE_INDEX_CONSTRAINT_GT
+                || op == SQLITE_INDEX_CONSTRAINT_GE
+                || op == SQLITE_INDEX_CONSTRAINT_LT
+                || op == SQLITE_INDEX_CONSTRAINT_LE))
+        {
+            selectivity *= op == SQLITE_INDEX_CONSTRAINT_EQ ? 1 / total : 0.33;
+        }
+        else
+        {
+            continue;
+        }
+
+        if (in)
+        {
+            vt_in(pIdxInfo, i, 1);
+        }
+
+        pIdxInfo->aConstraintUsage[i].argvIndex = ++argc;
+        plan << " " << column << ":" << static_cast<int>(op) << ":" << (in ? 1 : 0);
+
+        if (rank > lookup_rank)
+        {
+            lookup = argc;
+            lookup_rank = rank;
+            lookup_rows = rows;
+            unique = rank == 4;
+        }
+    }
+
+    pIdxInfo->idxNum = lookup;
+    pIdxInfo->idxStr = sqlite3_mprintf("%s", plan.str().c_str());
+    pIdxInfo->needToFreeIdxStr = 1;
+
+    // The cost is the number of rows we visit, the estimate is how many of
+    // them we expect to return.
+    pIdxInfo->estimatedCost = lookup_rows;
+    pIdxInfo->estimatedRows = static_cast<sqlite3_int64>(std::max(lookup_rows * selectivity, 1.0));
+
+    if (unique)
+    {
+        pIdxInfo->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+    }
+
     return SQLITE_OK;
 }
 
@@ -379,9 +815,9 @@ static sqlite3_module PorlaSqliteModule =
     nullptr         /* xRollbackto   - function overloading */
 };
 
-int TorrentsVTable::Install(sqlite3* db, std::map<lt::info_hash_t, lt::torrent_handle>& torrents)
+int TorrentsVTable::Install(sqlite3* db, const porla::TorrentRegistry& torrents)
 {
-    int res = sqlite3_create_module(db, "porla", &PorlaSqliteModule, &torrents);
+    int res = sqlite3_create_module(db, "porla", &PorlaSqliteModule, const_cast<porla::TorrentRegistry*>(&torrents));
 
     if (res != SQLITE_OK)
     {
@@ -1,15 +1,14 @@
 #pragma once
 
-#include <map>
-
-#include <libtorrent/torrent_handle.hpp>
 #include <sqlite3.h>
 
+#include "torrentregistry.hpp"
+
 namespace porla
 {
     class TorrentsVTable
     {
     public:
-        static int Install(sqlite3* db, std::map<libtorrent::info_hash_t, libtorrent::torrent_handle>& torrents);
+        static int Install(sqlite3* db, const TorrentRegistry& torrents);
     };
 }
@@ -0,0 +1,103 @@
+#include "trackersvt.hpp"
+
+#include <libtorrent/announce_entry.hpp>
+
+#include "childvt.hpp"
+
+namespace lt = libtorrent;
+
+using porla::TrackersVTable;
+
+// A tracker with the announce state of all its endpoints summed up.
+struct TrackerRow
+{
+    lt::announce_entry entry;
+    int fails;
+    std::string message;
+    int scrape_complete;
+    int scrape_downloaded;
+    int scrape_incomplete;
+    bool updating;
+};
+
+typedef porla::ChildVTable<TrackerRow> Table;
+
+int TrackersVTable::Install(sqlite3* db, const porla::TorrentRegistry& torrents)
+{
+    return Table::Install(
+        db,
+        "trackers",
+        torrents,
+        {
+            {"url", [](const TrackerRow& row, sqlite3_context* ctx) {
+                sqlite3_result_text(ctx, row.entry.url.c_str(), -1, SQLITE_TRANSIENT);
+            }},
+            {"tier", [](const TrackerRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, row.entry.tier);
+            }},
+            {"source", [](const TrackerRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, row.entry.source);
+            }},
+            {"verified", [](const TrackerRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, row.entry.verified ? 1 : 0);
+            }},
+            {"fail_limit", [](const TrackerRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, row.entry.fail_limit);
+            }},
+            {"trackerid", [](const TrackerRow& row, sqlite3_context* ctx) {
+                row.entry.trackerid.empty()
+                    ? sqlite3_result_null(ctx)
+                    : sqlite3_result_text(ctx, row.entry.trackerid.c_str(), -1, SQLITE_TRANSIENT);
+            }},
+            {"fails", [](const TrackerRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, row.fails);
+            }},
+            {"message", [](const TrackerRow& row, sqlite3_context* ctx) {
+                row.message.empty()
+                    ? sqlite3_result_null(ctx)
+                    : sqlite3_result_text(ctx, row.message.c_str(), -1, SQLITE_TRANSIENT);
+            }},
+            {"scrape_complete", [](const TrackerRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, row.scrape_complete);
+            }},
+            {"scrape_downloaded", [](const TrackerRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, row.scrape_downloaded);
+            }},
+            {"scrape_incomplete", [](const TrackerRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, row.scrape_incomplete);
+            }},
+            {"updating", [](const TrackerRow& row, sqlite3_context* ctx) {
+                sqlite3_result_int(ctx, row.updating ? 1 : 0);
+            }},
+        },
+        [](const porla::TorrentRegistry::Entry& entry, std::vector<TrackerRow>& rows)
+        {
+            for (auto& tracker : entry.handle.trackers())
+            {
+                TrackerRow row{
+                    .entry             = std::move(tracker),
+                    .fails             = 0,
+                    .scrape_complete   = -1,
+                    .scrape_downloaded = -1,
+                    .scrape_incomplete = -1,
+                    .updating          = false
+                };
+
+                for (auto const& endpoint : row.entry.endpoints)
+                {
+                    for (auto const& ih : endpoint.info_hashes)
+                    {
+                        row.fails             = std::max(row.fails, static_cast<int>(ih.fails));
+                        row.scrape_complete   = std::max(row.scrape_complete, ih.scrape_complete);
+                        row.scrape_downloaded = std::max(row.scrape_downloaded, ih.scrape_downloaded);
+                        row.scrape_incomplete = std::max(row.scrape_incomplete, ih.scrape_incomplete);
+                        row.updating          = row.updating || ih.updating;
+
+                        if (row.message.empty()) row.message = ih.message;
+                    }
+                }
+
+                rows.push_back(std::move(row));
+            }
+        });
+}
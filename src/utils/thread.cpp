@@ -0,0 +1,29 @@
+#include "thread.hpp"
+
+#include <cstring>
+
+#include <boost/log/trivial.hpp>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+void porla::Utils::PinThread(int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    if (int const res = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set); res != 0)
+    {
+        BOOST_LOG_TRIVIAL(warning) << "Failed to pin thread to CPU " << cpu << ": " << strerror(res);
+        return;
+    }
+
+    BOOST_LOG_TRIVIAL(debug) << "Pinned thread to CPU " << cpu;
+#else
+    BOOST_LOG_TRIVIAL(warning) << "CPU pinning is not supported on this platform";
+#endif
+}
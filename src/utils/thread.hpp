@@ -0,0 +1,8 @@
+#pragma once
+
+namespace porla::Utils
+{
+    // Pins the calling thread to the given CPU. Does nothing on platforms
+    // where this is not supported.
+    void PinThread(int cpu);
+}
@@ -0,0 +1,194 @@
+#include "wireencoding.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <optional>
+#include <vector>
+
+namespace http = boost::beast::http;
+
+using json = nlohmann::json;
+using porla::Utils::WireEncoding;
+
+namespace
+{
+    struct MediaRange
+    {
+        std::string type;
+        double q;
+    };
+}
+
+static std::string_view Trim(std::string_view value)
+{
+    auto const begin = value.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) return {};
+
+    auto const end = value.find_last_not_of(" \t");
+    return value.substr(begin, end - begin + 1);
+}
+
+// Parses a media type, or a comma separated list of media ranges, into their
+// lower case type/subtype and q-value. Parameters other than q are ignored.
+static std::vector<MediaRange> ParseMediaRanges(boost::beast::string_view header)
+{
+    std::vector<MediaRange> ranges;
+    std::string_view rest(header.data(), header.size());
+
+    while (!rest.empty())
+    {
+        auto const comma = rest.find(',');
+        auto const range = rest.substr(0, comma);
+        rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+
+        auto const semicolon = range.find(';');
+        auto const type = Trim(range.substr(0, semicolon));
+
+        if (type.empty()) continue;
+
+        double q = 1.0;
+        auto params = semicolon == std::string_view::npos ? std::string_view() : range.substr(semicolon + 1);
+
+        while (!params.empty())
+        {
+            auto const next = params.find(';');
+            auto const param = Trim(params.substr(0, next));
+            params = next == std::string_view::npos ? std::string_view() : params.substr(next + 1);
+
+            if (param.size() < 2 || std::tolower(static_cast<unsigned char>(param[0])) != 'q' || param[1] != '=')
+            {
+                continue;
+            }
+
+            std::string const value(param.substr(2));
+            char* end = nullptr;
+            q = std::strtod(value.c_str(), &end);
+
+            // A range with an invalid q-value is not acceptable.
+            if (end == value.c_str() || *end != '\0' || q < 0 || q > 1) q = 0;
+        }
+
+        MediaRange media{ .type = std::string(type), .q = q };
+
+        std::transform(
+            media.type.begin(),
+            media.type.end(),
+            media.type.begin(),
+            [](unsigned char c) { return std::tolower(c); });
+
+        ranges.push_back(std::move(media));
+    }
+
+    return ranges;
+}
+
+static std::optional<WireEncoding> FromMediaType(std::string_view type)
+{
+    if (type == "application/json") return WireEncoding::Json;
+    if (type == "application/cbor") return WireEncoding::Cbor;
+    if (type == "application/msgpack" || type == "application/x-msgpack") return WireEncoding::MsgPack;
+
+    return std::nullopt;
+}
+
+WireEncoding porla::Utils::BodyEncoding(boost::beast::string_view content_type)
+{
+    auto const ranges = ParseMediaRanges(content_type);
+
+    return ranges.empty()
+        ? WireEncoding::Json
+        : FromMediaType(ranges.front().type).value_or(WireEncoding::Json);
+}
+
+WireEncoding porla::Utils::RequestEncoding(const http::request<http::string_body>& req)
+{
+    return BodyEncoding(req[http::field::content_type]);
+}
+
+WireEncoding porla::Utils::ResponseEncoding(const http::request<http::string_body>& req)
+{
+    // JSON is also accepted through the wildcards, with the q-value of the
+    // most specific range matching it. The binary encodings must be named,
+    // and are only used when the client prefers them over JSON.
+    double json_q = -1;
+    double application_q = -1;
+    double any_q = -1;
+
+    double best_q = 0;
+    auto best = WireEncoding::Json;
+
+    for (auto const& range : ParseMediaRanges(req[http::field::accept]))
+    {
+        if (range.type == "*/*")
+        {
+            any_q = std::max(any_q, range.q);
+            continue;
+        }
+
+        if (range.type == "application/*")
+        {
+            application_q = std::max(application_q, range.q);
+            continue;
+        }
+
+        auto const encoding = FromMediaType(range.type);
+
+        if (encoding == WireEncoding::Json)
+        {
+            json_q = std::max(json_q, range.q);
+        }
+        else if (encoding.has_value() && range.q > best_q)
+        {
+            best = encoding.value();
+            best_q = range.q;
+        }
+    }
+
+    if (json_q < 0) json_q = application_q >= 0 ? application_q : any_q;
+
+    return best_q > json_q ? best : WireEncoding::Json;
+}
+
+const char* porla::Utils::ContentType(WireEncoding encoding)
+{
+    switch (encoding)
+    {
+    case WireEncoding::Cbor:    return "application/cbor";
+    case WireEncoding::MsgPack: return "application/msgpack";
+    case WireEncoding::Json:    break;
+    }
+
+    return "application/json";
+}
+
+json porla::Utils::Decode(std::string_view data, WireEncoding encoding)
+{
+    switch (encoding)
+    {
+    case WireEncoding::Cbor:    return json::from_cbor(data.begin(), data.end());
+    case WireEncoding::MsgPack: return json::from_msgpack(data.begin(), data.end());
+    case WireEncoding::Json:    break;
+    }
+
+    return json::parse(data);
+}
+
+std::string porla::Utils::Encode(const json& j, WireEncoding encoding)
+{
+    std::string out;
+
+    switch (encoding)
+    {
+    case WireEncoding::Cbor:
+        json::to_cbor(j, out);
+        return out;
+    case WireEncoding::MsgPack:
+        json::to_msgpack(j, out);
+        return out;
+    case WireEncoding::Json:
+        break;
+    }
+
+    return j.dump(-1, ' ', false, json::error_handler_t::replace);
+}
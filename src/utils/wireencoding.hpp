@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include <boost/beast/http.hpp>
+#include <nlohmann/json.hpp>
+
+namespace porla::Utils
+{
+    enum class WireEncoding
+    {
+        Json,
+        Cbor,
+        MsgPack
+    };
+
+    // The encoding of a body with the given Content-Type. Bodies are JSON
+    // unless they are said to be in one of the binary encodings.
+    WireEncoding BodyEncoding(boost::beast::string_view content_type);
+
+    // The encoding of the request body, from its Content-Type.
+    WireEncoding RequestEncoding(const boost::beast::http::request<boost::beast::http::string_body>& req);
+
+    // The encoding to respond with, from the Accept header of the request. A
+    // binary encoding is only chosen when it has a higher q-value than JSON.
+    WireEncoding ResponseEncoding(const boost::beast::http::request<boost::beast::http::string_body>& req);
+
+    const char* ContentType(WireEncoding encoding);
+
+    // Throws nlohmann::json::parse_error if the data is not valid.
+    nlohmann::json Decode(std::string_view data, WireEncoding encoding);
+    std::string Encode(const nlohmann::json& j, WireEncoding encoding);
+}
@@ -0,0 +1,66 @@
+#include "workerpool.hpp"
+
+#include <algorithm>
+
+#include <boost/log/trivial.hpp>
+
+using porla::WorkerPool;
+
+WorkerPool::WorkerPool(const WorkerPoolOptions& options)
+    : m_pool(std::max<std::size_t>(options.threads, 1))
+    , m_queue_limit(std::max<std::size_t>(options.queue_limit, 1))
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    m_pool.join();
+}
+
+void WorkerPool::Join()
+{
+    m_pool.join();
+}
+
+bool WorkerPool::TryPost(std::function<void()> job)
+{
+    auto pending = m_pending.load(std::memory_order_relaxed);
+
+    do
+    {
+        if (pending >= m_queue_limit)
+        {
+            m_rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    while (!m_pending.compare_exchange_weak(pending, pending + 1, std::memory_order_relaxed));
+
+    boost::asio::post(
+        m_pool,
+        [this, job = std::move(job)]()
+        {
+            try
+            {
+                job();
+            }
+            catch (const std::exception& ex)
+            {
+                BOOST_LOG_TRIVIAL(error) << "Error when running worker job: " << ex.what();
+            }
+
+            m_pending.fetch_sub(1, std::memory_order_relaxed);
+            m_completed.fetch_add(1, std::memory_order_relaxed);
+        });
+
+    return true;
+}
+
+WorkerPool::Stats WorkerPool::GetStats() const
+{
+    return Stats{
+        .completed = m_completed.load(),
+        .pending   = m_pending.load(),
+        .rejected  = m_rejected.load()
+    };
+}
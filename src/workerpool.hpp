@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <boost/asio.hpp>
+
+namespace porla
+{
+    struct WorkerPoolOptions
+    {
+        std::size_t threads = 2;
+        std::size_t queue_limit = 64;
+    };
+
+    /*
+     * A fixed set of threads for work which is too heavy for the session
+     * thread. At most `queue_limit` jobs are queued or running at once, and
+     * jobs posted beyond that are rejected so the caller can shed the load
+     * instead of letting the queue grow.
+     */
+    class WorkerPool
+    {
+    public:
+        struct Stats
+        {
+            std::uint64_t completed;
+            std::uint64_t pending;
+            std::uint64_t rejected;
+        };
+
+        explicit WorkerPool(const WorkerPoolOptions& options);
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        ~WorkerPool();
+
+        // Waits for the queued jobs to finish. No jobs may be posted after.
+        void Join();
+
+        // Returns false, without running the job, if the pool is saturated.
+        bool TryPost(std::function<void()> job);
+
+        [[nodiscard]] Stats GetStats() const;
+
+    private:
+        boost::asio::thread_pool m_pool;
+        std::size_t m_queue_limit;
+
+        std::atomic_uint64_t m_completed{0};
+        std::atomic_uint64_t m_pending{0};
+        std::atomic_uint64_t m_rejected{0};
+    };
+}